@@ -1,12 +1,137 @@
 #include "Compiler.h"
 #include "Parser.h"
+#include <climits>
 
 using namespace Jet;
 
+const char* Jet::Instructions[] =
+{
+	"Add",
+	"Mul",
+	"Div",
+	"Sub",
+	"Modulus",
+
+	"Negate",
+
+	"BAnd",
+	"BOr",
+	"Xor",
+	"BNot",
+	"LeftShift",
+	"RightShift",
+
+	"Eq",
+	"NotEq",
+	"Lt",
+	"Gt",
+	"LtE",
+	"GtE",
+	"Incr",
+	"Decr",
+	"Dup",
+	"Pop",
+	"LdInt",
+	"LdReal",
+	"LdNull",
+	"LdStr",
+	"LoadFunction",
+	"Jump",
+	"JumpTrue",
+	"JumpTruePeek",
+	"JumpFalse",
+	"JumpFalsePeek",
+	"NewArray",
+	"NewObject",
+
+	"Store",
+	"Load",
+	//local vars
+	"LStore",
+	"LLoad",
+	//captured vars
+	"CStore",
+	"CLoad",
+	"CInit",
+
+	"ForEach",
+
+	//index functions
+	"LoadAt",
+	"StoreAt",
+
+	//these all work on the last value in the stack
+	"ECall",
+
+	"Call",
+	"Return",
+	"Resume",
+	"Yield",
+	"Close",
+	"TailCall",
+	"TailECall",
+
+	//superinstructions from the peephole pass
+	"LtLocalsJumpFalse",
+	"LtLocalImmJumpFalse",
+	"AddLocalImm",
+	"IncrLocal",
+	"InvokeMethod",
+
+	//three-address register instructions
+	"AddR",
+	"SubR",
+	"MulR",
+	"DivR",
+	"ModulusR",
+	"BAndR",
+	"BOrR",
+	"XorR",
+	"LeftShiftR",
+	"RightShiftR",
+	"EqR",
+	"NotEqR",
+	"LtR",
+	"GtR",
+	"LtER",
+	"GtER",
+
+	//quickened instructions
+	"AddIntInt",
+	"AddRealReal",
+	"SubIntInt",
+	"SubRealReal",
+	"MulIntInt",
+	"MulRealReal",
+	"DivIntInt",
+	"DivRealReal",
+	"LtIntInt",
+	"LtRealReal",
+	"GtIntInt",
+	"GtRealReal",
+	"LtEIntInt",
+	"LtERealReal",
+	"GtEIntInt",
+	"GtERealReal",
+	"EqIntInt",
+	"EqRealReal",
+	"NotEqIntInt",
+	"NotEqRealReal",
+
+	//dummy instructions for the assembler/debugging
+	"Label",
+	"Local",
+	"Global",
+	"Capture",
+	"DebugLine",
+	"Function"
+};
+
 CompilerContext::CompilerContext(void)
 {
 	this->vararg = false;
 	this->isgenerator = false;
+	this->registers = false;
 	this->closures = 0;
 	this->parent = 0;
 	this->uuid = 0;
@@ -134,6 +259,8 @@ std::vector<IntermediateInstruction> CompilerContext::Compile(BlockExpression* e
 
 		this->localindex = 0;
 		this->closures = 0;
+		this->temporaries.clear();
+		this->freeregisters.clear();
 
 		throw e;
 	}
@@ -158,14 +285,148 @@ std::vector<IntermediateInstruction> CompilerContext::Compile(BlockExpression* e
 	//add custom operators
 	this->localindex = 0;
 	this->closures = 0;
+	this->temporaries.clear();
+	this->freeregisters.clear();
 
 	//this->PrintAssembly();
 
 	auto temp = std::move(this->out);
 	this->out.clear();
+#ifndef JET_NO_PEEPHOLE
+	this->Optimize(temp);
+#endif
 	return std::move(temp);
 }
 
+//index of the next real instruction after i, debug lines are skipped
+//returns -1 if a label or other pseudo instruction is in the way
+static int NextInstruction(const std::vector<IntermediateInstruction>& code, int i)
+{
+	for (i++; i < (int)code.size(); i++)
+	{
+		if (code[i].type == InstructionType::DebugLine)
+			continue;
+		if (code[i].type >= InstructionType::Label)
+			return -1;
+		return i;
+	}
+	return -1;
+}
+
+static bool IsType(const std::vector<IntermediateInstruction>& code, int i, InstructionType type)
+{
+	return i >= 0 && code[i].type == type;
+}
+
+void CompilerContext::Optimize(std::vector<IntermediateInstruction>& code)
+{
+	std::vector<IntermediateInstruction> result;
+	result.reserve(code.size());
+#ifdef JET_PEEPHOLE_DUMP
+	const char* function = "";
+	int fused[(int)InstructionType::Label] = {0};
+#endif
+
+	for (int i = 0; i < (int)code.size(); i++)
+	{
+		auto& ins = code[i];
+		if (ins.type >= InstructionType::Label)
+		{
+#ifdef JET_PEEPHOLE_DUMP
+			if (ins.type == InstructionType::Function)
+				function = ins.string;
+#endif
+			result.push_back(ins);
+			continue;
+		}
+
+		int j = NextInstruction(code, i);
+		int k = j >= 0 ? NextInstruction(code, j) : -1;
+		int l = k >= 0 ? NextInstruction(code, k) : -1;
+
+		IntermediateInstruction fuse(ins.type);
+		int last = -1;//last instruction consumed by the fusion
+		if (ins.type == InstructionType::LLoad && IsType(code, k, InstructionType::Lt) && IsType(code, l, InstructionType::JumpFalse))
+		{
+			if (IsType(code, j, InstructionType::LLoad))
+			{
+				//LLoad a; LLoad b; Lt; JumpFalse L
+				fuse = IntermediateInstruction(InstructionType::LtLocalsJumpFalse, code[i].first, code[j].first);
+				fuse.string = code[l].string;
+				last = l;
+			}
+			else if (IsType(code, j, InstructionType::LdInt) && code[j].int_second >= SHRT_MIN && code[j].int_second <= SHRT_MAX)
+			{
+				//LLoad a; LdInt imm; Lt; JumpFalse L
+				fuse = IntermediateInstruction(InstructionType::LtLocalImmJumpFalse, (int)code[j].int_second, code[i].first);
+				fuse.string = code[l].string;
+				last = l;
+			}
+		}
+		if (last < 0 && ins.type == InstructionType::LLoad && IsType(code, j, InstructionType::LdInt) && IsType(code, k, InstructionType::Add)
+			&& IsType(code, l, InstructionType::LStore) && code[l].first == ins.first
+			&& code[j].int_second >= INT_MIN && code[j].int_second <= INT_MAX)
+		{
+			//LLoad x; LdInt imm; Add; LStore x
+			fuse = IntermediateInstruction(InstructionType::AddLocalImm, (int)code[j].int_second, ins.first);
+			last = l;
+		}
+		if (last < 0 && ins.type == InstructionType::LLoad && (IsType(code, j, InstructionType::Incr) || IsType(code, j, InstructionType::Decr))
+			&& IsType(code, k, InstructionType::LStore) && code[k].first == ins.first)
+		{
+			//LLoad x; Incr/Decr; LStore x
+			fuse = IntermediateInstruction(InstructionType::IncrLocal, code[j].type == InstructionType::Incr ? 1 : -1, ins.first);
+			last = k;
+		}
+		if (last < 0 && (ins.type == InstructionType::LLoad || ins.type == InstructionType::Load || ins.type == InstructionType::CLoad)
+			&& IsType(code, j, InstructionType::LoadAt) && code[j].string
+			&& IsType(code, k, InstructionType::ECall) && code[k].second == 1 && code[k].first <= UCHAR_MAX)
+		{
+			//obj:name(...) with a plain variable as receiver, the receiver is already
+			//on the stack as the first argument so it does not need to be loaded again
+			fuse = IntermediateInstruction(InstructionType::InvokeMethod, code[k].first);
+			fuse.string = code[j].string;
+			delete[] ins.string;
+			last = k;
+		}
+
+		if (last < 0)
+		{
+			result.push_back(ins);
+			continue;
+		}
+
+#ifdef JET_PEEPHOLE_DUMP
+		printf("Peephole %s:", function);
+		for (int n = i; n <= last; n++)
+		{
+			if (code[n].type != InstructionType::DebugLine)
+				printf(" %s", Instructions[(int)code[n].type]);
+		}
+		printf(" => %s\n", Instructions[(int)fuse.type]);
+		fused[(int)fuse.type]++;
+#endif
+
+		//keep the line info of the fused instructions
+		for (int n = i + 1; n < last; n++)
+		{
+			if (code[n].type == InstructionType::DebugLine)
+				result.push_back(code[n]);
+		}
+		result.push_back(fuse);
+		i = last;
+	}
+
+#ifdef JET_PEEPHOLE_DUMP
+	for (int n = 0; n < (int)InstructionType::Label; n++)
+	{
+		if (fused[n])
+			printf("Peephole: %d x %s\n", fused[n], Instructions[n]);
+	}
+#endif
+	code = std::move(result);
+}
+
 bool CompilerContext::RegisterLocal(const std::string name)
 {
 	//neeed to store locals in a contiguous array, even with different scopes
@@ -266,6 +527,122 @@ void CompilerContext::UnaryOperation(TokenType operation)
 	}
 }
 
+static InstructionType RegisterInstruction(TokenType operation)
+{
+	switch (operation)
+	{
+	case TokenType::Plus:
+	case TokenType::AddAssign:
+		return InstructionType::AddR;
+	case TokenType::Asterisk:
+	case TokenType::MultiplyAssign:
+		return InstructionType::MulR;
+	case TokenType::Minus:
+	case TokenType::SubtractAssign:
+		return InstructionType::SubR;
+	case TokenType::Slash:
+	case TokenType::DivideAssign:
+		return InstructionType::DivR;
+	case TokenType::Modulo:
+		return InstructionType::ModulusR;
+	case TokenType::Equals:
+		return InstructionType::EqR;
+	case TokenType::NotEqual:
+		return InstructionType::NotEqR;
+	case TokenType::LessThan:
+		return InstructionType::LtR;
+	case TokenType::GreaterThan:
+		return InstructionType::GtR;
+	case TokenType::LessThanEqual:
+		return InstructionType::LtER;
+	case TokenType::GreaterThanEqual:
+		return InstructionType::GtER;
+	case TokenType::OrAssign:
+	case TokenType::BOr:
+		return InstructionType::BOrR;
+	case TokenType::AndAssign:
+	case TokenType::BAnd:
+		return InstructionType::BAndR;
+	case TokenType::XorAssign:
+	case TokenType::Xor:
+		return InstructionType::XorR;
+	case TokenType::LeftShift:
+		return InstructionType::LeftShiftR;
+	case TokenType::RightShift:
+		return InstructionType::RightShiftR;
+	default:
+		return InstructionType::Label;//no register form
+	}
+}
+
+bool CompilerContext::IsRegisterOperation(TokenType operation)
+{
+	return RegisterInstruction(operation) != InstructionType::Label;
+}
+
+int CompilerContext::LocalRegister(const std::string& variable)
+{
+	Scope* ptr = this->scope;
+	while (ptr)
+	{
+		for (unsigned int i = 0; i < ptr->localvars.size(); i++)
+		{
+			if (ptr->localvars[i].name == variable)
+				return ptr->localvars[i].local;
+		}
+		ptr = ptr->previous;
+	}
+	return -1;
+}
+
+int CompilerContext::AllocRegister()
+{
+	if (this->freeregisters.size() > 0)
+	{
+		int reg = this->freeregisters.back();
+		this->freeregisters.pop_back();
+		return reg;
+	}
+
+	if (this->localindex >= 255)
+		throw CompilerException(this->filename, this->lastline, "Too many locals: over 256 locals in function!");
+
+	//temporaries are locals without a name, they still need debug info
+	int reg = this->localindex++;
+	this->temporaries.insert(reg);
+	out.push_back(IntermediateInstruction(InstructionType::Local, "(temp)", 0));
+	return reg;
+}
+
+void CompilerContext::FreeRegister(int reg)
+{
+	if (this->temporaries.find(reg) != this->temporaries.end())
+		this->freeregisters.push_back(reg);
+}
+
+//operands are packed into first as dst | lhs << 8 | kind << 16, kind 0 means the rhs
+//register is in int_second, 1 and 2 mean an int or real constant in second
+void CompilerContext::RegisterOperation(TokenType operation, int dst, int lhs, int rhs)
+{
+	IntermediateInstruction ins(RegisterInstruction(operation), dst | (lhs << 8));
+	ins.int_second = rhs;
+	out.push_back(ins);
+}
+
+void CompilerContext::RegisterOperationInt(TokenType operation, int dst, int lhs, int64_t value)
+{
+	IntermediateInstruction ins(RegisterInstruction(operation), dst | (lhs << 8) | (1 << 16));
+	ins.int_second = value;
+	out.push_back(ins);
+}
+
+void CompilerContext::RegisterOperationReal(TokenType operation, int dst, int lhs, double value)
+{
+	IntermediateInstruction ins(RegisterInstruction(operation), dst | (lhs << 8) | (2 << 16));
+	ins.second = value;
+	out.push_back(ins);
+}
+
 CompilerContext* CompilerContext::AddFunction(std::string name, unsigned int args, bool vararg)
 {
 	//push instruction that sets the function
@@ -277,6 +654,7 @@ CompilerContext* CompilerContext::AddFunction(std::string name, unsigned int arg
 	newfun->uuid = this->uuid;
 	newfun->parent = this;
 	newfun->vararg = vararg;
+	newfun->registers = this->registers;
 	this->functions[fname] = newfun;
 
 	//store the function in the variable
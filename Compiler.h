@@ -10,6 +10,10 @@
 #include "JetInstructions.h"
 #include "JetExceptions.h"
 
+//fuse common instruction sequences into superinstructions at the end of Compile
+//#define JET_NO_PEEPHOLE
+//print every fusion made by the peephole pass
+//#define JET_PEEPHOLE_DUMP
 
 namespace Jet
 {
@@ -139,6 +143,12 @@ namespace Jet
 
 		CompilerContext* parent;//parent scoping function
 
+		//register mode, pure arithmetic on locals is compiled to three-address
+		//instructions that work on the local slots, temporaries get extra slots
+		bool registers;
+		std::unordered_set<int> temporaries;//slots allocated by AllocRegister
+		std::vector<int> freeregisters;//temporaries that can be reused
+
 		std::vector<IntermediateInstruction> out;//list of instructions generated
 
 	public:
@@ -153,7 +163,13 @@ namespace Jet
 		void FinalizeFunction(CompilerContext* c);
 
 		std::vector<IntermediateInstruction> Compile(BlockExpression* expr, const char* filename);
+
+		bool RegisterMode() const { return this->registers; }
+		void SetRegisterMode(bool enable) { this->registers = enable; }
 	private:
+		//peephole pass, replaces fixed sequences with superinstructions
+		void Optimize(std::vector<IntermediateInstruction>& code);
+
 		void Compile()
 		{
 			//append functions to end here
@@ -238,6 +254,23 @@ namespace Jet
 		void BinaryOperation(TokenType operation);
 		void UnaryOperation(TokenType operation);
 
+		//register mode
+		static bool IsRegisterOperation(TokenType operation);
+		int LocalRegister(const std::string& variable);//slot of a local of this function, -1 if it is not one
+		int AllocRegister();
+		void FreeRegister(int reg);//only temporaries are released
+
+		//dst = lhs operation rhs, all registers
+		void RegisterOperation(TokenType operation, int dst, int lhs, int rhs);
+		//dst = lhs operation constant
+		void RegisterOperationInt(TokenType operation, int dst, int lhs, int64_t value);
+		void RegisterOperationReal(TokenType operation, int dst, int lhs, double value);
+
+		void LoadRegister(int reg)
+		{
+			out.push_back(IntermediateInstruction(InstructionType::LLoad, reg, 0));
+		}
+
 		//stack operations
 		void Pop()
 		{
@@ -383,9 +416,25 @@ namespace Jet
 			out.push_back(IntermediateInstruction(InstructionType::Call, function, args));
 		}
 
-		void ECall(unsigned int args)
+		//self marks a "obj:method()" call, the peephole pass uses it to find method calls
+		void ECall(unsigned int args, bool self = false)
 		{
-			out.push_back(IntermediateInstruction(InstructionType::ECall, args));
+			out.push_back(IntermediateInstruction(InstructionType::ECall, args, self ? 1.0 : 0.0));
+		}
+
+		//turns the Call/ECall just emitted into its tail form, used for "return f(...)"
+		void TailCall()
+		{
+			for (int i = (int)out.size() - 1; i >= 0; i--)
+			{
+				if (out[i].type == InstructionType::DebugLine)
+					continue;
+				if (out[i].type == InstructionType::Call)
+					out[i].type = InstructionType::TailCall;
+				else if (out[i].type == InstructionType::ECall)
+					out[i].type = InstructionType::TailECall;
+				break;
+			}
 		}
 
 		void LoadIndex(const char* index = 0)
@@ -398,6 +447,30 @@ namespace Jet
 			out.push_back(IntermediateInstruction(InstructionType::StoreAt, index));
 		}
 
+		//StoreAt with the key on the stack that can replace a shared string by a copy, see
+		//JetContext::StoreIndexOf. The stores up to EndStoreBack put the copy back where the
+		//string was loaded from, a jump leads past them when the string was written in place
+		int StoreIndexBack()
+		{
+			this->StoreIndex();
+			int store = (int)out.size() - 1;
+			this->Jump(("_storeback" + this->GetUUID()).c_str());
+			return store;
+		}
+
+		void EndStoreBack(int store)
+		{
+			//the VM skips as many instructions itself when it can
+			int count = 0;
+			for (unsigned int i = store + 1; i < out.size(); i++)
+			{
+				if (out[i].type < InstructionType::Label)
+					count++;
+			}
+			out[store].first = count;
+			this->Label(out[store + 1].string);
+		}
+
 		void NewArray(unsigned int number)
 		{
 			out.push_back(IntermediateInstruction(InstructionType::NewArray, number));
@@ -4,6 +4,52 @@
 
 using namespace Jet;
 
+//register mode helpers, see OperatorExpression::IsRegisterExpression
+static bool IsRegisterOperand(CompilerContext* context, Expression* expr, bool constant)
+{
+	if (auto name = dynamic_cast<NameExpression*>(expr))
+		return context->LocalRegister(name->GetName()) >= 0;
+	if (auto op = dynamic_cast<OperatorExpression*>(expr))
+		return op->IsRegisterExpression(context);
+	return constant && (dynamic_cast<IntNumberExpression*>(expr) || dynamic_cast<RealNumberExpression*>(expr));
+}
+
+//returns the register holding the operand, -1 for a constant
+static int CompileRegisterOperand(CompilerContext* context, Expression* expr)
+{
+	if (auto name = dynamic_cast<NameExpression*>(expr))
+		return context->LocalRegister(name->GetName());
+	if (auto op = dynamic_cast<OperatorExpression*>(expr))
+		return op->CompileRegister(context);
+	return -1;
+}
+
+static void EmitRegisterOperation(CompilerContext* context, TokenType operation, int dst, int lhs, int rhs, Expression* right)
+{
+	if (rhs >= 0)
+		context->RegisterOperation(operation, dst, lhs, rhs);
+	else if (auto number = dynamic_cast<IntNumberExpression*>(right))
+		context->RegisterOperationInt(operation, dst, lhs, number->GetValue());
+	else
+		context->RegisterOperationReal(operation, dst, lhs, static_cast<RealNumberExpression*>(right)->GetValue());
+}
+
+static bool IsComparison(TokenType operation)
+{
+	switch (operation)
+	{
+	case TokenType::Equals:
+	case TokenType::NotEqual:
+	case TokenType::LessThan:
+	case TokenType::GreaterThan:
+	case TokenType::LessThanEqual:
+	case TokenType::GreaterThanEqual:
+		return true;
+	default:
+		return false;
+	}
+}
+
 void PrefixExpression::Compile(CompilerContext* context)
 {
 	context->Line(this->_operator.line);
@@ -87,10 +133,33 @@ void IndexExpression::CompileStore(CompilerContext* context)
 	else
 	{
 		index->Compile(context);
-		context->StoreIndex();
+
+		//a shared string is copied instead of written, the copy goes back where it came from
+		if (IndexExpression::CanStoreBack(left))
+		{
+			int store = context->StoreIndexBack();
+			dynamic_cast<IStorableExpression*>(left)->CompileStore(context);
+			context->EndStoreBack(store);
+		}
+		else
+			context->StoreIndex();
 	}
 }
 
+bool IndexExpression::CanStoreBack(Expression* location)
+{
+	if (dynamic_cast<NameExpression*>(location))
+		return true;
+
+	//a[b] once more, for rows of a grid of strings and the like
+	auto element = dynamic_cast<IndexExpression*>(location);
+	if (element == 0 || dynamic_cast<NameExpression*>(element->left) == 0)
+		return false;
+	auto key = element->index;
+	return dynamic_cast<NameExpression*>(key) || dynamic_cast<StringExpression*>(key)
+		|| dynamic_cast<IntNumberExpression*>(key) || dynamic_cast<RealNumberExpression*>(key);
+}
+
 void ObjectExpression::Compile(CompilerContext* context)
 {
 	int count = 0;
@@ -177,6 +246,21 @@ void SwapExpression::Compile(CompilerContext* context)
 
 void AssignExpression::Compile(CompilerContext* context)
 {
+	//register mode, "x = a + b" writes the result straight into the local
+	auto name = dynamic_cast<NameExpression*>(this->left);
+	auto op = dynamic_cast<OperatorExpression*>(this->right);
+	if (name && op && op->IsRegisterExpression(context))
+	{
+		int dst = context->LocalRegister(name->GetName());
+		if (dst >= 0)
+		{
+			op->CompileRegister(context, dst);
+			if (dynamic_cast<BlockExpression*>(this->Parent) == 0)
+				context->LoadRegister(dst);
+			return;
+		}
+	}
+
 	this->right->Compile(context);
 
 	if (dynamic_cast<BlockExpression*>(this->Parent) == 0)
@@ -214,7 +298,7 @@ void CallExpression::Compile(CompilerContext* context)
 			left->Compile(context);//pushes function
 
 			//increase number of args
-			context->ECall((unsigned int)args->size() + 1);
+			context->ECall((unsigned int)args->size() + 1, true);
 		}
 		else
 		{
@@ -251,6 +335,22 @@ void NameExpression::Compile(CompilerContext* context)
 void OperatorAssignExpression::Compile(CompilerContext* context)
 {
 	context->Line(token.line);
+	//register mode, "x += y" becomes a single instruction on the local
+	auto name = dynamic_cast<NameExpression*>(this->left);
+	if (name && context->RegisterMode() && CompilerContext::IsRegisterOperation(token.type) && IsRegisterOperand(context, this->right, true))
+	{
+		int dst = context->LocalRegister(name->GetName());
+		if (dst >= 0)
+		{
+			int rhs = CompileRegisterOperand(context, this->right);
+			context->FreeRegister(rhs);
+			EmitRegisterOperation(context, token.type, dst, dst, rhs, this->right);
+			if (dynamic_cast<BlockExpression*>(this->Parent) == 0)
+				context->LoadRegister(dst);
+			return;
+		}
+	}
+
 	//https://dl.dropboxusercontent.com/u/675786/ShareX/2015-02/08_22-33-22.png fix this
 	this->left->Compile(context);
 	this->right->Compile(context);
@@ -290,6 +390,18 @@ void OperatorExpression::Compile(CompilerContext* context)
 		return;
 	}
 
+	//register mode, comparisons stay on the stack so the peephole pass can fuse them with the jump,
+	//a single operation stays there too as it would only add a temporary to the frame
+	bool nested = dynamic_cast<OperatorExpression*>(this->left) || dynamic_cast<OperatorExpression*>(this->right);
+	if (nested && IsComparison(this->_operator.type) == false && this->IsRegisterExpression(context))
+	{
+		int reg = this->CompileRegister(context);
+		if (dynamic_cast<BlockExpression*>(this->Parent) == 0)
+			context->LoadRegister(reg);
+		context->FreeRegister(reg);
+		return;
+	}
+
 	this->left->Compile(context);
 	this->right->Compile(context);
 	context->BinaryOperation(this->_operator.type);
@@ -299,6 +411,40 @@ void OperatorExpression::Compile(CompilerContext* context)
 		context->Pop();
 }
 
+bool OperatorExpression::IsRegisterExpression(CompilerContext* context)
+{
+	if (context->RegisterMode() == false || CompilerContext::IsRegisterOperation(this->_operator.type) == false)
+		return false;
+
+	//only the right hand side can be a constant
+	return IsRegisterOperand(context, this->left, false) && IsRegisterOperand(context, this->right, true);
+}
+
+void OperatorExpression::CompileRegisterOperands(CompilerContext* context, int& lhs, int& rhs)
+{
+	lhs = CompileRegisterOperand(context, this->left);
+	rhs = CompileRegisterOperand(context, this->right);
+
+	//operands are read before the result is written, so the result can reuse their temporaries
+	context->FreeRegister(rhs);
+	context->FreeRegister(lhs);
+}
+
+void OperatorExpression::CompileRegisterOperation(CompilerContext* context, int dst, int lhs, int rhs)
+{
+	EmitRegisterOperation(context, this->_operator.type, dst, lhs, rhs, this->right);
+}
+
+int OperatorExpression::CompileRegister(CompilerContext* context, int dst)
+{
+	int lhs, rhs;
+	this->CompileRegisterOperands(context, lhs, rhs);
+	if (dst < 0)
+		dst = context->AllocRegister();
+	this->CompileRegisterOperation(context, dst, lhs, rhs);
+	return dst;
+}
+
 void FunctionExpression::Compile(CompilerContext* context)
 {
 	context->Line(token.line);
@@ -355,8 +501,18 @@ void Jet::LocalExpression::Compile(CompilerContext* context)
 
 	for (auto v : *this->defines)
 	{
+		//ĴģʽֱӰѽд±
+		auto op = dynamic_cast<OperatorExpression*>(v.m_Experssion);
+		if (op && op->IsRegisterExpression(context) == false)
+			op = nullptr;
+
 		//ʽֵ
-		if (v.m_Experssion != nullptr)
+		int lhs, rhs;
+		if (op != nullptr)
+		{
+			op->CompileRegisterOperands(context, lhs, rhs);
+		}
+		else if (v.m_Experssion != nullptr)
 		{
 			v.m_Experssion->Compile(context);
 		}
@@ -368,7 +524,11 @@ void Jet::LocalExpression::Compile(CompilerContext* context)
 		}
 
 		//ݴ洢
-		if (v.m_Experssion != nullptr)
+		if (op != nullptr)
+		{
+			op->CompileRegisterOperation(context, context->LocalRegister(v.m_Name.text), lhs, rhs);
+		}
+		else if (v.m_Experssion != nullptr)
 		{
 			context->StoreLocal(v.m_Name.text);
 		}
@@ -319,6 +319,11 @@ namespace Jet
 		void Compile(CompilerContext* context);
 
 		void CompileStore(CompilerContext* context);
+
+	private:
+		//whether a copy can be stored into location again without evaluating anything
+		//with side effects a second time
+		static bool CanStoreBack(Expression* location);
 	};
 
 	class AssignExpression: public Expression
@@ -485,6 +490,17 @@ namespace Jet
 		}
 
 		void Compile(CompilerContext* context);
+
+		//register mode: true if the expression only reads locals of this function and
+		//number constants, so its operands can be read in place from the local slots
+		bool IsRegisterExpression(CompilerContext* context);
+
+		//evaluates both operands into registers, rhs is -1 for a constant
+		void CompileRegisterOperands(CompilerContext* context, int& lhs, int& rhs);
+		void CompileRegisterOperation(CompilerContext* context, int dst, int lhs, int rhs);
+
+		//evaluates the expression into dst, or a new temporary if dst is -1
+		int CompileRegister(CompilerContext* context, int dst = -1);
 	};
 
 	class StatementExpression: public Expression
@@ -935,7 +951,12 @@ namespace Jet
 			context->Line(token.line);
 
 			if (right)
+			{
 				right->Compile(context);
+				//return f(...) reuses this frame for the call
+				if (dynamic_cast<CallExpression*>(right))
+					context->TailCall();
+			}
 			else
 				context->Null();//bad value to prevent use
 
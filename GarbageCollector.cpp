@@ -1,18 +1,67 @@
 #include "GarbageCollector.h"
 #include "JetContext.h"
+#include "ParallelMark.h"
+#include <climits>
 
 using namespace Jet;
 
 //#define JETGCDEBUG
 
+//the _gc metamethod of a userdata from its prototype table, null if it has none
+static Value Finalizer(JetUserdata* ud)
+{
+	auto _gc = ud->m_Prototype ? ud->m_Prototype->GetMetamethod(Metamethod::Gc) : 0;
+	return _gc ? *_gc : Value();
+}
+
+//true if obj survives this collection but stays in the nursery
+static inline bool StaysYoung(const void* obj)
+{
+	return ((GarbageCollector::gcval*)obj)->age + 1 < JET_NURSERY_AGE;
+}
+
 GarbageCollector::GarbageCollector(JetContext* context) : m_Context(context)
 {
 	this->m_AllocationCounter = 1;//messes up if these start at 0
 	this->m_CollectionCounter = 1;
+	this->m_LastMajor = 0;
+	this->m_OldSize = 0;
+	this->m_Major = false;
+	this->m_Phase = Phase::Idle;
+	this->m_PauseTarget = 0;
+	this->m_SweepYoung = 0;
+	this->m_Whitened = 0;
+	this->m_Partial = 0;
+	this->m_Threads = 1;
+	this->m_Marker = 0;
+}
+
+GarbageCollector::~GarbageCollector()
+{
+#ifdef JET_PARALLEL_GC
+	delete this->m_Marker;
+#endif
+}
+
+void GarbageCollector::SetThreads(unsigned int count)
+{
+	this->m_Threads = count > 0 ? count : 1;
+#ifdef JET_PARALLEL_GC
+	delete this->m_Marker;
+	this->m_Marker = this->m_Threads > 1 ? new ParallelMarker(this->m_Threads) : 0;
+#endif
 }
 
 void GarbageCollector::Cleanup()
 {
+	//objects the running collection did not sweep yet
+	for (auto ii: this->m_Sweeping2)
+		this->m_Generation2.push_back(ii);
+	for (size_t i = this->m_SweepYoung; i < this->m_Sweeping1.size(); i++)
+		this->m_Generation1.push_back(this->m_Sweeping1[i]);
+	this->m_Sweeping1.clear();
+	this->m_Sweeping2.clear();
+
 	//need to do a two pass system to properly destroy userdata
 	//first pass of destructing
 	for (auto& ii: this->m_Generation1)
@@ -27,7 +76,7 @@ void GarbageCollector::Cleanup()
 		case ValueType::Userdata:
 			{
 				Value ud = Value(((JetUserdata*)ii), ((JetUserdata*)ii)->m_Prototype);
-				Value _gc = (*((JetUserdata*)ii)->m_Prototype).get("_gc");
+				Value _gc = Finalizer((JetUserdata*)ii);
 				if (_gc.m_Type == ValueType::NativeFunction)
 					_gc.m_NativeFunction(this->m_Context, &ud, 1);
 				else if (_gc.m_Type == ValueType::Function)
@@ -51,7 +100,7 @@ void GarbageCollector::Cleanup()
 		case ValueType::Userdata:
 			{
 				Value ud = Value(((JetUserdata*)ii), ((JetUserdata*)ii)->m_Prototype);
-				Value _gc = (*((JetUserdata*)ii)->m_Prototype).get("_gc");
+				Value _gc = Finalizer((JetUserdata*)ii);
 				if (_gc.m_Type == ValueType::NativeFunction)
 					_gc.m_NativeFunction(this->m_Context, &ud, 1);
 				else if (_gc.m_Type == ValueType::Function)
@@ -74,31 +123,27 @@ void GarbageCollector::Cleanup()
 				if (fun->m_UpValueCount)
 					delete[] fun->m_UpValues;
 				delete fun->m_Generator;
-				delete fun;
+				this->Delete(fun);
 				break;
 			}
 		case ValueType::Object:
-			delete (JetObject*)ii;
+			this->Delete((JetObject*)ii);
 			break;
 		case ValueType::Array:
-			((JetArray*)ii)->m_Data.~vector();
-			delete[] (char*)ii;
+			this->Delete((JetArray*)ii);
 			break;
 		case ValueType::Userdata:
 			//did in first pass
-			delete (JetUserdata*)ii;
+			this->Delete((JetUserdata*)ii);
 			break;
 		case ValueType::String:
 			{
-				JetString* str = (JetString*)ii;
-				delete[] str->m_Data;
-				delete str;
+				this->FreeString((JetString*)ii);
 				break;
 			}
 		case ValueType::Capture:
 			{
-				Capture* c = (Capture*)ii;
-				delete c;
+				this->Delete((Capture*)ii);
 				break;
 			}
 		}
@@ -114,58 +159,95 @@ void GarbageCollector::Cleanup()
 				if (fun->m_UpValueCount)
 					delete[] fun->m_UpValues;
 				delete fun->m_Generator;
-				delete fun;
+				this->Delete(fun);
 				break;
 			}
 		case ValueType::Object:
-			delete (JetObject*)ii;
+			this->Delete((JetObject*)ii);
 			break;
 		case ValueType::Array:
-			delete ((JetArray*)ii);
+			this->Delete((JetArray*)ii);
 			break;
 		case ValueType::Userdata:
 			//did in first pass
-			delete (JetUserdata*)ii;
+			this->Delete((JetUserdata*)ii);
 			break;
 		case ValueType::String:
 			{
-				JetString* str = (JetString*)ii;
-				delete[] str->m_Data;
-				delete str;
+				this->FreeString((JetString*)ii);
 				break;
 			}
 		case ValueType::Capture:
 			{
-				Capture* c = (Capture*)ii;
-				delete c;
+				this->Delete((Capture*)ii);
 				break;
 			}
 		}
 	}
 }
 
-void GarbageCollector::Mark()
+void GarbageCollector::Trace(const Value& v, bool& young)
 {
-	//mark basic types
-	this->m_Greys.Push(m_Context->m_ArrayPrototype);
-	this->m_Greys.Push(m_Context->m_ArrayIterPrototype);
-	this->m_Greys.Push(m_Context->m_ObjectPrototype);
-	this->m_Greys.Push(m_Context->m_ObjectIterPrototype);
-	this->m_Greys.Push(m_Context->m_StringPrototype);
-	this->m_Greys.Push(m_Context->m_FunctionPrototype);
-
-	for (unsigned int i = 0; i < this->m_Context->m_Prototypes.size(); i++)
-		this->m_Greys.Push(this->m_Context->m_Prototypes[i]);
-
-	//mark all objects being held by native code
-	for (unsigned int i = 0; i < this->m_NativeRefs.size(); i++)
+	if (v.m_Type > ValueType::NativeFunction)
 	{
-		if (this->m_NativeRefs[i].m_Object->m_Grey == false)
+		young |= StaysYoung(v.m_Object);
+		if (v.m_Object->m_Grey == false)
 		{
-			this->m_NativeRefs[i].m_Object->m_Grey = true;
-			this->m_Greys.Push(this->m_NativeRefs[i]);
+			v.m_Object->m_Grey = true;
+			this->m_Greys.Push(v);
 		}
 	}
+}
+
+#ifdef JET_PARALLEL_GC
+void MarkWorker::Trace(const Value& v, bool& young)
+{
+	if (v.m_Type > ValueType::NativeFunction)
+	{
+		JetObject* o = v.m_Object;
+		auto obj = (GarbageCollector::gcval*)o;
+		young |= StaysYoung(obj);
+		if (GreyLoad(obj->grey) == false && GreyClaim(obj->grey))
+			this->m_Greys.Push(v);
+	}
+}
+#endif
+
+//the part of parts slice of a root list
+static inline void Slice(size_t size, unsigned int part, unsigned int parts, size_t& begin, size_t& end)
+{
+	begin = size*part/parts;
+	end = size*(part + 1)/parts;
+}
+
+template<class Marker>
+void GarbageCollector::MarkRoots(Marker& marker, unsigned int part, unsigned int parts)
+{
+	bool young = false;//roots are traced by every collection anyway
+	size_t begin, end;
+
+	if (part == 0)
+	{
+		//mark basic types, they are not in the generations, StartMarking whitened them
+		marker.Trace(Value(m_Context->m_ArrayPrototype), young);
+		marker.Trace(Value(m_Context->m_ArrayIterPrototype), young);
+		marker.Trace(Value(m_Context->m_ObjectPrototype), young);
+		marker.Trace(Value(m_Context->m_ObjectIterPrototype), young);
+		marker.Trace(Value(m_Context->m_StringPrototype), young);
+		marker.Trace(Value(m_Context->m_FunctionPrototype), young);
+		marker.Trace(Value(m_Context->m_StringBuilderPrototype), young);
+
+		for (unsigned int i = 0; i < this->m_Context->m_Prototypes.size(); i++)
+			marker.Trace(Value(this->m_Context->m_Prototypes[i]), young);
+
+		if (m_Context->m_CallStack.size() > 0 && m_Context->m_CurFrame)
+			marker.Trace(Value(m_Context->m_CurFrame), young);
+	}
+
+	//mark all objects being held by native code
+	Slice(this->m_NativeRefs.size(), part, parts, begin, end);
+	for (size_t i = begin; i < end; i++)
+		marker.Trace(this->m_NativeRefs[i], young);
 
 	//add more write barriers to detect when objects are removed and what not
 	//if flag is marked, then black
@@ -174,287 +256,458 @@ void GarbageCollector::Mark()
 
 	//push all reachable items onto grey stack
 	//this means globals
+	Slice(m_Context->m_Variables.size(), part, parts, begin, end);
+	for (size_t i = begin; i < end; i++)
+		marker.Trace(m_Context->m_Variables[i], young);
+
+	Slice(m_Context->m_Stack.size(), part, parts, begin, end);
+	for (size_t i = begin; i < end; i++)
+		marker.Trace(m_Context->m_Stack._data[i], young);
+
+	//this is really part of the sweep section
+	//the locals of every frame live in m_Stack and were marked above, only the closures are left
+	Slice(m_Context->m_CallStack.size(), part, parts, begin, end);
+	for (size_t i = begin; i < end; i++)
 	{
-		//StackProfile profile("Mark Globals as Grey");
-		for (unsigned int i = 0; i < m_Context->m_Variables.size(); i++)
-		{
-			if (m_Context->m_Variables[i].m_Type > ValueType::NativeFunction)
-			{
-				if (m_Context->m_Variables[i].m_Object->m_Grey == false)
-				{
-					m_Context->m_Variables[i].m_Object->m_Grey = true;
-					this->m_Greys.Push(m_Context->m_Variables[i]);
-				}
-			}
-		}
+		auto closure = m_Context->m_CallStack._data[i].m_Closure;
+		if (closure)
+			marker.Trace(Value(closure), young);
 	}
+}
 
-
-	if (m_Context->m_Stack.size() > 0)
+template<class Marker>
+void GarbageCollector::Scan(const Value& obj, Marker& marker)
+{
+	//set if obj points to an object that stays in the nursery
+	bool young = false;
+	switch (obj.m_Type)
 	{
-		for (unsigned int i = 0; i < m_Context->m_Stack.size(); i++)
+	case ValueType::Object:
 		{
-			if (m_Context->m_Stack._data[i].m_Type > ValueType::NativeFunction)
+			//obj.m_Object->DebugPrint();
+			if (obj.m_Object->m_Prototype)
+				marker.Trace(obj.m_Object->m_Prototype, young);
+
+			obj.m_Object->m_Mark = true;
+			for (unsigned int i = 0; i < obj.m_Object->m_ArraySize; i++)
+				marker.Trace(obj.m_Object->m_Array[i], young);
+			if (obj.m_Object->m_Shape)
 			{
-				if (m_Context->m_Stack._data[i].m_Object->m_Grey == false)
-				{
-					m_Context->m_Stack._data[i].m_Object->m_Grey = true;
-					this->m_Greys.Push(m_Context->m_Stack._data[i]);
-				}
+				//keys held by a shape are kept alive by the shape itself
+				for (unsigned int i = 0; i < obj.m_Object->m_Size; i++)
+					marker.Trace(obj.m_Object->m_Slots[i], young);
+				break;
+			}
+			for (unsigned int i = 0; i < obj.m_Object->m_Size; i++)
+			{
+				auto& ii = obj.m_Object->m_Nodes[i];
+				marker.Trace(ii.first, young);
+				marker.Trace(ii.second, young);
 			}
+			break;
 		}
-	}
-
-
-	//this is really part of the sweep section
-	if (m_Context->m_CallStack.size() > 0)
-	{
-		//traverse all local vars
-		if (m_Context->m_CurFrame && m_Context->m_CurFrame->m_Grey == false)
+	case ValueType::Array:
 		{
-			m_Context->m_CurFrame->m_Grey = true;
-			this->m_Greys.Push(Value(m_Context->m_CurFrame));
+			//the whole array at once, Propagate traces big ones over several Steps instead.
+			//Afterwards m_Dirty is the first element still in the nursery
+			auto arr = obj.m_Array;
+			arr->m_Mark = true;
+
+			unsigned int size = (unsigned int)arr->m_Data.size();
+			unsigned int i = 0;
+			if (arr->m_Age >= JET_NURSERY_AGE)
+				i = arr->m_Dirty < size ? arr->m_Dirty : size;
+			unsigned int first = size;
+			for (; i < size; i++)
+			{
+				bool child = false;
+				marker.Trace(arr->m_Data[i], child);
+				if (child && first == size)
+					first = i;
+			}
+			arr->m_Dirty = first;
+			young |= first < size;
+			break;
 		}
-
-		int sp = 0;
-		for (unsigned int i = 0; i < m_Context->m_CallStack.size(); i++)
+	case ValueType::String:
 		{
-			auto closure = m_Context->m_CallStack[i].second;
-			if (closure == 0)
-				continue;
+			obj.m_String->m_Mark = true;
 
-			if (closure->m_Grey == false)
+			//a view alone does not keep its parent alive, see below
+			if (IsView(obj.m_String))
 			{
-				closure->m_Grey = true;
-				this->m_Greys.Push(Value(closure));
+				marker.m_Views.push_back(obj.m_String);
+				break;
 			}
-			int max = sp+closure->m_Prototype->m_Locals;
-			for (; sp < max; sp++)
+
+			//the halves of a rope that was not flattened yet, they are never younger than it
+			JetString* halves[2] = { obj.m_String->m_Left, obj.m_String->m_Right };
+			for (auto half : halves)
 			{
-				if (m_Context->m_LocalStack[sp].m_Type > ValueType::NativeFunction)
-				{
-					if (m_Context->m_LocalStack[sp].m_Object->m_Grey == false)
-					{
-						m_Context->m_LocalStack[sp].m_Object->m_Grey = true;
-						this->m_Greys.Push(m_Context->m_LocalStack[sp]);
-					}
-				}
+				if (half)
+					marker.Trace(Value(half), young);
 			}
+			break;
 		}
-
-		//mark curframe locals
-		if (m_Context->m_CurFrame)
+#ifdef _DEBUG
+	case ValueType::Capture:
+		{
+			throw RuntimeException("There should not be an upvalue in the grey loop");
+			break;
+		}
+#endif
+	case ValueType::Function:
 		{
-			int max = sp+m_Context->m_CurFrame->m_Prototype->m_Locals;
-			for (; sp < max; sp++)
+			obj.m_Function->m_Mark = true;
+			if (obj.m_Function->m_Prev)
+				marker.Trace(Value(obj.m_Function->m_Prev), young);
+
+			if (obj.m_Function->m_UpValueCount)
 			{
-				if (m_Context->m_LocalStack[sp].m_Type > ValueType::NativeFunction)
+				for (unsigned int i = 0; i < obj.m_Function->m_UpValueCount; i++)
 				{
-					if (m_Context->m_LocalStack[sp].m_Object->m_Grey == false)
+					auto uv = obj.m_Function->m_UpValues[i];
+					if (uv)
 					{
-						m_Context->m_LocalStack[sp].m_Object->m_Grey = true;
-						this->m_Greys.Push(m_Context->m_LocalStack[sp]);
+						//captures are only reached through closures, so the value of
+						//one that is already marked is traced again from each of them
+						young |= StaysYoung(uv);
+						if (uv->m_Closed)
+							marker.Trace(uv->m_Value, young);//mark the value stored in it
+						marker.MarkCapture(uv);
 					}
 				}
 			}
+
+			if (obj.m_Function->m_Generator)
+			{
+				//mark generator stack
+				for (unsigned int i = 0; i < obj.m_Function->m_Prototype->m_Locals; i++)
+					marker.Trace(obj.m_Function->m_Generator->m_Stack[i], young);
+			}
+			break;
 		}
+	case ValueType::Userdata:
+		{
+			obj.m_UserData->m_Mark = true;
+
+			if (obj.m_UserData->m_Prototype)
+				marker.Trace(obj.m_UserData->m_Prototype, young);
+			break;
+		}
+	default:
+		break;
 	}
 
-	{
-		//StackProfile prof("Traverse Greys");
-		while(this->m_Greys.size() > 0)
-		{
-			//traverse the object
-			auto obj = this->m_Greys.Pop();
-			switch (obj.m_Type)
-			{
-			case ValueType::Object:
-				{
-					//obj.m_Object->DebugPrint();
-					if (obj.m_Object->m_Prototype && obj.m_Object->m_Prototype->m_Grey == false)
-					{
-						obj.m_Object->m_Prototype->m_Grey = true;
+	//an old object keeps its mark through minor collections and is not traced by them,
+	//so one that points into the nursery is traced again by the next collection
+	if (young && StaysYoung(obj.m_Object) == false)
+		marker.m_Remembered.push_back(obj);
+}
 
-						this->m_Greys.Push(obj.m_Object->m_Prototype);
-					}
+bool GarbageCollector::Propagate(Budget& budget)
+{
+	if (this->m_Partial && this->TraceArray(budget) == false)
+		return false;
 
-					obj.m_Object->m_Mark = true;
-					for (auto& ii: *obj.m_Object)
-					{
-						if (ii.first.m_Type > ValueType::NativeFunction && ii.first.m_Object->m_Grey == false)
-						{
-							ii.first.m_Object->m_Grey = true;
-							m_Greys.Push(ii.first);
-						}
-						if (ii.second.m_Type > ValueType::NativeFunction && ii.second.m_Object->m_Grey == false)
-						{
-							ii.second.m_Object->m_Grey = true;
-							m_Greys.Push(ii.second);
-						}
-					}
-					break;
-				}
-			case ValueType::Array:
-				{
-					obj.m_Array->m_Mark = true;
+	while (this->m_Greys.size() > 0)
+	{
+		if (budget.Spent())
+			return false;
 
-					for (auto& ii: obj.m_Array->m_Data)
-					{
-						if (ii.m_Type > ValueType::NativeFunction && ii.m_Object->m_Grey == false)
-						{
-							ii.m_Object->m_Grey = true;
-							m_Greys.Push(ii);
-						}
-					}
+		//traverse the object
+		auto obj = this->m_Greys.Pop();
+		if (obj.m_Type != ValueType::Array)
+		{
+			this->Scan(obj, *this);
+			continue;
+		}
 
-					break;
-				}
-			case ValueType::String:
-				{
-					obj.m_String->m_Mark = true;
+		auto arr = obj.m_Array;
+		arr->m_Mark = true;
+
+		//an old array was traced before, only the elements stored since then need it
+		//again. Whitening sets m_Dirty to 0, so a gen2 collection traces all of them
+		unsigned int size = (unsigned int)arr->m_Data.size();
+		this->m_PartialNext = 0;
+		if (arr->m_Age >= JET_NURSERY_AGE)
+			this->m_PartialNext = arr->m_Dirty < size ? arr->m_Dirty : size;
+		this->m_PartialFirst = UINT_MAX;
+		arr->m_Dirty = UINT_MAX;//lowered by stores while the array is traced
+
+		//a big array is traced over several Steps
+		this->m_Partial = arr;
+		if (this->TraceArray(budget) == false)
+			return false;
+	}
+	return true;
+}
 
-					break;
-				}
-#ifdef _DEBUG
-			case ValueType::Capture:
-				{
-					throw RuntimeException("There should not be an upvalue in the grey loop");
-					break;
-				}
+bool GarbageCollector::TraceArray(Budget& budget)
+{
+	//the program may have shrunk the array while it waited for the next Step
+	auto arr = this->m_Partial;
+	while (this->m_PartialNext < arr->m_Data.size())
+	{
+		if (budget.Spent())
+			return false;
+
+		bool child = false;
+		this->Trace(arr->m_Data[this->m_PartialNext], child);
+		if (child && this->m_PartialFirst == UINT_MAX)
+			this->m_PartialFirst = this->m_PartialNext;
+		this->m_PartialNext++;
+	}
+	this->m_Partial = 0;
+
+	//m_Dirty becomes the first element still in the nursery or stored to since tracing began
+	unsigned int size = (unsigned int)arr->m_Data.size();
+	if (this->m_PartialFirst < arr->m_Dirty)
+		arr->m_Dirty = this->m_PartialFirst;
+	if (arr->m_Dirty > size)
+		arr->m_Dirty = size;
+
+	//a store in between already remembered it and took its mark
+	if (this->m_PartialFirst != UINT_MAX && arr->m_Mark && StaysYoung(arr) == false)
+		this->m_Remembered.push_back(Value(arr));
+	return true;
+}
+
+void GarbageCollector::MarkParallel()
+{
+#ifdef JET_PARALLEL_GC
+	//the workers trace arrays whole, one a Step left half done is finished here
+	Budget all;
+	if (this->m_Partial)
+		this->TraceArray(all);
+
+	//the greys so far and the roots are split between the workers, from there on they
+	//balance the work by stealing
+	//the remembered objects among the seeds were pushed without a claim and can be there
+	//twice, whitening them lets one worker claim each
+	auto marker = this->m_Marker;
+	unsigned int parts = marker->Count();
+	unsigned int seeds = this->m_Greys.size();
+	for (unsigned int i = 0; i < seeds; i++)
+		this->m_Greys._data[i].m_Object->m_Grey = false;
+	marker->Run([this, marker, parts, seeds](unsigned int part)
+	{
+		auto& me = marker->Worker(part);
+		bool young = false;
+		size_t begin, end;
+		Slice(seeds, part, parts, begin, end);
+		for (size_t i = begin; i < end; i++)
+			me.Trace(this->m_Greys._data[i], young);
+		this->MarkRoots(me, part, parts);
+
+		Value obj;
+		while (marker->Next(me, obj))
+			this->Scan(obj, me);
+	});
+	this->m_Greys.QuickPop(seeds);
+
+	for (unsigned int i = 0; i < parts; i++)
+	{
+		auto& worker = marker->Worker(i);
+		this->m_Remembered.insert(this->m_Remembered.end(), worker.m_Remembered.begin(), worker.m_Remembered.end());
+		this->m_Views.insert(this->m_Views.end(), worker.m_Views.begin(), worker.m_Views.end());
+		worker.m_Remembered.clear();
+		worker.m_Views.clear();
+	}
 #endif
-			case ValueType::Function:
-				{
-					obj.m_Function->m_Mark = true;
-					if (obj.m_Function->m_Prev && obj.m_Function->m_Prev->m_Grey == false)
-					{
-						obj.m_Function->m_Prev->m_Grey = true;
-						m_Greys.Push(Value(obj.m_Function->m_Prev));
-					}
+}
 
-					if (obj.m_Function->m_UpValueCount)
-					{
-						for (unsigned int i = 0; i < obj.m_Function->m_UpValueCount; i++)
-						{
-							auto uv = obj.m_Function->m_UpValues[i];
-							if (uv && uv->m_Grey == false)
-							{
-								if (uv->m_Closed)
-								{
-									//mark the value stored in it
-									if (uv->m_Value.m_Type > ValueType::NativeFunction)
-									{
-										if (uv->m_Value.m_Object->m_Grey == false)
-										{
-											uv->m_Value.m_Object->m_Grey = true;
-											m_Greys.Push(uv->m_Value);
-										}
-									}
-								}
-								//mark it
-								uv->m_Grey = true;
-								uv->m_Mark = true;
-							}
-						}
-					}
+void GarbageCollector::Begin()
+{
+	//a gen2 collection once the old generation grew enough since the last one,
+	//in between only the nursery and the remembered old objects are traced
+	this->m_Major = this->m_CollectionCounter - this->m_LastMajor >= GC_STEPS
+		&& this->m_Generation2.size() - this->m_OldSize >= this->m_OldSize*JET_GC_MAJOR_GROWTH/100;
 
-					if (obj.m_Function->m_Generator)
-					{
-						//mark generator stack
-						for (unsigned int i = 0; i < obj.m_Function->m_Prototype->m_Locals; i++)
-						{
-							if (obj.m_Function->m_Generator->m_Stack[i].m_Type > ValueType::NativeFunction)
-							{
-								if (obj.m_Function->m_Generator->m_Stack[i].m_Object->m_Grey == false)
-								{
-									obj.m_Function->m_Generator->m_Stack[i].m_Object->m_Grey = true;
-									m_Greys.Push(obj.m_Function->m_Generator->m_Stack[i]);
-								}
-							}
-						}
-					}
-					break;
-				}
-			case ValueType::Userdata:
-				{
-					obj.m_UserData->m_Mark = true;
+	//it traces everything again, so it starts with all old objects white
+	if (this->m_Major)
+	{
+		this->m_Remembered.clear();
+		this->m_RememberedCaptures.clear();
+		this->m_Whitened = 0;
+		this->m_Phase = Phase::Whitening;
+		return;
+	}
+	this->StartMarking();
+}
 
-					if (obj.m_UserData->m_Prototype && obj.m_UserData->m_Prototype->m_Grey == false)
-					{
-						obj.m_UserData->m_Prototype->m_Grey = true;
+bool GarbageCollector::Whiten(Budget& budget)
+{
+	//marking only starts once all are white, the program can not promote objects before
+	while (this->m_Whitened < this->m_Generation2.size())
+	{
+		if (budget.Spent())
+			return false;
+
+		auto ii = this->m_Generation2[this->m_Whitened++];
+		ii->mark = false;
+		ii->grey = false;
+		if (ii->type == ValueType::Array)
+			((JetArray*)ii)->m_Dirty = 0;
+	}
+	return true;
+}
 
-						m_Greys.Push(obj.m_UserData->m_Prototype);
-					}
-					break;
-				}
-			}
-		}
+void GarbageCollector::StartMarking()
+{
+	//old objects written to since the last collection or still pointing into the nursery,
+	//with the roots they are all a minor collection traces
+	for (auto& ii: this->m_Remembered)
+		this->m_Greys.Push(ii);
+	this->m_Remembered.clear();
+
+	auto captures = std::move(this->m_RememberedCaptures);
+	this->m_RememberedCaptures.clear();
+	for (auto uv: captures)
+	{
+		bool young = false;
+		this->Trace(uv->m_Value, young);
+		uv->m_Mark = true;
+		if (young && StaysYoung(uv) == false)
+			this->m_RememberedCaptures.push_back(uv);
 	}
+	this->WhitenPrototypes();
+	this->m_Phase = Phase::Marking;
 }
 
-void GarbageCollector::Sweep()
+void GarbageCollector::WhitenPrototypes()
 {
-	bool nextIncremental = ((this->m_CollectionCounter+1)%GC_STEPS)!=0;
-	bool incremental = ((this->m_CollectionCounter)%GC_STEPS)!=0;
+	//they are traced from the roots by every collection, once each
+	JetObject* builtins[] = { m_Context->m_ArrayPrototype, m_Context->m_ArrayIterPrototype, m_Context->m_ObjectPrototype,
+		m_Context->m_ObjectIterPrototype, m_Context->m_StringPrototype, m_Context->m_FunctionPrototype, m_Context->m_StringBuilderPrototype };
+	for (auto proto: builtins)
+		proto->m_Grey = false;
+	for (auto proto: this->m_Context->m_Prototypes)
+		proto->m_Grey = false;
+}
+
+void GarbageCollector::Atomic()
+{
+	//the stacks and globals are written without barriers, so they are scanned again
+	//before the rest of the greys. Objects written to while marking were only remembered,
+	//tracing them here once is cheaper than after every store to a big array
+	for (auto& ii: this->m_Remembered)
+		this->m_Greys.Push(ii);
+	this->m_Remembered.clear();
+#ifdef JET_PARALLEL_GC
+	//a gen2 collection traces the whole heap, worth waking the other threads for
+	if (this->m_Major && this->m_Marker)
+		this->MarkParallel();
+	else
+#endif
+	{
+		this->MarkRoots(*this, 0, 1);
+		Budget all;
+		this->Propagate(all);
+	}
+
+	//a view whose parent is only reachable through views gets its own copy of the
+	//characters, so a few substrings do not keep a whole input buffer alive
+	for (auto view : this->m_Views)
+	{
+		if (view->m_Left->m_Mark == false && view->m_Left->m_RefCount == 0)
+			DetachView(view);
+	}
+	this->m_Views.clear();
+
+	//the nursery and, in a gen2 collection, the old generation are swept from these,
+	//objects allocated from now on go into the new lists and survive this cycle. Swapping
+	//keeps the capacity the lists had in the last cycle
+	this->m_Sweeping1.swap(this->m_Generation1);
+	this->m_Generation1.clear();
+	this->m_SweepYoung = 0;
+	if (this->m_Major)
+		this->m_Sweeping2.swap(this->m_Generation2);
+	this->m_Phase = Phase::Sweeping;
+}
 
+bool GarbageCollector::Sweep(Budget& budget)
+{
 	/* SWEEPING SECTION */
 
 	//this must all be done when sweeping!!!!!!!
 
-	//process stack variables, stack vars are ALWAYS grey
-
-	//finally sweep through
-	//sweep and free all whites and make all blacks white
-	//iterate through all gc values
+	//sweep and free all whites, the mutator may have run since marking finished, so an object
+	//that is grey without its mark went through a write barrier and is alive as well
 #ifdef _DEBUG
 	if (this->m_Greys.size() > 0)
 		throw RuntimeException("Runtime Error: Garbage collector grey array not empty when collecting!");
 #endif
 
-	if (!incremental)//do a gen2 collection
+	//Obviously, this approach doesn't work for a non-copying GC. But the main insights behind a generational GC can be abstracted:
+
+	//Minor collections only take care of newly allocated objects.
+	//Major collections deal with all objects, but are run much less often.
+
+	//The basic idea is to modify the sweep phase: 
+	//1. free the (unreachable) white objects, but don't flip the color of black objects before a minor collection. 
+	//2. The mark phase of the following minor collection then only traverses newly allocated blocks and objects written to (marked gray). 
+	//3. All other objects are assumed to be still reachable during a minor GC and are neither traversed, nor swept, nor are their marks changed (kept black). A regular sweep phase is used if a major collection is to follow.
+
+	while (this->m_Sweeping2.size() > 0 && budget.Spent() == false)
+	{
+		//survivors stay black until the next gen2 collection
+		auto ii = this->m_Sweeping2.front();
+		this->m_Sweeping2.pop_front();
+		if (ii->mark || ii->grey || ii->refcount)
+			this->m_Generation2.push_back(ii);
+		else
+			this->Free(ii);
+	}
+
+	while (this->m_Sweeping2.size() == 0 && this->m_SweepYoung < this->m_Sweeping1.size() && budget.Spent() == false)
 	{
-		auto g2list = std::move(this->m_Generation2);
-		this->m_Generation2.clear();
-		for (auto& ii: g2list)
+		auto ii = this->m_Sweeping1[this->m_SweepYoung++];
+		if (ii->mark || ii->grey || ii->refcount)
 		{
-			if (ii->mark || ii->refcount)
+			if (++ii->age >= JET_NURSERY_AGE)
 			{
-				ii->mark = false;
-				ii->grey = false;
-
-				this->m_Generation2.push_back(ii);
+				this->m_Generation2.push_back(ii);//promote, it SURVIVED, and stays black
 			}
 			else
 			{
-				this->Free(ii);
+				//still young, the next collection decides again
+				ii->mark = false;
+				ii->grey = false;
+				this->m_Generation1.push_back(ii);
 			}
 		}
-	}
-
-	auto g1list = std::move(this->m_Generation1);
-	this->m_Generation1.clear();
-	for (auto& ii: g1list)
-	{
-		if (ii->mark || ii->refcount)
-		{
-			//ii->mark = false;//perhaps do this ONLY IF we just did a gen2 collection
-			//ii->grey = false;
-			this->m_Generation2.push_back(ii);//promote, it SURVIVED
-		}
 		else
 		{
 			this->Free(ii);
 		}
 	}
 
-	//Obviously, this approach doesn't work for a non-copying GC. But the main insights behind a generational GC can be abstracted:
+	//freed prototypes and names could be reused at the same address
+	this->m_Context->InvalidateMethods();
+	return this->m_SweepYoung == this->m_Sweeping1.size() && this->m_Sweeping2.size() == 0;
 
-	//Minor collections only take care of newly allocated objects.
-	//Major collections deal with all objects, but are run much less often.
+}
 
-	//The basic idea is to modify the sweep phase: 
-	//1. free the (unreachable) white objects, but don't flip the color of black objects before a minor collection. 
-	//2. The mark phase of the following minor collection then only traverses newly allocated blocks and objects written to (marked gray). 
-	//3. All other objects are assumed to be still reachable during a minor GC and are neither traversed, nor swept, nor are their marks changed (kept black). A regular sweep phase is used if a major collection is to follow.
+void GarbageCollector::End()
+{
+	this->m_Sweeping1.clear();
+	this->m_Sweeping2.clear();
+
+	//old objects that point into the nursery are traced again by the next collection,
+	//the same way a write barrier would have them traced
+	for (auto& ii: this->m_Remembered)
+		ii.m_Object->m_Mark = false;
+	for (auto uv: this->m_RememberedCaptures)
+		uv->m_Mark = false;
+
+	if (this->m_Major)
+	{
+		this->m_LastMajor = this->m_CollectionCounter;
+		this->m_OldSize = this->m_Generation2.size();
+	}
+	this->m_CollectionCounter++;//used to determine collection mode
+	this->m_Phase = Phase::Idle;
 }
 
 void GarbageCollector::Run()
@@ -465,13 +718,21 @@ void GarbageCollector::Run()
 	//QueryPerformanceFrequency( (LARGE_INTEGER *)&rate );
 	QueryPerformanceCounter( (LARGE_INTEGER *)&start );
 #endif
-	//mark all references in the grey stack
-	this->Mark();
+	Budget all;
 
-	//clear up dead memory
-	this->Sweep();
+	//finish the cycle a Step started, it may have missed garbage made since it began
+	if (this->m_Phase != Phase::Idle)
+		this->Advance(all);
 
-	this->m_CollectionCounter++;//used to determine collection mode
+	this->Begin();
+	if (this->m_Phase == Phase::Whitening)
+	{
+		this->Whiten(all);
+		this->StartMarking();
+	}
+	this->Atomic();
+	this->Sweep(all);
+	this->End();
 #ifdef JET_TIME_EXECUTION
 	INT64 rate;
 	QueryPerformanceCounter( (LARGE_INTEGER *)&end );
@@ -485,6 +746,47 @@ void GarbageCollector::Run()
 	//printf("GC Complete: %d Greys, %d Globals, %d Stack\n%d Closures, %d Arrays, %d Objects, %d Userdata\n", this->greys.size(), this->vars.size(), 0, this->closures.size(), this->arrays.size(), this->objects.size(), this->userdata.size());
 }
 
+void GarbageCollector::Step()
+{
+	if (this->m_PauseTarget == 0)
+	{
+		this->Run();
+		return;
+	}
+
+	//one slice of a cycle, the cycles follow each other as long as the program allocates
+	Budget budget(this->m_PauseTarget, JET_GC_STEP_WORK);
+	if (this->m_Phase == Phase::Idle)
+	{
+		//the atomic step scans the roots again, marking from them now leaves it less to do
+		this->Begin();
+		if (this->m_Phase == Phase::Marking)
+			this->MarkRoots(*this, 0, 1);
+	}
+	this->Advance(budget);
+}
+
+bool GarbageCollector::Advance(Budget& budget)
+{
+	if (this->m_Phase == Phase::Whitening)
+	{
+		if (this->Whiten(budget) == false)
+			return false;
+		this->StartMarking();
+		this->MarkRoots(*this, 0, 1);
+	}
+	if (this->m_Phase == Phase::Marking)
+	{
+		if (this->Propagate(budget) == false)
+			return false;
+		this->Atomic();
+	}
+	if (this->Sweep(budget) == false)
+		return false;
+	this->End();
+	return true;
+}
+
 void GarbageCollector::Free(gcval* ii)
 {
 	switch (ii->type)
@@ -501,7 +803,7 @@ void GarbageCollector::Free(gcval* ii)
 				delete[] fun->m_UpValues;
 
 			delete fun->m_Generator;
-			delete fun;
+			this->Delete(fun);
 #endif
 			break;
 		}
@@ -511,7 +813,7 @@ void GarbageCollector::Free(gcval* ii)
 			JetObject* obj = (JetObject*)ii;
 			obj->m_Nodes = (ObjNode*)0xcdcdcdcd;
 #else
-			delete (JetObject*)ii;
+			this->Delete((JetObject*)ii);
 #endif
 			break;
 		}
@@ -521,34 +823,33 @@ void GarbageCollector::Free(gcval* ii)
 			JetArray* arr = (JetArray*)ii;
 			arr->m_Data.clear();
 #endif
-			delete (JetArray*)ii;
-			//#endif
+			this->Delete((JetArray*)ii);
 			break;
 		}
 	case ValueType::Userdata:
 		{
 			Value ud = Value(((JetUserdata*)ii), ((JetUserdata*)ii)->m_Prototype);
-			Value _gc = (*((JetUserdata*)ii)->m_Prototype).get("_gc");
+			Value _gc = Finalizer((JetUserdata*)ii);
 			if (_gc.m_Type == ValueType::NativeFunction)
 				_gc.m_NativeFunction(this->m_Context, &ud, 1);
 			else if (_gc.m_Type == ValueType::Function)
 				throw RuntimeException("Non Native _gc Hooks Not Implemented!");//todo
 			else if (_gc.m_Type != ValueType::Null)
 				throw RuntimeException("Invalid _gc Hook!");
-			delete (JetUserdata*)ii;
+			this->Delete((JetUserdata*)ii);
 			break;
 		}
 	case ValueType::String:
 		{
 			JetString* str = (JetString*)ii;
-			delete[] str->m_Data;
-			delete str;
+			if (str->m_Interned)
+				this->m_Context->m_Strings.Remove(str);
+			this->FreeString(str);
 			break;
 		}
 	case ValueType::Capture:
 		{
-			Capture* uv = (Capture*)ii;
-			delete uv;
+			this->Delete((Capture*)ii);
 			break;
 		}
 #ifdef _DEBUG
@@ -556,4 +857,16 @@ void GarbageCollector::Free(gcval* ii)
 		throw RuntimeException("Runtime Error: Invalid GC Object Typeid!");
 #endif
 	}
+}
+
+void GarbageCollector::FreeString(JetString* str)
+{
+	//flattened ropes and detached views keep their characters in a buffer of their own
+	size_t size = sizeof(JetString);
+	if (str->m_Data == InlineData(str))
+		size += str->m_Length + 1;
+	else if (str->m_Left == 0)
+		delete[] str->m_Data;
+	str->~GCVal();
+	m_Pool.Release(str, size);
 }
\ No newline at end of file
@@ -3,11 +3,15 @@
 
 #include "Value.h"
 #include "VMStack.h"
+#include "ObjectPool.h"
 #include <vector>
+#include <deque>
+#include <chrono>
 
 namespace Jet
 {
 	class JetContext;
+	class ParallelMarker;
 
 	class GarbageCollector
 	{
@@ -25,31 +29,66 @@ namespace Jet
 			bool			grey;
 			Jet::ValueType	type;
 			unsigned char	refcount;
+			unsigned char	age;//collections survived in m_Generation1, JET_NURSERY_AGE once promoted
 		};
 		std::vector<gcval*> m_Generation1;
-		std::vector<gcval*> m_Generation2;
+		std::deque<gcval*>	m_Generation2;//grows without copying the old generation over in one go
+		std::vector<gcval*> m_Sweeping1;//the generations as they were when marking finished
+		std::deque<gcval*>	m_Sweeping2;//the old generation is swept off its front
+		size_t				m_SweepYoung;//how far the sweep got in m_Sweeping1
 		//std::vector<gcval*> gen3;basically permanent objects, todo
 
 		std::vector<Value>	m_NativeRefs;//a list of all objects stored natively to mark
 
 		int					m_AllocationCounter;//used to determine when to run the GC
 		int					m_CollectionCounter;//state of the gc
+		int					m_LastMajor;//m_CollectionCounter of the last gen2 collection
+		size_t				m_OldSize;//size of m_Generation2 after it
+		bool				m_Major;//the running collection is a gen2 collection
+
+		//a collection can be spread over several Steps, with the program running in between
+		enum class Phase
+		{
+			Idle,
+			Whitening,//a gen2 collection first clears the marks of the old generation
+			Marking,
+			Sweeping,
+		};
+		Phase				m_Phase;
+		size_t				m_Whitened;//old objects whitened so far
+		JetArray*			m_Partial;//array whose tracing a Step left unfinished
+		unsigned int		m_PartialNext;//next element of it to trace
+		unsigned int		m_PartialFirst;//first of its elements found in the nursery
+		unsigned int		m_PauseTarget;//microseconds one Step may take, 0 runs whole collections
+		unsigned int		m_Threads;//threads that mark in a gen2 collection
+		ParallelMarker*		m_Marker;//their pool, null with one thread
 		VMStack<Value>		m_Greys;//stack of grey objects for processing
+		ObjectPool			m_Pool;
+		std::vector<JetString*>	m_Views;//substring views reached while marking
+		std::vector<Value>		m_Remembered;//old objects to trace again in the next minor collection
+		std::vector<Capture*>	m_RememberedCaptures;//same for captures, they are no values
 
 		GarbageCollector(JetContext* context);
+		~GarbageCollector();
+
+		GarbageCollector(const GarbageCollector&) = delete;
+		GarbageCollector& operator=(const GarbageCollector&) = delete;
 
 		void Cleanup();
 
 		inline void AddObject(gcval* obj)
 		{
+			obj->age = 0;
 			this->m_Generation1.push_back(obj);
 		}
 
+		//every gc object comes from the pool and goes back with Delete
 		template<class T> 
 		T* New()
 		{
 			//need to call constructor
-			T* buf = new T();
+			T* buf = new (m_Pool.Allocate(sizeof(T))) T();
+			((gcval*)buf)->age = 0;
 			this->m_Generation1.push_back((gcval*)buf);
 			return (T*)(buf);
 		}
@@ -59,7 +98,8 @@ namespace Jet
 		T* New(JetContext* arg1)
 		{
 			//need to call constructor
-			T* buf = new T(arg1);
+			T* buf = new (m_Pool.Allocate(sizeof(T))) T(arg1);
+			((gcval*)buf)->age = 0;
 			this->m_Generation1.push_back((gcval*)buf);
 			return (T*)(buf);
 		}
@@ -69,19 +109,30 @@ namespace Jet
 		T* New(char* arg1)
 		{
 			//need to call constructor
-			T* buf = new T(arg1);
+			T* buf = new (m_Pool.Allocate(sizeof(T))) T(arg1);
+			((gcval*)buf)->age = 0;
 			this->m_Generation1.push_back((gcval*)buf);
 			return (T*)(buf);
 		}
 
+		//string with room for length characters behind the header, m_Data points there
+		JetString* NewString(unsigned int length)
+		{
+			JetString* buf = new (m_Pool.Allocate(sizeof(JetString) + length + 1)) JetString();
+			buf->m_Data = InlineData(buf);
+			((gcval*)buf)->age = 0;
+			this->m_Generation1.push_back((gcval*)buf);
+			return buf;
+		}
+
 		//hack for userdata
 		template<class T> 
 		T* New(void* arg1, JetObject* arg2)
 		{
 			//need to call constructor
-			T* buf = new T(arg1, arg2);
+			T* buf = new (m_Pool.Allocate(sizeof(T))) T(arg1, arg2);
+			((gcval*)buf)->age = 0;
 			this->m_Generation1.push_back((gcval*)buf);
-			//new (buf) T(arg1, arg2);
 			return (T*)(buf);
 
 #ifdef _DEBUG
@@ -92,11 +143,130 @@ namespace Jet
 #endif
 		}
 
+		template<class T>
+		void Delete(T* obj)
+		{
+			obj->~T();
+			m_Pool.Release(obj, sizeof(T));
+		}
+
+		//write barrier, call it when a reference is stored into obj. Old objects stay marked
+		//through minor collections and are not traced by them, so the first store into one
+		//since the last collection remembers it for the next collection to trace.
+		//Arrays use the overload below
+		inline void Barrier(const Value& obj)
+		{
+			if (obj.m_Object->m_Mark)
+			{
+				//traced again by the next collection, or by the atomic step of the one marking now
+				obj.m_Object->m_Mark = false;
+				this->m_Remembered.push_back(obj);
+			}
+		}
+
+		//for an array the next collection only traces the elements from index on
+		inline void Barrier(JetArray* arr, unsigned int index)
+		{
+			if (index < arr->m_Dirty)
+				arr->m_Dirty = index;
+			if (arr->m_Mark)
+			{
+				arr->m_Mark = false;
+				this->m_Remembered.push_back(Value(arr));
+			}
+		}
+
+		//same for a closed capture that got a new value
+		inline void Barrier(Capture* uv)
+		{
+			if (uv->m_Mark)
+			{
+				uv->m_Mark = false;
+				this->m_RememberedCaptures.push_back(uv);
+			}
+
+			//the closures may have been traced already in this cycle
+			if (this->m_Phase == Phase::Marking)
+			{
+				bool young = false;
+				this->Trace(uv->m_Value, young);
+			}
+		}
+
+		//call on a string found in the string table. The table does not keep strings alive,
+		//so one that is only waiting for the sweep to free it must survive this cycle
+		inline JetString* Revive(JetString* str)
+		{
+			if (str && this->m_Phase == Phase::Sweeping)
+				str->m_Grey = true;
+			return str;
+		}
+
+		//a whole collection, finishes the one in progress first
 		void Run();
+		//the work for one allocation step, a slice of a collection when m_PauseTarget is set
+		void Step();
+
+		//starts or stops the marking threads, only call it between collections
+		void SetThreads(unsigned int count);
 
 	private:
-		void Mark();
-		void Sweep();
+		//work limit of one Step, the clock is only read every few objects and not before
+		//the minimum amount of work is done
+		struct Budget
+		{
+			std::chrono::steady_clock::time_point	m_End;
+			unsigned int							m_Work;
+			unsigned int							m_MinWork;
+			bool									m_Limited;
+
+			Budget() : m_Work(0), m_MinWork(0), m_Limited(false) {}
+			Budget(unsigned int microseconds, unsigned int minWork) : m_End(std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds)), m_Work(0), m_MinWork(minWork), m_Limited(true) {}
+
+			inline bool Spent()
+			{
+				return m_Limited && ++m_Work >= m_MinWork && (m_Work & 63) == 0 && std::chrono::steady_clock::now() >= m_End;
+			}
+		};
+
+		//starts a collection, a gen2 collection starts by whitening the old generation
+		void Begin();
+		//whitens old objects until all are white or the budget is spent, true when done
+		bool Whiten(Budget& budget);
+		//the remembered old objects and the roots become grey
+		void StartMarking();
+		//pushes part of parts of the roots that are white, so several threads can share them.
+		//Marker is the collector itself or a MarkWorker of the parallel marking
+		template<class Marker>
+		void MarkRoots(Marker& marker, unsigned int part, unsigned int parts);
+		//traces what a grey object points to
+		template<class Marker>
+		void Scan(const Value& obj, Marker& marker);
+		//traces greys until none are left or the budget is spent, true when done
+		bool Propagate(Budget& budget);
+		//traces the elements of m_Partial, true when done
+		bool TraceArray(Budget& budget);
+		//roots and greys traced by all marking threads, without a budget
+		void MarkParallel();
+		//finishes marking without a break and starts the sweep
+		void Atomic();
+		//frees white objects until all are swept or the budget is spent, true when done
+		bool Sweep(Budget& budget);
+		void End();
+		//carries the collection in progress on, true once it is done
+		bool Advance(Budget& budget);
+
+		void FreeString(JetString* str);
+		//pushes v if it is white and notes whether it stays in the nursery
+		void Trace(const Value& v, bool& young);
+		//captures are not traced on their own, the closures that reach them mark them
+		void MarkCapture(Capture* uv)
+		{
+			uv->m_Grey = true;
+			uv->m_Mark = true;
+		}
+		//the prototypes are not in the generations, so nothing else whitens them
+		void WhitenPrototypes();
 
 		void Free(gcval* val);
 	};
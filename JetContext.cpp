@@ -4,6 +4,9 @@
 #include <stack>
 #include <fstream>
 #include <memory>
+#include <climits>
+#include <random>
+#include <chrono>
 
 #undef Yield
 
@@ -78,6 +81,7 @@ Value& JetContext::operator[](const std::string& id)
 		//add it
 		m_VariableIndex[id] = (unsigned int)m_VariableIndex.size();
 		m_Variables.push_back(Value::Empty);
+		m_VariablesData = m_Variables.data();
 		return m_Variables[m_VariableIndex[id]];
 	}
 	else
@@ -107,6 +111,7 @@ void JetContext::Set(const std::string& name, const Value& value)
 		//add it
 		m_VariableIndex[name] = (unsigned int)m_VariableIndex.size();
 		m_Variables.push_back(value);
+		m_VariablesData = m_Variables.data();
 	}
 	else
 	{
@@ -141,6 +146,7 @@ Value JetContext::CreateNewArray()
 	a->m_Grey = a->m_Mark = false;
 	a->m_Type = ValueType::Array;
 	a->m_Context = this;
+	a->m_Dirty = 0;
 
 	return Value(a);
 }
@@ -159,29 +165,214 @@ Value JetContext::CreateNewUserData(void* data, const Value& proto)
 
 Value JetContext::CreateNewString(const char* string, bool copy)
 {
-	if (copy)
+	//the characters always get copied behind the header, a handed over buffer is freed
+	Value str = this->NewString(string, (unsigned int)strlen(string));
+	if (copy == false)
+		delete[] string;
+	return str;
+}
+
+JetString* JetContext::AllocateString(const char* string, unsigned int length)
+{
+	auto str = m_GC.NewString(length);
+	str->m_Grey = str->m_Mark = false;
+	str->m_RefCount = 0;
+	str->m_Type = ValueType::String;
+	memcpy(str->m_Data, string, length);
+	str->m_Data[length] = 0;
+	str->m_Length = length;
+	str->m_Hash = StringHash(string, length);
+	str->m_Interned = str->m_Pinned = false;
+	str->m_Context = this;
+	return str;
+}
+
+Value JetContext::NewString(const char* string, unsigned int length)
+{
+	if (length > JET_SHORT_STRING_LENGTH)
+		return Value(this->AllocateString(string, length));
+
+	unsigned int hash = StringHash(string, length);
+	JetString* str = m_GC.Revive(m_Strings.Find(string, length, hash));
+	if (str == 0)
 	{
-		size_t len = strlen(string);
-		auto temp = new char[len+1];
-		memcpy(temp, string, len);
-		temp[len] = 0;
-		string = temp;
+		str = this->AllocateString(string, length);
+		m_Strings.Add(str);
+	}
+	return Value(str);
+}
+
+Value JetContext::Concat(const Value& left, const Value& right)
+{
+	JetString* a = left.m_String;
+	JetString* b = right.m_Type == ValueType::String ? (JetString*)right.m_String : this->CreateNewString(right.ToString().c_str()).m_String;
+
+	unsigned int length = a->m_Length + b->m_Length;
+	if (length < JET_ROPE_MIN_LENGTH)
+	{
+		Flatten(a);
+		Flatten(b);
+		char text[JET_ROPE_MIN_LENGTH];
+		memcpy(text, a->m_Data, a->m_Length);
+		memcpy(text + a->m_Length, b->m_Data, b->m_Length);
+		return this->NewString(text, length);
 	}
-	auto str = m_GC.New<GCVal<char*>>((char*)string);
+
+	//the halves are shared from now on, so their characters can not change anymore
+	a->m_Piece = b->m_Piece = true;
+	auto str = m_GC.New<JetString>((char*)0);
 	str->m_Grey = str->m_Mark = false;
 	str->m_RefCount = 0;
 	str->m_Type = ValueType::String;
+	str->m_Length = length;
+	str->m_Hash = 0;
+	str->m_Interned = str->m_Pinned = false;
 	str->m_Context = this;
+	str->m_Left = a;
+	str->m_Right = b;
 	return Value(str);
 }
 
+void Jet::FlattenRope(JetString* str)
+{
+	char* text = new char[str->m_Length + 1];
+	text[str->m_Length] = 0;
+
+	//fill from the end, ropes from s = s + piece lean left so the stack only
+	//holds left halves while a right half is a rope itself
+	char* end = text + str->m_Length;
+	std::vector<JetString*> left;
+	JetString* s = str;
+	for (;;)
+	{
+		if (s->m_Data)
+		{
+			end -= s->m_Length;
+			memcpy(end, s->m_Data, s->m_Length);
+			if (left.empty())
+				break;
+			s = left.back();
+			left.pop_back();
+		}
+		else
+		{
+			left.push_back(s->m_Left);
+			s = s->m_Right;
+		}
+	}
+
+	str->m_Data = text;
+	str->m_Hash = StringHash(text, str->m_Length);
+	str->m_Left = str->m_Right = 0;
+}
+
+void Jet::DetachView(JetString* str)
+{
+	char* text = new char[str->m_Length + 1];
+	memcpy(text, str->m_Data, str->m_Length);
+	text[str->m_Length] = 0;
+	str->m_Data = text;
+	str->m_Left = 0;
+}
+
+void Jet::HashView(JetString* str)
+{
+	str->m_Hash = StringHash(str->m_Data, str->m_Length);
+	str->m_Hashed = true;
+}
+
+Value JetContext::Substring(JetString* str, unsigned int start, unsigned int length)
+{
+	Flatten(str);
+	if (length < JET_VIEW_MIN_LENGTH)
+		return this->NewString(str->m_Data + start, length);
+
+	//a view of a view points into the same parent, whose characters are fixed from now on
+	JetString* parent = IsView(str) ? str->m_Left : str;
+	parent->m_Piece = true;
+	auto view = m_GC.New<JetString>(str->m_Data + start);
+	view->m_Grey = view->m_Mark = false;
+	view->m_RefCount = 0;
+	view->m_Type = ValueType::String;
+	view->m_Length = length;
+	view->m_Hash = 0;
+	view->m_Hashed = false;
+	view->m_Interned = view->m_Pinned = false;
+	view->m_Context = this;
+	view->m_Left = parent;
+	return Value(view);
+}
+
+JetString* JetContext::Intern(const char* string)
+{
+	unsigned int length = (unsigned int)strlen(string);
+	JetString* str = m_GC.Revive(m_Strings.Find(string, length, StringHash(string, length)));
+	if (str == 0)
+	{
+		str = this->AllocateString(string, length);
+		m_Strings.Add(str);
+	}
+	return str;
+}
+
+JetString* JetContext::Intern(JetString* str)
+{
+	if (str->m_Interned)
+		return str;
+
+	Hash(Flatten(str));
+	//the string itself becomes the interned one unless its content already is
+	JetString* interned = m_GC.Revive(m_Strings.Find(str->m_Data, str->m_Length, str->m_Hash));
+	if (interned)
+		return interned;
+	//keys live long, they should not keep a whole input buffer alive
+	if (IsView(str))
+		DetachView(str);
+	m_Strings.Add(str);
+	return str;
+}
+
+JetString* JetContext::FindString(const char* string) const
+{
+	unsigned int length = (unsigned int)strlen(string);
+	return m_Strings.Find(string, length, StringHash(string, length));
+}
+
+JetString* JetContext::FindString(JetString* str) const
+{
+	if (str->m_Interned)
+		return str;
+	Flatten(str);
+	return m_Strings.Find(str->m_Data, str->m_Length, Hash(str)->m_Hash);
+}
+
+void JetContext::PinString(JetString* str)
+{
+	//one reference for all holders, the count is only 8 bits
+	if (str->m_Pinned == false)
+	{
+		str->m_Pinned = true;
+		Value(str).AddRef();
+	}
+}
+
 #include "Libraries/File.h"
 #include "Libraries/Math.h"
 
-JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDEPTH, "Call Stack Overflow")
+JetContext::JetContext() : m_Stack(JET_STACK_SIZE), m_CallStack(JET_MAX_CALLDEPTH, "Call Stack Overflow"), m_GC(this)
+#ifdef JET_JIT
+	, m_Jit(this)
+#endif
 {
-	this->m_SP = this->m_LocalStack;//initialize stack pointer
+	this->m_SP = this->m_Stack._data;//initialize stack pointer
+	this->m_VariablesData = 0;
 	this->m_CurFrame = 0;
+	this->m_RootShape = new Shape(0);
+
+	//random_device may be deterministic on some platforms, mix in the clock and our address
+	std::random_device random;
+	this->m_HashSeed = ((uint64_t)random() << 32) ^ random()
+		^ (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count() ^ (uint64_t)(size_t)this;
 
 	//add more functions and junk
 	(*this)["print"] = print;
@@ -223,7 +414,7 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 		if (argc < 1 || args[0].m_Type != ValueType::String)
 			throw RuntimeException("Cannot load non string");
 
-		return context->Assemble(context->Compile(args[0].m_String->m_Data, "loadstring"));
+		return context->Assemble(context->Compile(Terminate(args[0].m_String)->m_Data, "loadstring"));
 	};
 
 	(*this)["setprototype"] = [](JetContext* context, Value* v, int args)
@@ -234,7 +425,7 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 		if (v->m_Type == ValueType::Object && v[1].m_Type == ValueType::Object)
 		{
 			Value val = v[0];
-			val.m_Object->m_Prototype = v[1].m_Object;
+			val.m_Object->SetPrototype(v[1].m_Object);
 			return val;
 		}
 		else
@@ -248,6 +439,7 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 		if (args != 1 || v->m_Type != ValueType::String)
 			throw RuntimeException("Invalid Call, Improper Arguments!");
 
+		Terminate(v->m_String);
 		auto iter = context->m_RequireCache.find(v->m_String->m_Data);
 		if (iter == context->m_RequireCache.end())
 		{
@@ -313,14 +505,7 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 	(*this->m_StringPrototype)["append"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args == 2 && v[0].m_Type == ValueType::String && v[1].m_Type == ValueType::String)
-		{
-			size_t len = v[0].m_Length + v[1].m_Length + 1;
-			char* text = new char[len];
-			memcpy(text, v[0].m_String->m_Data, v[0].m_Length);
-			memcpy(text+v[0].m_Length, v[1].m_String->m_Data, v[1].m_Length);
-			text[len-1] = 0;
-			return context->CreateNewString(text, false);
-		}
+			return context->Concat(v[0], v[1]);
 		else
 			throw RuntimeException("bad append call!");
 	});
@@ -328,11 +513,12 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 	{
 		if (args && v->m_Type == ValueType::String)
 		{
-			char* str = new char[v->m_Length+1];
-			memcpy(str, v->m_String->m_Data, v->m_Length);
-			for (unsigned int i = 0; i < v->m_Length; i++)
+			Flatten(v->m_String);
+			char* str = new char[v->m_String->m_Length+1];
+			memcpy(str, v->m_String->m_Data, v->m_String->m_Length);
+			for (unsigned int i = 0; i < v->m_String->m_Length; i++)
 				str[i] = tolower(str[i]);
-			str[v->m_Length] = 0;
+			str[v->m_String->m_Length] = 0;
 			return context->CreateNewString(str, false);
 		}
 		throw RuntimeException("bad lower call");
@@ -341,11 +527,12 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 	{
 		if (args && v->m_Type == ValueType::String)
 		{
-			char* str = new char[v->m_Length+1];
-			memcpy(str, v->m_String->m_Data, v->m_Length);
-			for (unsigned int i = 0; i < v->m_Length; i++)
+			Flatten(v->m_String);
+			char* str = new char[v->m_String->m_Length+1];
+			memcpy(str, v->m_String->m_Data, v->m_String->m_Length);
+			for (unsigned int i = 0; i < v->m_String->m_Length; i++)
 				str[i] = toupper(str[i]);
-			str[v->m_Length] = 0;
+			str[v->m_String->m_Length] = 0;
 			return context->CreateNewString(str, false);
 		}
 		throw RuntimeException("bad upper call");
@@ -354,21 +541,14 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 	(*this->m_StringPrototype)["_add"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args == 2 && v[0].m_Type == ValueType::String && v[1].m_Type == ValueType::String)
-		{
-			size_t len = v[0].m_Length + v[1].m_Length + 1;
-			char* text = new char[len];
-			memcpy(text, v[1].m_String->m_Data, v[1].m_Length);
-			memcpy(text+v[1].m_Length, v[0].m_String->m_Data, v[0].m_Length);
-			text[len-1] = 0;
-			return context->CreateNewString(text, false);
-		}
+			return context->Concat(v[1], v[0]);
 		else
 			throw RuntimeException("bad string::append() call!");
 	});
 	(*this->m_StringPrototype)["length"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args == 1 && v->m_Type == ValueType::String)
-			return Value((int64_t)v->m_Length);
+			return Value((int64_t)v->m_String->m_Length);
 		else
 			throw RuntimeException("bad string:length() call!");
 	});
@@ -379,18 +559,24 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 			if (v[0].m_Type != ValueType::String)
 				throw RuntimeException("must be a string");
 
-			int len = v[0].m_Length-(int)v[1];
-			if (len < 0)
+			int start = (int)v[1];
+			int len = v[0].m_String->m_Length-start;
+			if (start < 0 || len < 0)
 				throw RuntimeException("Invalid string index");
 
-			char* str = new char[len+1];
-			CopySizedString(str, &v[0].m_String->m_Data[(int)v[1]], len+1,len);
-			str[len] = 0;
-			return context->CreateNewString(str, false);
+			return context->Substring(v[0].m_String, start, len);
 		}
 		else if (args == 3)
 		{
-			throw RuntimeException("Not Implemented!");
+			if (v[0].m_Type != ValueType::String)
+				throw RuntimeException("must be a string");
+
+			int start = (int)v[1];
+			int len = (int)v[2];
+			if (start < 0 || len < 0 || start + len > (int)v[0].m_String->m_Length)
+				throw RuntimeException("Invalid string index");
+
+			return context->Substring(v[0].m_String, start, len);
 		}
 		else
 			throw RuntimeException("bad sub call");
@@ -402,7 +588,10 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 	(*this->m_ArrayPrototype)["add"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args == 2)
+		{
 			v->m_Array->m_Data.push_back(v[1]);
+			context->m_GC.Barrier(v->m_Array, (unsigned int)v->m_Array->m_Data.size() - 1);
+		}
 		else
 			throw RuntimeException("Invalid add call!!");
 		return Value::Empty;
@@ -425,7 +614,11 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 	(*this->m_ArrayPrototype)["remove"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args == 2)
+		{
+			//the elements behind it move down
 			v->m_Array->m_Data.erase(v->m_Array->m_Data.begin()+(int)v[1]);
+			context->m_GC.Barrier(v->m_Array, (int)v[1]);
+		}
 		else
 			throw RuntimeException("Invalid remove call!!");
 		return Value::Empty;
@@ -493,7 +686,7 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 		if (iterator->iterator == iterator->container->end())
 			return Value::Zero;
 
-		iterator->current = iterator->iterator->second;
+		iterator->current = (*iterator->iterator).second;
 		++iterator->iterator;
 		return Value::One;
 	});
@@ -564,7 +757,7 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 					return *v;//hack for foreach loops
 			}
 
-			Closure* closure = new Closure;
+			Closure* closure = context->m_GC.New<Closure>();
 			closure->m_RefCount = 0;
 			closure->m_Grey = closure->m_Mark = false;
 			closure->m_Prev = v->m_Function->m_Prev;
@@ -573,7 +766,7 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 			if (closure->m_UpValueCount)
 				closure->m_UpValues = new Capture*[closure->m_UpValueCount];
 			closure->m_Prototype = v->m_Function->m_Prototype;
-			context->m_GC.AddObject((GarbageCollector::gcval*)closure);
+			closure->m_Type = ValueType::Function;
 
 			if (closure->m_Generator->m_State == Generator::GeneratorState::Dead)
 				return Value::Empty;
@@ -608,6 +801,64 @@ JetContext::JetContext() : m_GC(this), m_Stack(4096), m_CallStack(JET_MAX_CALLDE
 		throw RuntimeException("");
 	});
 
+	//mutable string with amortized growth for building long results piece by piece
+	this->m_StringBuilderPrototype = new JetObject(this);
+	this->m_StringBuilderPrototype->m_Prototype = 0;
+	(*this)["StringBuilder"] = [](JetContext* context, Value* v, int args)
+	{
+		auto builder = new std::string;
+		for (int i = 0; i < args; i++)
+			*builder += v[i].ToString();
+		return context->CreateNewUserData(builder, context->m_StringBuilderPrototype);
+	};
+	(*this->m_StringBuilderPrototype)["append"] = Value([](JetContext* context, Value* v, int args)
+	{
+		if (args < 1 || v->m_Type != ValueType::Userdata || v->m_UserData->m_Prototype != context->m_StringBuilderPrototype)
+			throw RuntimeException("bad StringBuilder:append() call!");
+
+		auto builder = v->GetUserdata<std::string>();
+		for (int i = 1; i < args; i++)
+		{
+			if (v[i].m_Type == ValueType::String)
+				builder->append(Flatten(v[i].m_String)->m_Data, v[i].m_String->m_Length);
+			else
+				builder->append(v[i].ToString());
+		}
+		return v[0];
+	});
+	(*this->m_StringBuilderPrototype)["appendNumber"] = Value([](JetContext* context, Value* v, int args)
+	{
+		if (args != 2 || v->m_Type != ValueType::Userdata || v->m_UserData->m_Prototype != context->m_StringBuilderPrototype)
+			throw RuntimeException("bad StringBuilder:appendNumber() call!");
+
+		char text[32];
+		if (v[1].m_Type == ValueType::Int)
+			snprintf(text, sizeof(text), "%lld", (long long)v[1].m_IntValue);
+		else if (v[1].m_Type == ValueType::Real)
+			snprintf(text, sizeof(text), "%f", (double)v[1].m_RealValue);
+		else
+			throw RuntimeException("StringBuilder:appendNumber() needs a number!");
+		v->GetUserdata<std::string>()->append(text);
+		return v[0];
+	});
+	(*this->m_StringBuilderPrototype)["length"] = Value([](JetContext* context, Value* v, int args)
+	{
+		if (args != 1 || v->m_Type != ValueType::Userdata || v->m_UserData->m_Prototype != context->m_StringBuilderPrototype)
+			throw RuntimeException("bad StringBuilder:length() call!");
+		return Value((int64_t)v->GetUserdata<std::string>()->length());
+	});
+	(*this->m_StringBuilderPrototype)["toString"] = Value([](JetContext* context, Value* v, int args)
+	{
+		if (args != 1 || v->m_Type != ValueType::Userdata || v->m_UserData->m_Prototype != context->m_StringBuilderPrototype)
+			throw RuntimeException("bad StringBuilder:toString() call!");
+		return context->CreateNewString(v->GetUserdata<std::string>()->c_str());
+	});
+	(*this->m_StringBuilderPrototype)["_gc"] = Value([](JetContext* context, Value* v, int args)
+	{
+		delete v->GetUserdata<std::string>();
+		return Value::Empty;
+	});
+
 	//load default libraries
 	RegisterFileLibrary(this);
 	RegisterMathLibrary(this);
@@ -632,6 +883,9 @@ JetContext::~JetContext()
 	delete this->m_ArrayIterPrototype;
 	delete this->m_ObjectIterPrototype;
 	delete this->m_FunctionPrototype;
+	delete this->m_StringBuilderPrototype;
+
+	delete this->m_RootShape;
 }
 
 #ifndef _WIN32
@@ -704,6 +958,217 @@ void JetContext::RunGC()
 	this->m_GC.Run();
 }
 
+Value JetContext::LoadMember(const Value& loc, JetString* name, InlineCache* cache)
+{
+	if (loc.m_Type == ValueType::Object)
+	{
+		JetObject* obj = loc.m_Object;
+		if (cache)
+		{
+			//a matching shape means the receiver still has the same keys,
+			//a matching prototype means the holder is still alive
+			if (cache->m_Shape == obj->m_Shape && obj->m_Shape)
+			{
+				if (cache->m_Holder == 0)
+				{
+					m_CacheHits++;
+					return obj->m_Slots[cache->m_Slot];
+				}
+				else if (cache->m_Holder == obj->m_Prototype && cache->m_HolderShape == cache->m_Holder->m_Shape)
+				{
+					m_CacheHits++;
+					return cache->m_Holder->m_Slots[cache->m_Slot];
+				}
+			}
+			m_CacheMisses++;
+		}
+
+		//look in the object first, then up its prototype chain through the method cache
+		JetObject* holder = obj;
+		auto v = obj->findValue(name);
+		if (v == 0)
+		{
+			if (obj->m_Prototype == 0)
+				return Value::Empty;
+			v = this->FindMethod(obj->m_Prototype, name, &holder);
+			if (v == 0)
+				return Value::Empty;
+		}
+
+		//only cache hits on the object or its direct prototype, deeper
+		//prototypes could be shadowed without the receiver noticing
+		if (cache && obj->m_Shape && holder->m_Shape && (holder == obj || holder == obj->m_Prototype))
+		{
+			cache->m_Shape = obj->m_Shape;
+			cache->m_HolderShape = holder->m_Shape;
+			cache->m_Holder = holder == obj ? 0 : holder;
+			cache->m_Slot = (unsigned int)(v - holder->m_Slots);
+		}
+		return *v;
+	}
+
+	JetObject* proto;
+	if (loc.m_Type == ValueType::String)
+		proto = this->m_StringPrototype;
+	else if (loc.m_Type == ValueType::Array)
+		proto = this->m_ArrayPrototype;
+	else if (loc.m_Type == ValueType::Userdata)
+		proto = loc.m_UserData->m_Prototype;
+	else if (loc.m_Type == ValueType::Function && loc.m_Function->m_Prototype->m_Generator)
+		proto = this->m_FunctionPrototype;
+	else
+		throw RuntimeException("Could not index a non array/object value!");
+
+	auto v = this->FindMethod(proto, name);
+	return v ? *v : Value::Empty;
+}
+
+Value* JetContext::FindMethod(JetObject* proto, JetString* name, JetObject** holder)
+{
+	auto& entry = this->m_Methods[(((size_t)proto >> 4) ^ name->m_Hash) & (JET_METHOD_CACHE_SIZE - 1)];
+	if (entry.m_Prototype != proto || entry.m_Name != name || entry.m_Version != this->m_MethodVersion)
+	{
+		entry.m_Prototype = proto;
+		entry.m_Name = name;
+		entry.m_Version = this->m_MethodVersion;
+		entry.m_Value = 0;
+		entry.m_Holder = 0;
+		for (auto h = proto; h; h = h->m_Prototype)
+		{
+			//from now on adding keys to h has to invalidate the entry
+			h->m_MethodCached = true;
+			if (auto v = h->findValue(name))
+			{
+				entry.m_Value = v;
+				entry.m_Holder = h;
+				break;
+			}
+		}
+	}
+	if (holder)
+		*holder = entry.m_Holder;
+	return entry.m_Value;
+}
+
+void JetContext::InvalidateMethods()
+{
+	//on wrap around clear the entries so none of them can match the new version by accident
+	if (++this->m_MethodVersion == 0)
+	{
+		for (auto& entry : this->m_Methods)
+			entry = MethodCacheEntry();
+		this->m_MethodVersion = 1;
+	}
+}
+
+void JetContext::StoreMember(JetObject* obj, JetString* name, const Value& val, InlineCache* cache)
+{
+	if (cache && obj->m_Shape)
+	{
+		//metamethod tables on the chain copied the old value
+		if (obj->m_MethodCached && name->m_Data[0] == '_')
+			this->m_MetaVersion++;
+		if (cache->m_Shape == obj->m_Shape)
+		{
+			m_CacheHits++;
+			obj->m_Slots[cache->m_Slot] = val;
+			return;
+		}
+		else if (cache->m_HolderShape == obj->m_Shape)
+		{
+			//the same key gets added to another object with the same history
+			m_CacheHits++;
+			if (obj->m_MethodCached)
+				this->InvalidateMethods();
+			obj->Append(cache->m_Shape);
+			obj->m_Slots[cache->m_Slot] = val;
+			return;
+		}
+		m_CacheMisses++;
+	}
+
+	auto shape = obj->m_Shape;
+	Value* v = obj->getValue(name);
+	*v = val;
+	if (cache && obj->m_Shape)
+	{
+		cache->m_Shape = obj->m_Shape;
+		//remember the transition if this store added the key
+		cache->m_HolderShape = shape != obj->m_Shape ? shape : 0;
+		cache->m_Holder = 0;
+		cache->m_Slot = (unsigned int)(v - obj->m_Slots);
+	}
+}
+
+Value JetContext::LoadIndexOf(const Value& loc, Value& index)
+{
+	if (loc.m_Type == ValueType::Array)
+	{
+		int in = (int)index;
+		if (in >= (int)loc.m_Array->m_Data.size() || in < 0)
+			throw RuntimeException("Array index out of range!");
+		return loc.m_Array->m_Data[in];
+	}
+	else if (loc.m_Type == ValueType::Object)
+	{
+		return loc.m_Object->get(index);
+	}
+	else if (loc.m_Type == ValueType::String)
+	{
+		int in = (int)index;
+		if (in >= (int)loc.m_String->m_Length || in < 0)
+			throw RuntimeException("String index out of range!");
+
+		return Value(Flatten(loc.m_String)->m_Data[in]);
+	}
+	throw RuntimeException("Could not index a non array/object value!");
+}
+
+bool JetContext::StoreIndexOf(Value& loc, Value& index, Value& val)
+{
+	if (loc.m_Type == ValueType::Array)
+	{
+		int in = (int)index;
+		if (in >= (int)loc.m_Array->m_Data.size() || in < 0)
+			throw RuntimeException("Array index out of range!");
+		loc.m_Array->m_Data[in] = val;
+
+		//write barrier
+		m_GC.Barrier(loc.m_Array, in);
+	}
+	else if (loc.m_Type == ValueType::Object)
+	{
+		//operator[] does the write barrier
+		(*loc.m_Object)[index] = val;
+	}
+	else if (loc.m_Type == ValueType::String)
+	{
+		int in = (int)index;
+		if (in >= (int)loc.m_String->m_Length || in < 0)
+			throw RuntimeException("String index out of range!");
+
+		//interned strings are shared by every constant and key with their content and ropes
+		//and views read the characters of the strings they were built from later, so the store
+		//writes a copy that replaces loc. StoreAt puts it back into the variable loc came from,
+		//it is not interned even when it is short
+		Flatten(loc.m_String);
+		bool copy = loc.m_String->m_Interned || loc.m_String->m_Piece;
+		if (copy)
+			loc = Value(this->AllocateString(loc.m_String->m_Data, loc.m_String->m_Length));
+		if (IsView(loc.m_String))
+			DetachView(loc.m_String);
+		loc.m_String->m_Data[in] = (int)val;
+		loc.m_String->m_Hash = StringHash(loc.m_String->m_Data, loc.m_String->m_Length);
+		loc.m_String->m_Hashed = true;
+		return copy;
+	}
+	else
+	{
+		throw RuntimeException("Could not index a non array/object value!");
+	}
+	return false;
+}
+
 unsigned int JetContext::Call(const Value* fun, unsigned int iptr, unsigned int args)
 {
 	if (fun->m_Type == ValueType::Function)
@@ -711,26 +1176,22 @@ unsigned int JetContext::Call(const Value* fun, unsigned int iptr, unsigned int
 		//let generators be called
 		if (fun->m_Function->m_Generator)
 		{
-			m_CallStack.Push(std::pair<unsigned int, Closure*>(iptr, m_CurFrame));
-
-			m_SP += m_CurFrame->m_Prototype->m_Locals;
-
-			if ((m_SP - m_LocalStack) >= JET_STACK_SIZE)
-				throw RuntimeException("Stack Overflow!");
+			m_CallStack.Reserve(1);
+			vmstack_push(m_CallStack, CallFrame(iptr, m_CurFrame, m_SP));
 
 			m_CurFrame = fun->m_Function;
 
+			//the first argument is what the yield the generator stopped at evaluates to
 			if (args == 0)
 				m_Stack.Push(Value::Empty);
 			else if (args > 1)
-				for (unsigned int i = 1; i < args; i++)
-					m_Stack.Pop();
+				m_Stack.QuickPop(args - 1);
 			return fun->m_Function->m_Generator->Resume(this)-1;
 		}
 		if (fun->m_Function->m_Prototype->m_Generator)
 		{
 			//create generator and return it
-			Closure* closure = new Closure;
+			Closure* closure = m_GC.New<Closure>();
 			closure->m_Grey = closure->m_Mark = false;
 			closure->m_Prev = fun->m_Function->m_Prev;
 			closure->m_UpValueCount = fun->m_Function->m_UpValueCount;
@@ -740,63 +1201,16 @@ unsigned int JetContext::Call(const Value* fun, unsigned int iptr, unsigned int
 				closure->m_UpValues = new Capture*[closure->m_UpValueCount];
 			closure->m_Prototype = fun->m_Function->m_Prototype;
 			closure->m_Type = ValueType::Function;
-			this->m_GC.AddObject((GarbageCollector::gcval*)closure);
 
 			this->m_Stack.Push(Value(closure));
 			return iptr;
 		}
 
 		//manipulate frame pointer
-		m_CallStack.Push(std::pair<unsigned int, Closure*>(iptr, m_CurFrame));
-
-		m_SP += m_CurFrame->m_Prototype->m_Locals;
-
-		//clean out the new stack for the m_GC
-		for (unsigned int i = 0; i < fun->m_Function->m_Prototype->m_Locals; i++)
-		{
-			m_SP[i] = Value::Empty;
-		}
-
-		if ((m_SP - m_LocalStack) >= JET_STACK_SIZE)
-		{
-			throw RuntimeException("Stack Overflow!");
-		}
+		m_CallStack.Reserve(1);
+		vmstack_push(m_CallStack, CallFrame(iptr, m_CurFrame, m_SP));
 
-		m_CurFrame = fun->m_Function;
-
-		Function* func = m_CurFrame->m_Prototype;
-		//set all the locals
-		if (args <= func->m_Args)
-		{
-			for (int i = (int)func->m_Args-1; i >= 0; i--)
-			{
-				if (i < (int)args)
-					m_Stack.Pop(m_SP[i]);
-			}
-		}
-		else if (func->m_VarArg)
-		{
-			m_SP[func->m_Locals-1] = this->CreateNewArray();
-			auto arr = &m_SP[func->m_Locals-1].m_Array->m_Data;
-			arr->resize(args - func->m_Args);
-			for (int i = (int)args-1; i >= 0; i--)
-			{
-				if (i < (int)func->m_Args)
-					m_Stack.Pop(m_SP[i]);
-				else
-					m_Stack.Pop((*arr)[i]);
-			}
-		}
-		else
-		{
-			for (int i = (int)args-1; i >= 0; i--)
-			{
-				if (i < (int)func->m_Args)
-					m_Stack.Pop(m_SP[i]);
-				else
-					m_Stack.QuickPop();
-			}
-		}
+		this->EnterFrame(fun->m_Function, args);
 
 		//go to function
 		return -1;
@@ -807,14 +1221,15 @@ unsigned int JetContext::Call(const Value* fun, unsigned int iptr, unsigned int
 
 		//ok fix this to be cleaner and resolve stack printing
 		//should just push a value to indicate that we are in a native function call
-		m_CallStack.Push(std::pair<unsigned int, Closure*>(iptr, m_CurFrame));
-		m_CallStack.Push(std::pair<unsigned int, Closure*>(JET_BAD_INSTRUCTION, 0));
+		m_CallStack.Reserve(2);
+		vmstack_push(m_CallStack, CallFrame(iptr, m_CurFrame, m_SP));
+		vmstack_push(m_CallStack, CallFrame(JET_BAD_INSTRUCTION, 0, m_SP));
 		Closure* temp = m_CurFrame;
-		m_SP += temp->m_Prototype->m_Locals;
+		Value* sp = m_SP;
 		m_CurFrame = 0;
 		Value ret = (*fun->m_NativeFunction)(this,tmp,args);
 		m_Stack.QuickPop(args);
-		m_SP -= temp->m_Prototype->m_Locals;		
+		m_SP = sp;
 		m_CurFrame = temp;
 		m_CallStack.QuickPop(2);
 		m_Stack.Push(ret);
@@ -824,7 +1239,7 @@ unsigned int JetContext::Call(const Value* fun, unsigned int iptr, unsigned int
 	{
 		Value* tmp = &m_Stack._data[m_Stack.size()-args];
 		Value ret;
-		if(fun->TryCallMetamethod("_call", tmp, args, &ret))
+		if(fun->TryCallMetamethod(Metamethod::Call, tmp, args, &ret))
 		{
 			m_Stack.QuickPop(args);
 			m_Stack.Push(ret);
@@ -835,6 +1250,63 @@ unsigned int JetContext::Call(const Value* fun, unsigned int iptr, unsigned int
 	throw RuntimeException("Cannot call non function type " + std::string(fun->Type()) + "!!!");
 }
 
+void JetContext::EnterFrame(Closure* closure, unsigned int args)
+{
+	Function* func = closure->m_Prototype;
+	unsigned int base = m_Stack._size - args;
+	m_Stack.EnsureCapacity(base + func->m_Locals + func->m_MaxStack);
+
+	Value* sp = &m_Stack._data[base];
+	m_CurFrame = closure;
+	if (args > func->m_Args && func->m_VarArg)
+	{
+		//the extra arguments go into the rest array, the local right after the named arguments
+		Value rest = this->CreateNewArray();
+		rest.m_Array->m_Data.assign(sp + func->m_Args, sp + args);
+		sp[func->m_Args] = rest;
+		args = func->m_Args + 1;
+	}
+	else if (args > func->m_Args)
+	{
+		args = func->m_Args;
+	}
+
+	//clean out the rest of the frame for the m_GC
+	for (unsigned int i = args; i < func->m_Locals; i++)
+		sp[i] = Value::Empty;
+
+	m_Stack._size = base + func->m_Locals;
+	m_SP = sp;
+}
+
+void JetContext::CloseCaptures(int start)
+{
+	//remove from the back
+	while (m_OpenCaptures.size() > 0)
+	{
+		auto cur = m_OpenCaptures.back();
+		int index = (int)(cur.capture->m_Ptr - m_SP);
+		if (index < start)
+			break;
+
+#ifdef _DEBUG
+		//this just verifies that the break above works right
+		if (cur.creator != this->m_CurFrame)
+			throw RuntimeException("RUNTIME ERROR: Tried to close capture in wrong scope!");
+#endif
+
+		cur.capture->m_Closed = true;
+		cur.capture->m_Value = *cur.capture->m_Ptr;
+		cur.capture->m_Ptr = &cur.capture->m_Value;
+		//m_OutputFunction("Closed capture with value %s\n", cur->value.ToString().c_str());
+		//m_OutputFunction("Closed capture %d in %d as %s\n", i, cur, cur->upvals[i]->v->ToString().c_str());
+
+		//do a write barrier, the value is no longer on the stack
+		this->m_GC.Barrier(cur.capture);
+		m_OpenCaptures.pop_back();
+	}
+}
+
 Value JetContext::Execute(int iptr, Closure* frame)
 {
 #ifdef JET_TIME_EXECUTION
@@ -847,341 +1319,526 @@ Value JetContext::Execute(int iptr, Closure* frame)
 	unsigned int startstack = this->m_Stack._size;
 	auto startlocalstack = this->m_SP;
 
-	vmstack_push(m_CallStack,(std::pair<unsigned int, Closure*>(JET_BAD_INSTRUCTION, nullptr)));//bad value to get it to return;
+	m_CallStack.Reserve(1);
+	vmstack_push(m_CallStack, CallFrame(JET_BAD_INSTRUCTION, nullptr, m_SP));//bad value to get it to return;
 	m_CurFrame = frame;
 
+	//every function ends with a Return (see Assemble), so the code and constant pointers
+	//are only reloaded when the frame changes and no per instruction bounds checks are needed
+	Instruction* code = frame->m_Prototype->m_Instructions.data();
+	const Value* constants = frame->m_Prototype->m_Constants.data();
+	InlineCache* caches = frame->m_Prototype->m_Caches.data();
+	Instruction* in;
+
+#define VM_FRAME()		{ code = m_CurFrame->m_Prototype->m_Instructions.data(); constants = m_CurFrame->m_Prototype->m_Constants.data(); caches = m_CurFrame->m_Prototype->m_Caches.data(); }
+//inline cache of the current named LoadAt/StoreAt/InvokeMethod, null if it has none
+#define VM_CACHE()		(in->m_Value2 >= 0 ? &caches[in->m_Value2] : nullptr)
+//register instructions of the current frame, see VALUES_REGISTER_OP
+#define VM_REGISTER_OP(op, op2)	VALUES_REGISTER_OP(m_SP, constants, in, op, op2)
+#define VM_REGISTER_ASSIGN(op2)	VALUES_REGISTER_ASSIGN(m_SP, constants, in, op2)
+#define VM_REGISTER_CMP(op)		VALUES_REGISTER_CMP(m_SP, constants, in, op)
+
+#ifdef JET_THREADED_DISPATCH
+	//handler addresses, in the same order as InstructionType
+	static void* const dispatch[] =
+	{
+		&&op_Add, &&op_Mul, &&op_Div, &&op_Sub, &&op_Modulus,
+		&&op_Negate,
+		&&op_BAnd, &&op_BOr, &&op_Xor, &&op_BNot,
+		&&op_LeftShift, &&op_RightShift,
+		&&op_Eq, &&op_NotEq,
+		&&op_Lt, &&op_Gt,
+		&&op_LtE, &&op_GtE,
+		&&op_Incr,
+		&&op_Decr,
+		&&op_Dup, &&op_Pop,
+		&&op_LdInt,
+		&&op_LdReal,
+		&&op_LdNull,
+		&&op_LdStr,
+		&&op_LoadFunction,
+		&&op_Jump,
+		&&op_JumpTrue, &&op_JumpTruePeek,
+		&&op_JumpFalse, &&op_JumpFalsePeek,
+		&&op_NewArray,
+		&&op_NewObject,
+		&&op_Store, &&op_Load,
+		&&op_LStore, &&op_LLoad,
+		&&op_CStore, &&op_CLoad,
+		&&op_CInit,
+		&&op_default,//ForEach
+		&&op_LoadAt,
+		&&op_StoreAt,
+		&&op_ECall,
+		&&op_Call,
+		&&op_Return,
+		&&op_Resume,
+		&&op_Yield,
+		&&op_Close,
+		&&op_TailCall, &&op_TailECall,
+		&&op_LtLocalsJumpFalse,
+		&&op_LtLocalImmJumpFalse,
+		&&op_AddLocalImm,
+		&&op_IncrLocal,
+		&&op_InvokeMethod,
+		&&op_AddR, &&op_SubR, &&op_MulR, &&op_DivR, &&op_ModulusR,
+		&&op_BAndR, &&op_BOrR, &&op_XorR,
+		&&op_LeftShiftR, &&op_RightShiftR,
+		&&op_EqR, &&op_NotEqR,
+		&&op_LtR, &&op_GtR,
+		&&op_LtER, &&op_GtER,
+		&&op_AddIntInt, &&op_AddRealReal,
+		&&op_SubIntInt, &&op_SubRealReal,
+		&&op_MulIntInt, &&op_MulRealReal,
+		&&op_DivIntInt, &&op_DivRealReal,
+		&&op_LtIntInt, &&op_LtRealReal,
+		&&op_GtIntInt, &&op_GtRealReal,
+		&&op_LtEIntInt, &&op_LtERealReal,
+		&&op_GtEIntInt, &&op_GtERealReal,
+		&&op_EqIntInt, &&op_EqRealReal,
+		&&op_NotEqIntInt, &&op_NotEqRealReal
+	};
+	static_assert(sizeof(dispatch)/sizeof(dispatch[0]) == (int)InstructionType::Label, "dispatch table out of sync with InstructionType");
+
+#define VM_DISPATCH()	{ in = &code[iptr]; goto *dispatch[(int)in->m_Instruction]; }
+#define VM_CASE(op)		op_##op
+#define VM_DEFAULT		op_default
+#define VM_NEXT()		{ ++iptr; VM_DISPATCH(); }
+#define VM_REDISPATCH()	VM_DISPATCH()
+#else
+#define VM_CASE(op)		case InstructionType::op
+#define VM_DEFAULT		default
+#define VM_NEXT()		break
+#define VM_REDISPATCH()	continue
+#endif
+
+#ifndef JET_NO_QUICKENING
+//rewrite the current instruction to its typed form when both operands have the same type,
+//sites that failed a guard before (m_Value3 set) stay generic so they do not flip back and forth
+#define VM_QUICKEN(a, b, intop, realop)	{\
+	if (in->m_Value3 == 0 && a.m_Type == b.m_Type) {\
+		if (a.m_Type == ValueType::Int) in->m_Instruction = InstructionType::intop;\
+		else if (a.m_Type == ValueType::Real) in->m_Instruction = InstructionType::realop;\
+	}\
+	}
+#else
+#define VM_QUICKEN(a, b, intop, realop)
+#endif
+//guard of a quickened instruction failed, go back to the generic form and run that instead
+#define VM_DEOPTIMIZE(op)	{ in->m_Instruction = InstructionType::op; in->m_Value3 = 1; VM_REDISPATCH(); }
+#ifdef JET_JIT
+//counts calls and loop iterations of the current function and compiles it once it is hot,
+//compiled code then runs from the next instruction for as long as it has entry points
+#define VM_JIT()	{\
+	Function* p_ = m_CurFrame->m_Prototype;\
+	if (p_->m_Jit || (--p_->m_Hotness == 0 && m_Jit.Compile(p_)))\
+	{\
+		++iptr;\
+		m_Jit.Run(iptr);\
+		--iptr;\
+		VM_FRAME();\
+	}\
+	}
+#else
+#define VM_JIT()
+#endif
+//call fun with argc arguments on the stack. A plain script function called with exactly its arity
+//is entered directly (see TryEnterFrame), everything else goes through Call
+#define VM_CALL(fun, argc)	{\
+	const Value* f_ = (fun);\
+	unsigned int argc_ = (argc);\
+	if (this->TryEnterFrame(f_, iptr, argc_))\
+		iptr = -1;\
+	else\
+		iptr = (int)this->Call(f_, iptr, argc_);\
+	VM_FRAME();\
+	VM_JIT();\
+	}
+//call in tail position: the current frame is closed and its arguments are moved down to where
+//the frame starts, then the callee is called from our caller so it takes over our call stack entry
+//and stack slots, the result then goes straight to our caller.
+//Generator frames and frames entered from native code keep the normal call and the Return after it
+#define VM_TAILCALL(fun, argc)	{\
+	const Value* t_ = (fun);\
+	unsigned int targc_ = (argc);\
+	auto& oframe_ = vmstack_peek(m_CallStack);\
+	if (m_CurFrame->m_Generator || oframe_.m_IPtr == JET_BAD_INSTRUCTION\
+		|| (t_->m_Type == ValueType::Function && t_->m_Function->m_Generator))\
+	{\
+		VM_CALL(t_, targc_);\
+	}\
+	else\
+	{\
+		this->CloseCaptures(0);\
+		const Value* targs_ = &m_Stack._data[m_Stack._size - targc_];\
+		for (unsigned int i_ = 0; i_ < targc_; i_++)\
+			m_SP[i_] = targs_[i_];\
+		m_Stack._size = (unsigned int)(m_SP - m_Stack._data) + targc_;\
+		iptr = oframe_.m_IPtr;\
+		m_CurFrame = oframe_.m_Closure;\
+		m_SP = oframe_.m_SP;\
+		vmstack_pop(m_CallStack);\
+		VM_CALL(t_, targc_);\
+	}\
+	}
+
 	try
 	{
-		while (m_CurFrame && iptr < (int)m_CurFrame->m_Prototype->m_Instructions.size() && iptr >= 0)
+#ifdef JET_JIT
+		//functions called from native code again and again get compiled as well
+		--iptr;
+		VM_JIT();
+		++iptr;
+#endif
+#ifdef JET_THREADED_DISPATCH
+		VM_DISPATCH();
+		{
+			{
+#else
+		for (;;)
 		{
-			const Instruction& in = m_CurFrame->m_Prototype->m_Instructions[iptr];
-			switch(in.m_Instruction)
+			in = &code[iptr];
+			switch(in->m_Instruction)
 			{
-			case InstructionType::Add:
+#endif
+			VM_CASE(Add):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, AddIntInt, AddRealReal);
 					VALUES_OP(a, b, +, += );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Sub:
+			VM_CASE(Sub):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, SubIntInt, SubRealReal);
 					VALUES_OP(a, b, -, -= );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Mul:
+			VM_CASE(Mul):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, MulIntInt, MulRealReal);
 					VALUES_OP(a, b, *, *= );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Div:
+			VM_CASE(Div):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, DivIntInt, DivRealReal);
 					VALUES_OP(a, b, /, /= );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Modulus:
+			VM_CASE(Modulus):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
 					a %=b;
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::BAnd:
+			VM_CASE(BAnd):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
 					a &= b;
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::BOr:
+			VM_CASE(BOr):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
 					a |= b;
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Xor:
+			VM_CASE(Xor):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
 					a^=b;
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::BNot:
+			VM_CASE(BNot):
 				{
 					Value& a = vmstack_peek(m_Stack);
 					a = ~a;
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::LeftShift:
+			VM_CASE(LeftShift):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
 					a <<= b;
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::RightShift:
+			VM_CASE(RightShift):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
 					a >>= b;
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Incr:
+			VM_CASE(Incr):
 				{
 					Value& a = vmstack_peek(m_Stack);
 					a .Increase();
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Decr:
+			VM_CASE(Decr):
 				{
 					Value& a = vmstack_peek(m_Stack);
 					a.Decrease();
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Negate:
+			VM_CASE(Negate):
 				{
 					Value& a = vmstack_peek(m_Stack);
 					a.Negate();
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Eq:
+			VM_CASE(Eq):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, EqIntInt, EqRealReal);
 					//set_value_bool(a, a == b);
 					VALUES_CMP(a, a, b, == );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::NotEq:
+			VM_CASE(NotEq):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, NotEqIntInt, NotEqRealReal);
 					//set_value_bool(a, !(a == b));
 					VALUES_CMP(a, a, b, != );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Lt:
+			VM_CASE(Lt):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, LtIntInt, LtRealReal);
 					//set_value_bool(a, a.m_IntValue < b.m_IntValue);
 					VALUES_CMP(a, a, b, < );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Gt:
+			VM_CASE(Gt):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, GtIntInt, GtRealReal);
 					//set_value_bool(a, a.m_IntValue > b.m_IntValue);
 					VALUES_CMP(a, a, b, > );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::GtE:
+			VM_CASE(GtE):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, GtEIntInt, GtERealReal);
 					//set_value_bool(a, a.m_IntValue >= b.m_IntValue);
 					VALUES_CMP(a, a, b, >= );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::LtE:
+			VM_CASE(LtE):
 				{
 					const Value& b = vmstack_peek(m_Stack);
 					--m_Stack._size;
 					Value& a = vmstack_peek(m_Stack);
+					VM_QUICKEN(a, b, LtEIntInt, LtERealReal);
 					//set_value_bool(a, a.m_IntValue <= b.m_IntValue);
 					VALUES_CMP(a, a, b, <= );
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::LdNull:
+			VM_CASE(LdNull):
 				{
 					vmstack_push(m_Stack,Value::Empty);
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::LdInt:
+			VM_CASE(LdInt):
 				{
-					vmstack_push(m_Stack, in.m_IntValue);
-					break;
+					vmstack_push(m_Stack, constants[in->m_Value]);
+					VM_NEXT();
 				}
-			case InstructionType::LdReal:
+			VM_CASE(LdReal):
 			{
-				vmstack_push(m_Stack, in.m_RealValue);
-				break;
+				vmstack_push(m_Stack, constants[in->m_Value]);
+				VM_NEXT();
 			}
-			case InstructionType::LdStr:
+			VM_CASE(LdStr):
 				{
-					vmstack_push(m_Stack, Value(in.m_StringLiteral ));
-					break;
+					vmstack_push(m_Stack, constants[in->m_Value]);
+					VM_NEXT();
 				}
-			case InstructionType::Jump:
+			VM_CASE(Jump):
 				{
-					iptr = in.m_Value - 1;
-					break;
+					if (in->m_Value <= iptr)
+					{
+						//loop back edge
+						iptr = in->m_Value - 1;
+						VM_JIT();
+					}
+					else
+						iptr = in->m_Value - 1;
+					VM_NEXT();
 				}
-			case InstructionType::JumpTrue:
+			VM_CASE(JumpTrue):
 				{
 					const auto& temp= vmstack_peek(m_Stack);
 					if (temp.m_Type != ValueType::Null)
 					{
 						if (temp.m_IntValue != 0)
 						{
-							iptr = in.m_Value - 1;
+							iptr = in->m_Value - 1;
 						}
 					}
 					vmstack_pop(m_Stack);
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::JumpTruePeek:
+			VM_CASE(JumpTruePeek):
 				{
 					const auto& temp = vmstack_peek(m_Stack);
 					if (temp.m_Type != ValueType::Null)
 					{
 						if (temp.m_IntValue != 0)
 						{
-							iptr = in.m_Value - 1;
+							iptr = in->m_Value - 1;
 						}
 					}
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::JumpFalse:
+			VM_CASE(JumpFalse):
 				{
 					const auto&  temp = vmstack_peek(m_Stack);
 					if (temp.m_Type != ValueType::Null)
 					{
 						if (temp.m_IntValue == 0)
 						{
-							iptr = in.m_Value - 1;
+							iptr = in->m_Value - 1;
 						}
 					}
 					else
 					{
-						iptr = in.m_Value - 1;
+						iptr = in->m_Value - 1;
 					}
 					vmstack_pop(m_Stack);
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::JumpFalsePeek:
+			VM_CASE(JumpFalsePeek):
 				{
 					const auto& temp = vmstack_peek(m_Stack);
 					if (temp.m_Type != ValueType::Null)
 					{
-						if (temp.m_RealValue == 0)
+						if (temp.m_IntValue == 0)
 						{
-							iptr = in.m_Value - 1;
+							iptr = in->m_Value - 1;
 						}
 					}
 					else
 					{
-						iptr = in.m_Value - 1;
+						iptr = in->m_Value - 1;
 					}
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Load:
+			VM_CASE(Load):
 				{
-					vmstack_push(m_Stack, (m_Variables[in.m_Value]));
-					break;
+					vmstack_push(m_Stack, (m_Variables[in->m_Value]));
+					VM_NEXT();
 				}
-			case InstructionType::Store:
+			VM_CASE(Store):
 				{
-					m_Stack.Pop(m_Variables[in.m_Value]);
-					break;
+					m_Stack.Pop(m_Variables[in->m_Value]);
+					VM_NEXT();
 				}
-			case InstructionType::LLoad:
+			VM_CASE(LLoad):
 				{
-					vmstack_push(m_Stack, (m_SP[in.m_Value]));
-					break;
+					vmstack_push(m_Stack, (m_SP[in->m_Value]));
+					VM_NEXT();
 				}
-			case InstructionType::LStore:
+			VM_CASE(LStore):
 				{
-					m_Stack.Pop(m_SP[in.m_Value]);
-					break;
+					m_Stack.Pop(m_SP[in->m_Value]);
+					VM_NEXT();
 				}
-			case InstructionType::CLoad:
+			VM_CASE(CLoad):
 				{
 					auto frame = m_CurFrame;
-					int index = in.m_Value2;
+					int index = in->m_Value2;
 					while ( index++ < 0)
 						frame = frame->m_Prev;
 
-					vmstack_push(m_Stack, (*frame->m_UpValues[in.m_Value]->m_Ptr));
-					break;
+					vmstack_push(m_Stack, (*frame->m_UpValues[in->m_Value]->m_Ptr));
+					VM_NEXT();
 				}
-			case InstructionType::CStore:
+			VM_CASE(CStore):
 				{
 					auto frame = m_CurFrame;
-					int index = in.m_Value2;
+					int index = in->m_Value2;
 					while ( index++ < 0)
 						frame = frame->m_Prev;
 
-					if (frame->m_Mark)
+					auto capture = frame->m_UpValues[in->m_Value];
+					if (capture->m_Closed)
 					{
-						frame->m_Mark = false;
-						m_GC.m_Greys.Push(frame);
-					}
-
-					if (frame->m_UpValues[in.m_Value]->m_Closed)
-					{
-						frame->m_UpValues[in.m_Value]->m_Value = m_Stack.Pop();
+						capture->m_Value = m_Stack.Pop();
+						m_GC.Barrier(capture);
 					}
 					else
 					{
-						m_Stack.Pop(*frame->m_UpValues[in.m_Value]->m_Ptr);
+						m_Stack.Pop(*capture->m_Ptr);
 					}
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::LoadFunction:
+			VM_CASE(LoadFunction):
 				{
 					//construct a new closure with the right number of upvalues
 					//from the Func* object
-					Closure* closure = new Closure;
+					Function* proto = m_CurFrame->m_Prototype->m_Prototypes[in->m_Value];
+					Closure* closure = m_GC.New<Closure>();
 					closure->m_Grey = closure->m_Mark = false;
 					closure->m_Prev = m_CurFrame;
 					closure->m_RefCount = 0;
 					closure->m_Generator = 0;
-					closure->m_UpValueCount = in.m_Function->m_UpValues;
-					if (in.m_Function->m_UpValues)
+					closure->m_UpValueCount = proto->m_UpValues;
+					if (proto->m_UpValues)
 					{
-						closure->m_UpValues = new Capture*[in.m_Function->m_UpValues];
+						closure->m_UpValues = new Capture*[proto->m_UpValues];
 						//#ifdef _DEBUG
-						for (unsigned int i = 0; i < in.m_Function->m_UpValues; i++)
+						for (unsigned int i = 0; i < proto->m_UpValues; i++)
 							closure->m_UpValues[i] = 0;//this is done for the GC
 						//#endif
 						this->m_LastAdded = closure;
 					}
 
-					closure->m_Prototype = in.m_Function;
+					closure->m_Prototype = proto;
 					closure->m_Type = ValueType::Function;
-					m_GC.AddObject((GarbageCollector::gcval*)closure);
 					vmstack_push(m_Stack, Value(closure));
 
 					if (m_GC.m_AllocationCounter++%GC_INTERVAL == 0)
-						this->RunGC();
+						this->m_GC.Step();
 
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::CInit:
+			VM_CASE(CInit):
 				{
 					//allocate and add new upvalue
 					auto frame = m_LastAdded;
@@ -1189,18 +1846,14 @@ Value JetContext::Execute(int iptr, Closure* frame)
 					bool found = false;
 					for (auto& ii: m_OpenCaptures)
 					{
-						if (ii.capture->m_Ptr == &m_SP[in.m_Value])
+						if (ii.capture->m_Ptr == &m_SP[in->m_Value])
 						{
 							//we found it
-							frame->m_UpValues[in.m_Value2] = ii.capture;
+							frame->m_UpValues[in->m_Value2] = ii.capture;
 							found = true;
 							//m_OutputFunction("Reused Capture %d %s in %s\n", in.value2, sptr[in.value].ToString().c_str(), curframe->prototype->name.c_str());
 
-							if (frame->m_Mark)
-							{
-								frame->m_Mark = false;
-								m_GC.m_Greys.Push(frame);
-							}
+							m_GC.Barrier(frame);
 							break;
 						}
 					}
@@ -1213,12 +1866,12 @@ Value JetContext::Execute(int iptr, Closure* frame)
 						capture->m_Grey = capture->m_Mark = false;
 						capture->m_RefCount = 0;
 						capture->m_Type = ValueType::Capture;
-						capture->m_Ptr = &m_SP[in.m_Value];
+						capture->m_Ptr = &m_SP[in->m_Value];
 #ifdef _DEBUG
 						capture->m_UseCount = 1;
 						capture->m_Owner = frame;
 #endif
-						frame->m_UpValues[in.m_Value2] = capture;
+						frame->m_UpValues[in->m_Value2] = capture;
 
 						OpenCapture c;
 						c.capture = capture;
@@ -1228,323 +1881,530 @@ Value JetContext::Execute(int iptr, Closure* frame)
 						//m_OutputFunction("Initalized Capture %d %s in %s\n", in.value2, sptr[in.value].ToString().c_str(), curframe->prototype->name.c_str());
 						this->m_OpenCaptures.push_back(c);
 
-						if (frame->m_Mark)
-						{
-							frame->m_Mark = false;
-							m_GC.m_Greys.Push(frame);
-						}
+						m_GC.Barrier(frame);
 
 						if (m_GC.m_AllocationCounter++%GC_INTERVAL == 0)
-							this->RunGC();
+							this->m_GC.Step();
 					}
 
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Close:
+			VM_CASE(Close):
 				{
-					//remove from the back
-					while (m_OpenCaptures.size() > 0)
-					{
-						auto cur = m_OpenCaptures.back();
-						int index = (int)(cur.capture->m_Ptr - m_SP);
-						if (index < in.m_Value)
-							break;
-
-#ifdef _DEBUG
-						//this just verifies that the break above works right
-						if (cur.creator != this->m_CurFrame)
-							throw RuntimeException("RUNTIME ERROR: Tried to close capture in wrong scope!");
-#endif
+					this->CloseCaptures(in->m_Value);
 
-						cur.capture->m_Closed = true;
-						cur.capture->m_Value = *cur.capture->m_Ptr;
-						cur.capture->m_Ptr = &cur.capture->m_Value;
-						//m_OutputFunction("Closed capture with value %s\n", cur->value.ToString().c_str());
-						//m_OutputFunction("Closed capture %d in %d as %s\n", i, cur, cur->upvals[i]->v->ToString().c_str());
-
-						//do a write barrier
-						if (cur.capture->m_Value.m_Type > ValueType::NativeFunction && cur.capture->m_Value.m_Object->m_Grey == false)
-						{
-							cur.capture->m_Value.m_Object->m_Grey = true;
-							this->m_GC.m_Greys.Push(cur.capture->m_Value);
-						}
-						m_OpenCaptures.pop_back();
-					}
-
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Call:
+			VM_CASE(Call):
 				{
-					iptr = (int)this->Call(&m_Variables[in.m_Value], iptr, in.m_Value2);
-					break;
+					VM_CALL(&m_Variables[in->m_Value], in->m_Value2);
+					VM_NEXT();
 				}
-			case InstructionType::ECall:
+			VM_CASE(ECall):
 				{
 					//allocate capture area here
 					Value one;
 					m_Stack.Pop(one);
-					iptr = (int)this->Call(&one, iptr, in.m_Value);
-					break;
+					VM_CALL(&one, in->m_Value);
+					VM_NEXT();
+				}
+			VM_CASE(TailCall):
+				{
+					VM_TAILCALL(&m_Variables[in->m_Value], in->m_Value2);
+					VM_NEXT();
+				}
+			VM_CASE(TailECall):
+				{
+					Value one;
+					m_Stack.Pop(one);
+					VM_TAILCALL(&one, in->m_Value);
+					VM_NEXT();
 				}
-			case InstructionType::Return:
+			VM_CASE(Return):
 				{
-					auto& oframe = vmstack_peek(m_CallStack);
-					iptr = oframe.first;
 					if (m_CurFrame && m_CurFrame->m_Generator)
 						m_CurFrame->m_Generator->Kill();
 
-					if (oframe.first != JET_BAD_INSTRUCTION)
-					{
 #ifdef _DEBUG
-						//this makes sure that the m_GC doesnt overrun its boundaries
-						for (int i = 0; i < (int)oframe.second->m_Prototype->m_Locals; i++)
-						{
-							//need to mark stack with garbage values for error checking
-							m_SP[i].m_Type = ValueType::Object;
-							m_SP[i].m_Object = (JetObject*)0xcdcdcdcd;
-						}
+					Value* fsp = m_SP;
+					int flocals = (int)m_CurFrame->m_Prototype->m_Locals;
 #endif
-						m_SP -= oframe.second->m_Prototype->m_Locals;
+					//the result takes the place of the frame, where the caller pushed the arguments
+					iptr = (int)this->LeaveFrame();
+#ifdef _DEBUG
+					//this makes sure that the m_GC doesnt overrun its boundaries
+					for (int i = 1; i < flocals; i++)
+					{
+						//need to mark stack with garbage values for error checking
+						fsp[i].m_Type = ValueType::Object;
+						fsp[i].m_Object = (JetObject*)0xcdcdcdcd;
 					}
-					//m_OutputFunction("Return: Stack Ptr At: %d\n", sptr - localstack);
-					m_CurFrame = oframe.second;
-					vmstack_pop(m_CallStack);
-					break;
+#endif
+
+					//returned past the frame pushed on entry, we are done
+					if (m_CurFrame == nullptr)
+						goto vm_exit;
+					VM_FRAME();
+					VM_JIT();
+					VM_NEXT();
 				}
-			case InstructionType::Yield:
+			VM_CASE(Yield):
 				{
 					if (m_CurFrame->m_Generator)
 						m_CurFrame->m_Generator->Yield(this, iptr);
 					else
 						throw RuntimeException("Cannot Yield from outside a generator");
 
-					auto oframe = m_CallStack.Pop();
-					iptr = oframe.first;
-					m_CurFrame = oframe.second;
-					if (oframe.second)
-						m_SP -= oframe.second->m_Prototype->m_Locals;
-
-					break;
+					//the yielded value is returned like a result
+					iptr = (int)this->LeaveFrame();
+					if (m_CurFrame == nullptr)
+						goto vm_exit;
+					VM_FRAME();
+					VM_NEXT();
 				}
-			case InstructionType::Resume:
+			VM_CASE(Resume):
 				{
 					//resume last item placed on stack
 					Value v = this->m_Stack.Pop();
 					if (v.m_Type != ValueType::Function || v.m_Function->m_Generator == 0)
 						throw RuntimeException("Cannot resume a non generator!");
 
-					vmstack_push(m_CallStack,(std::pair<unsigned int, Closure*>(iptr, m_CurFrame)));
-
-					m_SP += m_CurFrame->m_Prototype->m_Locals;
-
-					if ((m_SP - m_LocalStack) >= JET_STACK_SIZE)
-						throw RuntimeException("Stack Overflow!");
+					m_CallStack.Reserve(1);
+					vmstack_push(m_CallStack, CallFrame(iptr, m_CurFrame, m_SP));
 
 					m_CurFrame = v.m_Function;
 
-					iptr = v.m_Function->m_Generator->Resume(this)-1;
+					//resume passes nothing to the yield
+					m_Stack.Push(Value::Empty);
 
-					break;
+					iptr = v.m_Function->m_Generator->Resume(this)-1;
+					VM_FRAME();
+					VM_NEXT();
 				}
-			case InstructionType::Dup:
+			VM_CASE(Dup):
 				{
 					vmstack_push_top(m_Stack);
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::Pop:
+			VM_CASE(Pop):
 				{
 					vmstack_pop(m_Stack);
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::StoreAt:
+			VM_CASE(StoreAt):
 				{
-					if (in.m_String)
+					if (in->m_Value >= 0)
 					{
-						Value& loc = vmstack_peek(m_Stack);
-						Value& val = vmstack_peekn(m_Stack,2);
-
-						if (loc.m_Type == ValueType::Object)
-							(*loc.m_Object)[in.m_String] = val;
-						else
-							throw RuntimeException("Could not index a non array/object value!");
+						this->StoreField(vmstack_peek(m_Stack), constants[in->m_Value].m_String, vmstack_peekn(m_Stack,2), VM_CACHE());
 						vmstack_popn(m_Stack,2);
-						//this may be redundant and already done in object
-						//check me
-						if (loc.m_Object->m_Mark)
-						{
-							//reset to grey and push back for reprocessing
-							loc.m_Object->m_Mark = false;
-							m_GC.m_Greys.Push(loc);//push to grey stack
-						}
-						//write barrier
+					}
+					else if (this->StoreIndex(vmstack_peekn(m_Stack,2), vmstack_peekn(m_Stack,1), vmstack_peekn(m_Stack,3)) && in->m_Value3)
+					{
+						//the copy of a shared string goes back where it came from, past the jump
+						vmstack_peekn(m_Stack,3) = vmstack_peekn(m_Stack,2);
+						vmstack_popn(m_Stack, 2);
+						iptr++;
 					}
 					else
 					{
-						Value& index = vmstack_peekn(m_Stack,1);
-						Value& loc = vmstack_peekn(m_Stack,2);
-						Value& val = vmstack_peekn(m_Stack,3);	
-
-						if (loc.m_Type == ValueType::Array)
-						{
-							int in = (int)index;
-							if (in >= (int)loc.m_Array->m_Data.size() || in < 0)
-								throw RuntimeException("Array index out of range!");
-							loc.m_Array->m_Data[in] = val;
-
-							//write barrier
-							if (loc.m_Array->m_Mark)
-							{
-								//reset to grey and push back for reprocessing
-								//m_OutputFunction("write barrier triggered!\n");
-								loc.m_Array->m_Mark = false;
-								m_GC.m_Greys.Push(loc);//push to grey stack
-							}
-						}
-						else if (loc.m_Type == ValueType::Object)
-						{
-							(*loc.m_Object)[index] = val;
-
-							//write barrier
-							//this may be redundant, lets check
-							//its also done in the object object
-							if (loc.m_Object->m_Mark)
-							{
-								//reset to grey and push back for reprocessing
-								//m_OutputFunction("write barrier triggered!\n");
-								loc.m_Object->m_Mark = false;
-								m_GC.m_Greys.Push(loc);//push to grey stack
-							}
-						}
-						else if (loc.m_Type == ValueType::String)
-						{
-							int in = (int)index;
-							if (in >= (int)loc.m_Length || in < 0)
-								throw RuntimeException("String index out of range!");
-
-							loc.m_String->m_Data[in] = (int)val;
-						}
-						else
-						{
-							throw RuntimeException("Could not index a non array/object value!");
-						}
+						//otherwise the jump and the stores after it are skipped
 						vmstack_popn(m_Stack, 3);
+						iptr += in->m_Value3;
 					}
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::LoadAt:
+			VM_CASE(LoadAt):
 				{
-					if (in.m_String)
+					if (in->m_Value >= 0)
 					{
-						Value loc;
-						m_Stack.Pop(loc);
-						if (loc.m_Type == ValueType::Object)
-						{
-							auto n = loc.m_Object->findNode(in.m_String);
-							if (n)
-							{
-								vmstack_push(m_Stack, n->second);
-							}
-							else
-							{
-								auto obj = loc.m_Object->m_Prototype;
-								while (obj)
-								{
-									n = obj->findNode(in.m_String);
-									if (n)
-									{
-										vmstack_push(m_Stack, n->second);
-										break;
-									}
-									obj = obj->m_Prototype;
-								}
-							}
-						}
-						else if (loc.m_Type == ValueType::String)
-							vmstack_push(m_Stack, ((*this->m_StringPrototype)[in.m_String]));
-						else if (loc.m_Type == ValueType::Array)
-							vmstack_push(m_Stack, ((*this->m_ArrayPrototype)[in.m_String]));
-						else if (loc.m_Type == ValueType::Userdata)
-							vmstack_push(m_Stack, ((*loc.m_UserData->m_Prototype)[in.m_String]));
-						else if (loc.m_Type == ValueType::Function && loc.m_Function->m_Prototype->m_Generator)
-							vmstack_push(m_Stack, ((*this->m_FunctionPrototype)[in.m_String]));
-						else
-							throw RuntimeException("Could not index a non array/object value!");
+						JetString* name = constants[in->m_Value].m_String;
+						Value& loc = vmstack_peek(m_Stack);
+						loc = this->LoadMember(loc, name, VM_CACHE());
 					}
 					else
 					{
-						Value index = m_Stack.Pop();
-						Value loc = m_Stack.Pop();
-
-						if (loc.m_Type == ValueType::Array)
-						{
-							int in = (int)index;
-							if (in >= (int)loc.m_Array->m_Data.size() || in < 0)
-								throw RuntimeException("Array index out of range!");
-							vmstack_push(m_Stack, (loc.m_Array->m_Data[in]));
-						}
-						else if (loc.m_Type == ValueType::Object)
-							vmstack_push(m_Stack,((*loc.m_Object).get(index)));
-						else if (loc.m_Type == ValueType::String)
-						{
-							int in = (int)index;
-							if (in >= (int)loc.m_Length || in < 0)
-								throw RuntimeException("String index out of range!");
-
-							vmstack_push(m_Stack, Value(loc.m_String->m_Data[in]));
-						}
-
-						else
-							throw RuntimeException("Could not index a non array/object value!");
+						Value v = this->LoadIndex(vmstack_peekn(m_Stack,2), vmstack_peek(m_Stack));
+						vmstack_popn(m_Stack, 2);
+						vmstack_push(m_Stack, v);
 					}
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::NewArray:
+			VM_CASE(NewArray):
 				{
-					auto arr = new JetArray();//GCVal<std::vector<Value>>();
+					auto arr = m_GC.New<JetArray>();
 					arr->m_Grey = arr->m_Mark = false;
 					arr->m_RefCount = 0;
 					arr->m_Context = this;
 					arr->m_Type = ValueType::Array;
-					this->m_GC.m_Generation1.push_back((GarbageCollector::gcval*)arr);
-					arr->m_Data.resize(in.m_Value);
-					for (int i = in.m_Value - 1; i >= 0; i--)
+					arr->m_Dirty = 0;
+					arr->m_Data.resize(in->m_Value);
+					for (int i = in->m_Value - 1; i >= 0; i--)
 					{
 						m_Stack.Pop(arr->m_Data[i]);
 					}
 					vmstack_push(m_Stack,(Value(arr)));
 
 					if (m_GC.m_AllocationCounter++%GC_INTERVAL == 0)
-						this->RunGC();
+						this->m_GC.Step();
 
-					break;
+					VM_NEXT();
 				}
-			case InstructionType::NewObject:
+			VM_CASE(NewObject):
 				{
-					auto obj = new JetObject(this);
+					auto obj = m_GC.New<JetObject>(this);
 					obj->m_Grey = obj->m_Mark = false;
 					obj->m_RefCount = 0;
 					obj->m_Type = ValueType::Object;
-					this->m_GC.m_Generation1.push_back((GarbageCollector::gcval*)obj);
-					for (int i = in.m_Value-1; i >= 0; i--)
+					//insert in source order so literals with the same keys share a shape
+					for (int i = in->m_Value; i > 0; i--)
 					{
-						const auto& value = vmstack_peek(m_Stack);
-						const auto& key = vmstack_peekn(m_Stack,2);
+						const auto& value = vmstack_peekn(m_Stack,(i*2-1));
+						const auto& key = vmstack_peekn(m_Stack,(i*2));
 						(*obj)[key] = value;
-						vmstack_popn(m_Stack,2);
 					}
+					vmstack_popn(m_Stack,in->m_Value*2);
 					vmstack_push(m_Stack,Value(obj));
 
 					if (m_GC.m_AllocationCounter++%GC_INTERVAL == 0)
-						this->RunGC();
+						this->m_GC.Step();
 
-					break;
+					VM_NEXT();
+				}
+			VM_CASE(LtLocalsJumpFalse):
+				{
+					Value& a = m_SP[in->m_Value2];
+					Value& b = m_SP[in->m_Value3];
+					Value r;
+					VALUES_CMP(r, a, b, < );
+					if (r.m_IntValue == 0)
+						iptr = in->m_Value - 1;
+					VM_NEXT();
+				}
+			VM_CASE(LtLocalImmJumpFalse):
+				{
+					Value& a = m_SP[in->m_Value3];
+					Value b(in->m_Value2);
+					Value r;
+					VALUES_CMP(r, a, b, < );
+					if (r.m_IntValue == 0)
+						iptr = in->m_Value - 1;
+					VM_NEXT();
+				}
+			VM_CASE(AddLocalImm):
+				{
+					Value& a = m_SP[in->m_Value2];
+					const Value b(in->m_Value);
+					VALUES_OP(a, b, +, += );
+					VM_NEXT();
+				}
+			VM_CASE(IncrLocal):
+				{
+					VALUES_INCR_LOCAL(m_SP, in);
+					VM_NEXT();
+				}
+			VM_CASE(InvokeMethod):
+				{
+					//the receiver is already on the stack as the first argument
+					const Value& self = m_Stack._data[m_Stack._size - in->m_Value3];
+					Value fun = this->LoadMember(self, constants[in->m_Value].m_String, VM_CACHE());
+					VM_CALL(&fun, in->m_Value3);
+					VM_NEXT();
+				}
+			VM_CASE(AddR):
+				{
+					VM_REGISTER_OP(+, += );
+					VM_NEXT();
+				}
+			VM_CASE(SubR):
+				{
+					VM_REGISTER_OP(-, -= );
+					VM_NEXT();
+				}
+			VM_CASE(MulR):
+				{
+					VM_REGISTER_OP(*, *= );
+					VM_NEXT();
+				}
+			VM_CASE(DivR):
+				{
+					VM_REGISTER_OP(/, /= );
+					VM_NEXT();
+				}
+			VM_CASE(ModulusR):
+				{
+					VM_REGISTER_ASSIGN(%=);
+					VM_NEXT();
+				}
+			VM_CASE(BAndR):
+				{
+					VM_REGISTER_ASSIGN(&=);
+					VM_NEXT();
+				}
+			VM_CASE(BOrR):
+				{
+					VM_REGISTER_ASSIGN(|=);
+					VM_NEXT();
+				}
+			VM_CASE(XorR):
+				{
+					VM_REGISTER_ASSIGN(^=);
+					VM_NEXT();
+				}
+			VM_CASE(LeftShiftR):
+				{
+					VM_REGISTER_ASSIGN(<<=);
+					VM_NEXT();
+				}
+			VM_CASE(RightShiftR):
+				{
+					VM_REGISTER_ASSIGN(>>=);
+					VM_NEXT();
+				}
+			VM_CASE(EqR):
+				{
+					VM_REGISTER_CMP(== );
+					VM_NEXT();
+				}
+			VM_CASE(NotEqR):
+				{
+					VM_REGISTER_CMP(!= );
+					VM_NEXT();
+				}
+			VM_CASE(LtR):
+				{
+					VM_REGISTER_CMP(< );
+					VM_NEXT();
+				}
+			VM_CASE(GtR):
+				{
+					VM_REGISTER_CMP(> );
+					VM_NEXT();
+				}
+			VM_CASE(LtER):
+				{
+					VM_REGISTER_CMP(<= );
+					VM_NEXT();
+				}
+			VM_CASE(GtER):
+				{
+					VM_REGISTER_CMP(>= );
+					VM_NEXT();
+				}
+			VM_CASE(AddIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(Add);
+					a.m_IntValue += b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(AddRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(Add);
+					a.m_RealValue += b.m_RealValue;
+					--m_Stack._size;
+					VM_NEXT();
 				}
-			default:
+			VM_CASE(SubIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(Sub);
+					a.m_IntValue -= b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(SubRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(Sub);
+					a.m_RealValue -= b.m_RealValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(MulIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(Mul);
+					a.m_IntValue *= b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(MulRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(Mul);
+					a.m_RealValue *= b.m_RealValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(DivIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(Div);
+					a.m_IntValue /= b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(DivRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(Div);
+					a.m_RealValue /= b.m_RealValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(LtIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(Lt);
+					a.m_IntValue = a.m_IntValue < b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(LtRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(Lt);
+					a.m_IntValue = a.m_RealValue < b.m_RealValue;
+					a.m_Type = ValueType::Int;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(GtIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(Gt);
+					a.m_IntValue = a.m_IntValue > b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(GtRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(Gt);
+					a.m_IntValue = a.m_RealValue > b.m_RealValue;
+					a.m_Type = ValueType::Int;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(LtEIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(LtE);
+					a.m_IntValue = a.m_IntValue <= b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(LtERealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(LtE);
+					a.m_IntValue = a.m_RealValue <= b.m_RealValue;
+					a.m_Type = ValueType::Int;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(GtEIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(GtE);
+					a.m_IntValue = a.m_IntValue >= b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(GtERealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(GtE);
+					a.m_IntValue = a.m_RealValue >= b.m_RealValue;
+					a.m_Type = ValueType::Int;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(EqIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(Eq);
+					a.m_IntValue = a.m_IntValue == b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(EqRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(Eq);
+					a.m_IntValue = a.m_RealValue == b.m_RealValue;
+					a.m_Type = ValueType::Int;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(NotEqIntInt):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Int || b.m_Type != ValueType::Int)
+						VM_DEOPTIMIZE(NotEq);
+					a.m_IntValue = a.m_IntValue != b.m_IntValue;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_CASE(NotEqRealReal):
+				{
+					const Value& b = vmstack_peek(m_Stack);
+					Value& a = m_Stack._data[m_Stack._size - 2];
+					if (a.m_Type != ValueType::Real || b.m_Type != ValueType::Real)
+						VM_DEOPTIMIZE(NotEq);
+					a.m_IntValue = a.m_RealValue != b.m_RealValue;
+					a.m_Type = ValueType::Int;
+					--m_Stack._size;
+					VM_NEXT();
+				}
+			VM_DEFAULT:
 				throw RuntimeException("Unimplemented Instruction!");
-			}
 
+			}
+#ifndef JET_THREADED_DISPATCH
 			iptr++;
+#endif
 		}
+vm_exit:;
 	}
 	catch(RuntimeException e)
 	{
@@ -1639,7 +2499,7 @@ Value JetContext::Execute(int iptr, Closure* frame)
 	//debug checks for stack and what not
 	if (this->m_CallStack.size() == 0)
 	{
-		if (this->m_SP != this->m_LocalStack)
+		if (this->m_SP != this->m_Stack._data)
 			throw RuntimeException("FATAL ERROR: Local stack did not properly reset");
 	}
 
@@ -1654,6 +2514,21 @@ Value JetContext::Execute(int iptr, Closure* frame)
 	return m_Stack.Pop();
 }
 
+#undef VM_FRAME
+#undef VM_CACHE
+#undef VM_REGISTER_ASSIGN
+#undef VM_REGISTER_OP
+#undef VM_REGISTER_CMP
+#undef VM_REDISPATCH
+#undef VM_QUICKEN
+#undef VM_DEOPTIMIZE
+#undef VM_CALL
+#undef VM_TAILCALL
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+
 void JetContext::GetCode(int ptr, Closure* closure, std::string& ret, unsigned int& line)
 {
 	if (closure->m_Prototype->debuginfo.size() == 0)//make sure we have debug info
@@ -1694,24 +2569,23 @@ void JetContext::GetCode(int ptr, Closure* closure, std::string& ret, unsigned i
 
 void JetContext::StackTrace(int curiptr, Closure* cframe)
 {
-	auto tempcallstack = this->m_CallStack.Copy();
-	if (m_CurFrame)
-		tempcallstack.Push(std::pair<unsigned int, Closure*>(curiptr,cframe));
-
-	while(tempcallstack.size() > 0)
+	//walk the call stack in place, innermost frame first
+	int i = (int)this->m_CallStack.size();
+	if (m_CurFrame == 0)
+		i--;
+	for (; i >= 0; i--)
 	{
-		auto top = tempcallstack.Pop();
-		int greatest = -1;
+		CallFrame top = i < (int)this->m_CallStack.size() ? this->m_CallStack._data[i] : CallFrame(curiptr, cframe, m_SP);
 
-		if (top.first == JET_BAD_INSTRUCTION)
+		if (top.m_IPtr == JET_BAD_INSTRUCTION)
 			m_OutputFunction("{Native}\n");
 		else
 		{
-			std::string fun = top.second->m_Prototype->m_Name;
+			std::string fun = top.m_Closure->m_Prototype->m_Name;
 			std::string file;
 			unsigned int line;
-			this->GetCode(top.first, top.second, file, line);
-			m_OutputFunction("%s() %s Line %d (Instruction %d)\n", fun.c_str(), file.c_str(), line, top.first);
+			this->GetCode(top.m_IPtr, top.m_Closure, file, line);
+			m_OutputFunction("%s() %s Line %d (Instruction %d)\n", fun.c_str(), file.c_str(), line, top.m_IPtr);
 		}
 	}
 }
@@ -1744,6 +2618,9 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 				Function* func = new Function;
 				func->m_Args = inst.a;
 				func->m_Locals = inst.b;
+				func->m_MaxStack = 0;
+				func->m_Hotness = JET_JIT_THRESHOLD;
+				func->m_Jit = nullptr;
 				func->m_UpValues = inst.c;
 				func->m_Name = inst.string;
 				func->m_Context = this;
@@ -1785,6 +2662,45 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 		}
 	}
 
+	//every function must end with a Return, Execute relies on it instead of bounds checking
+	bool trailinglabel = false;
+	auto terminate = [&trailinglabel](Function* func)
+	{
+		if (func && (trailinglabel || func->m_Instructions.empty() || func->m_Instructions.back().m_Instruction != InstructionType::Return))
+		{
+			Instruction ins;
+			ins.m_Instruction = InstructionType::LdNull;
+			ins.m_Value = 0;
+			ins.m_Value2 = 0;
+			ins.m_Value3 = 0;
+			func->m_Instructions.push_back(ins);
+			ins.m_Instruction = InstructionType::Return;
+			func->m_Instructions.push_back(ins);
+		}
+		//every instruction pushes at most one value, one more for the value a call or resume leaves
+		if (func)
+			func->m_MaxStack = (unsigned int)func->m_Instructions.size() + 1;
+		trailinglabel = false;
+	};
+
+	//gives a named property access its own inline cache, -1 if the function has too many
+	auto newcache = [](Function* func) -> short
+	{
+		if (func->m_Caches.size() >= SHRT_MAX)
+			return -1;
+		func->m_Caches.push_back(InlineCache());
+		return (short)(func->m_Caches.size() - 1);
+	};
+	//string constants are interned and live as long as the context, takes over the text
+	auto newstring = [this](Function* func, char* string) -> int
+	{
+		JetString* str = this->Intern(string);
+		delete[] string;
+		this->PinString(str);
+		func->m_Constants.push_back(Value(str));
+		return (int)func->m_Constants.size() - 1;
+	};
+
 	Function* current = 0;
 	for (auto inst: code)
 	{
@@ -1804,6 +2720,7 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 			}
 		case InstructionType::Label:
 			{
+				trailinglabel = true;
 				break;
 			}
 		case InstructionType::DebugLine:
@@ -1820,22 +2737,26 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 			}
 		case InstructionType::Function:
 			{
+				terminate(current);
 				current = this->m_Functions[inst.string];
 				delete[] inst.string;
 				break;
 			}
 		default:
 			{
+				trailinglabel = false;
 				Instruction ins;
 				ins.m_Instruction = inst.type;
-				ins.m_String = inst.string;
 				ins.m_Value = inst.first;
-				if (inst.string == 0 || inst.type == InstructionType::Call)
-					ins.m_Value2 = (int)inst.second;
+				ins.m_Value2 = 0;
+				ins.m_Value3 = 0;
+				if (inst.string == 0 || inst.type == InstructionType::Call || inst.type == InstructionType::TailCall)
+					ins.m_Value2 = (short)inst.second;
 
 				switch (inst.type)
 				{
 				case InstructionType::Call:
+				case InstructionType::TailCall:
 				case InstructionType::Store:
 				case InstructionType::Load:
 					{
@@ -1844,6 +2765,7 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 							//ȫֱ
 							m_VariableIndex[inst.string] = (unsigned int)m_VariableIndex.size();
 							m_Variables.push_back(Value::Empty);
+							m_VariablesData = m_Variables.data();
 						}
 						ins.m_Value = m_VariableIndex[inst.string];
 						delete[] inst.string;
@@ -1851,24 +2773,96 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 					}
 				case InstructionType::LdStr:
 					{
-						Value str = this->CreateNewString(inst.string, false);
-						str.AddRef();
-						ins.m_StringLiteral  = str.m_String;
+						ins.m_Value = newstring(current, inst.string);
 						break;
 					}
 				case InstructionType::LdInt:
 				{
-					ins.m_IntValue = inst.int_second;
+					ins.m_Value = (int)current->m_Constants.size();
+					current->m_Constants.push_back(Value(inst.int_second));
 					break;
 				}
 				case InstructionType::LdReal:
 					{
-						ins.m_RealValue = inst.second;
+						ins.m_Value = (int)current->m_Constants.size();
+						current->m_Constants.push_back(Value(inst.second));
+						break;
+					}
+				case InstructionType::LoadAt:
+				case InstructionType::StoreAt:
+					{
+						//named index, the name lives in the constant table
+						if (inst.string)
+						{
+							ins.m_Value = newstring(current, inst.string);
+							ins.m_Value2 = newcache(current);
+						}
+						else
+						{
+							//StoreAt: the instructions that store a copied string back
+							ins.m_Value = -1;
+							ins.m_Value3 = (unsigned char)inst.first;
+						}
+						break;
+					}
+				case InstructionType::InvokeMethod:
+					{
+						ins.m_Value = newstring(current, inst.string);
+						ins.m_Value2 = newcache(current);
+						ins.m_Value3 = (unsigned char)inst.first;
+						break;
+					}
+				case InstructionType::LtLocalsJumpFalse:
+				case InstructionType::LtLocalImmJumpFalse:
+					{
+						if (labels.find(inst.string) == labels.end())
+							throw RuntimeException("Label '" + (std::string)inst.string + "' does not exist!");
+						ins.m_Value = labels[inst.string];
+						ins.m_Value2 = (short)inst.first;
+						ins.m_Value3 = (unsigned char)inst.second;
+						delete[] inst.string;
+						break;
+					}
+				case InstructionType::AddR:
+				case InstructionType::SubR:
+				case InstructionType::MulR:
+				case InstructionType::DivR:
+				case InstructionType::ModulusR:
+				case InstructionType::BAndR:
+				case InstructionType::BOrR:
+				case InstructionType::XorR:
+				case InstructionType::LeftShiftR:
+				case InstructionType::RightShiftR:
+				case InstructionType::EqR:
+				case InstructionType::NotEqR:
+				case InstructionType::LtR:
+				case InstructionType::GtR:
+				case InstructionType::LtER:
+				case InstructionType::GtER:
+					{
+						//see CompilerContext::RegisterOperation for the operand packing
+						ins.m_Value3 = (unsigned char)(inst.first & 0xFF);
+						ins.m_Value2 = (short)((inst.first >> 8) & 0xFF);
+						switch (inst.first >> 16)
+						{
+						case 0:
+							ins.m_Value = (int)inst.int_second;
+							break;
+						case 1:
+							ins.m_Value = ~(int)current->m_Constants.size();
+							current->m_Constants.push_back(Value(inst.int_second));
+							break;
+						default:
+							ins.m_Value = ~(int)current->m_Constants.size();
+							current->m_Constants.push_back(Value(inst.second));
+							break;
+						}
 						break;
 					}
 				case InstructionType::LoadFunction:
 					{
-						ins.m_Function = m_Functions[inst.string];
+						ins.m_Value = (int)current->m_Prototypes.size();
+						current->m_Prototypes.push_back(m_Functions[inst.string]);
 						delete[] inst.string;
 						break;
 					}
@@ -1881,6 +2875,7 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 						if (labels.find(inst.string) == labels.end())
 							throw RuntimeException("Label '" + (std::string)inst.string + "' does not exist!");
 						ins.m_Value = labels[inst.string];
+						delete[] inst.string;
 						break;
 					}
 				case InstructionType::ForEach:
@@ -1890,19 +2885,23 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 						ins.m_Value = labels[inst.string];
 						if (labels.find(inst.string2) == labels.end())
 							throw RuntimeException("Label '" + (std::string)inst.string2 + "' does not exist!");
-						ins.m_Value2 = labels[inst.string2];
+						ins.m_Value2 = (short)labels[inst.string2];
 
 						delete[] inst.string;
 						delete[] inst.string2;
 						break;
 					}
+				default:
+					//the other instructions take their operands as they are
+					break;
 				}
 				current->m_Instructions.push_back(ins);
 			}
 		}
 	}
+	terminate(current);
 
-	auto frame = new Closure;
+	auto frame = m_GC.New<Closure>();
 	frame->m_Grey = frame->m_Mark = false;
 	frame->m_RefCount = 0;
 	frame->m_Prev = 0;
@@ -1912,7 +2911,6 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 	frame->m_Type = ValueType::Function;
 	frame->m_UpValues = 0;
 
-	m_GC.AddObject((GarbageCollector::gcval*)frame);
 
 #ifdef JET_TIME_EXECUTION
 	QueryPerformanceCounter( (LARGE_INTEGER *)&end );
@@ -1944,34 +2942,18 @@ Value JetContext::Call(const Value* fun, Value* args, unsigned int numargs)
 
 		return this->m_Stack.Pop();
 	}
-	else if (fun->m_Function->m_Generator)
-	{
-		if (m_CurFrame)
-			m_SP += m_CurFrame->m_Prototype->m_Locals;
-
-		if ((m_SP - m_LocalStack) >= JET_STACK_SIZE)
-			throw RuntimeException("Stack Overflow!");
-
-		m_CurFrame = fun->m_Function;
-
-		if (numargs == 0)
-			m_Stack.Push(Value::Empty);
-		else if (numargs >= 1)
-			m_Stack.Push(args[0]);
-		int iptr = fun->m_Function->m_Generator->Resume(this);
-
-		return this->Execute(iptr, fun->m_Function);
-	}
-
-	if (fun->m_Function->m_Prototype->m_Generator)
+	else if (fun->m_Function->m_Generator == 0 && fun->m_Function->m_Prototype->m_Generator)
 	{
 		//create generator and return it
-		Closure* closure = new Closure;
+		Closure* closure = m_GC.New<Closure>();
 		closure->m_Grey = closure->m_Mark = false;
 		closure->m_RefCount = 0;
 
 		closure->m_Prev = fun->m_Function->m_Prev;
 		closure->m_UpValueCount = fun->m_Function->m_UpValueCount;
+		m_Stack.Reserve(numargs);
+		for (unsigned int i = 0; i < numargs; i++)
+			this->m_Stack.Push(args[i]);
 		closure->m_Generator = new Generator(fun->m_Function->m_Prototype->m_Context, fun->m_Function, numargs);
 		if (closure->m_UpValueCount)
 		{
@@ -1980,67 +2962,61 @@ Value JetContext::Call(const Value* fun, Value* args, unsigned int numargs)
 		}
 		closure->m_Prototype = fun->m_Function->m_Prototype;
 		closure->m_Type = ValueType::Function;
-		this->m_GC.AddObject((GarbageCollector::gcval*)closure);
 
 		return Value(closure);
 	}
 
-	bool pushed = false;
-	if (this->m_CurFrame)
+	//the frame of the function that called into us (if any) stays on the call stack for the m_GC
+	//and stack traces, the new frame starts at the top of the stack
+	Closure* frame = m_CurFrame;
+	Value* sp = m_SP;
+	if (frame)
 	{
-		//need to advance stack pointer
-		m_SP += m_CurFrame->m_Prototype->m_Locals;
-		pushed = true;
-		this->m_CallStack.Push(std::pair<unsigned int, Closure*>(0, m_CurFrame));
+		m_CallStack.Reserve(1);
+		m_CallStack.Push(CallFrame(0, frame, sp));
 	}
 
-	//clear stack values for the m_GC
-	for (unsigned int i = 0; i < fun->m_Function->m_Prototype->m_Locals; i++)
-		m_SP[i] = Value::Empty;
-
-	//push args onto stack
-	for (unsigned int i = 0; i < numargs; i++)
-		this->m_Stack.Push(args[i]);
-
-	auto func = fun->m_Function;
-	if (numargs <= func->m_Prototype->m_Args)
+	Value ret;
+	try
 	{
-		for (int i = (int)func->m_Prototype->m_Args - 1; i >= 0; i--)
+		if (fun->m_Function->m_Generator)
 		{
-			if (i < (int)numargs)
-				m_Stack.Pop(m_SP[i]);
+			m_Stack.Reserve(1);
+			m_CurFrame = fun->m_Function;
+			m_Stack.Push(numargs == 0 ? Value::Empty : args[0]);
+			int iptr = fun->m_Function->m_Generator->Resume(this);
+
+			ret = this->Execute(iptr, fun->m_Function);
 		}
-	}
-	else if (func->m_Prototype->m_VarArg)
-	{
-		m_SP[func->m_Prototype->m_Locals-1] = this->CreateNewArray();
-		auto arr = &m_SP[func->m_Prototype->m_Locals-1].m_Array->m_Data;
-		arr->resize(numargs - func->m_Prototype->m_Args);
-		for (int i = (int)numargs - 1; i >= 0; i--)
+		else
 		{
-			if (i < (int)func->m_Prototype->m_Args)
-				m_Stack.Pop(m_SP[i]);
-			else
-				m_Stack.Pop((*arr)[i]);
+			//push args onto stack, they become the first locals
+			m_Stack.Reserve(numargs);
+			for (unsigned int i = 0; i < numargs; i++)
+				this->m_Stack.Push(args[i]);
+			this->EnterFrame(fun->m_Function, numargs);
+
+			ret = this->Execute(0, fun->m_Function);
 		}
 	}
-	else
+	catch (...)
 	{
-		for (int i = (int)numargs-1; i >= 0; i--)
-		{
-			if (i < (int)func->m_Prototype->m_Args)
-				m_Stack.Pop(m_SP[i]);
-			else
-				m_Stack.QuickPop();
-		}
+		m_CurFrame = frame;
+		m_SP = sp;
+		if (frame)
+			m_CallStack.QuickPop();
+		throw;
 	}
 
-	Value ret = this->Execute(0, fun->m_Function);
-
-	if (pushed)
-	{
-		m_CurFrame = this->m_CallStack.Pop().second;//restore
-		m_SP -= m_CurFrame->m_Prototype->m_Locals;
+	m_CurFrame = frame;
+	m_SP = sp;
+	if (frame)
+		m_CallStack.QuickPop();
+	else if (m_CallStack.size() == 0)
+	{
+		//back in the host, give memory used by deep recursion back
+		m_Stack.Shrink(JET_STACK_KEEP);
+		m_CallStack.Shrink(JET_STACK_KEEP);
 	}
 	return ret;
 }
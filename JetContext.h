@@ -11,6 +11,8 @@
 #include "JetInstructions.h"
 #include "JetExceptions.h"
 #include "GarbageCollector.h"
+#include "StringTable.h"
+#include "JetJit.h"
 
 
 #ifdef _WIN32
@@ -21,11 +23,47 @@
 //GCֵ
 #define GC_INTERVAL 200	
 
-//0ڴ1ڴתֵ(0ھٴռȻתΪ1
+//ռ֮ռ
 #define GC_STEPS 4		
 
-#define JET_STACK_SIZE 1024
-#define JET_MAX_CALLDEPTH 1024
+//ϴռ1ٷֱʱŽռ඼ֻ0Сռ
+#define JET_GC_MAJOR_GROWTH 100
+
+//¶ڵ0оôռȻŽ1ڴ֮ǰͱգһռ
+#define JET_NURSERY_AGE 2
+
+//ʱÿһٴô󣬲ͣĿСβ֮GC_INTERVAL࣬ղŸϷ
+#define JET_GC_STEP_WORK (4*GC_INTERVAL)
+
+//use direct threaded dispatch (labels as values) in Execute on GCC/Clang,
+//define JET_NO_THREADED_DISPATCH to fall back to the portable switch loop
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(JET_NO_THREADED_DISPATCH)
+#define JET_THREADED_DISPATCH
+#endif
+
+//Execute rewrites arithmetic and comparisons to int/real specialised instructions
+//the first time they run, define JET_NO_QUICKENING to keep the generic ones
+//#define JET_NO_QUICKENING
+
+//locals and temporaries share one stack, its address space is reserved up front and
+//committed as it grows, these are the limits in values and in call frames
+#define JET_STACK_SIZE (1024*1024)
+#define JET_MAX_CALLDEPTH (256*1024)
+//values/frames the stacks keep committed when control returns to the host
+#define JET_STACK_KEEP 4096
+
+//concatenations at least this long become ropes that are only copied together when
+//their characters are read, shorter ones are copied right away
+#define JET_ROPE_MIN_LENGTH 64
+
+//strings created at runtime up to this long are interned, so the many short pieces
+//scripts build (keys, characters, separators) share one allocation each. It stands in
+//for keeping them inside Value, which has no room for that with JET_NAN_BOXING
+#define JET_SHORT_STRING_LENGTH 7
+
+//substrings at least this long are views into the characters of their parent, shorter
+//ones cost no more to copy than the header of a view
+#define JET_VIEW_MIN_LENGTH 32
 
 namespace Jet
 {
@@ -44,6 +82,19 @@ namespace Jet
 	//ϢĶ
 	typedef int (__cdecl *OutputFunction) (const char* format, ...);
 
+	/// <summary>
+	/// ջеһ֡صַߵıհԼߵջַ֡
+	/// </summary>
+	struct CallFrame
+	{
+		unsigned int	m_IPtr;
+		Closure*		m_Closure;
+		Value*			m_SP;
+
+		CallFrame() {}
+		CallFrame(unsigned int iptr, Closure* closure, Value* sp) : m_IPtr(iptr), m_Closure(closure), m_SP(sp) {}
+	};
+
 	/// <summary>
 	/// űִ()
 	/// </summary>
@@ -53,6 +104,7 @@ namespace Jet
 		friend struct Value;
 		friend class JetObject;
 		friend class GarbageCollector;		
+		friend class JetJit;
 	public:
 		//캯
 		JetContext();
@@ -86,6 +138,48 @@ namespace Jet
 		/// <param name="copy">Ƿݣƣֱʹòṩַ</param>
 		/// <returns>ַ</returns>
 		Value CreateNewString(const char* string, bool copy = true);
+
+		/// <summary>
+		/// ȡפַʱ
+		/// </summary>
+		/// <param name="string">ַ0β</param>
+		/// <returns>ͬΨһפַ</returns>
+		JetString* Intern(const char* string);
+
+		/// <summary>
+		/// ƴֵrightַʱתϳʱߵַ
+		/// </summary>
+		/// <param name="left">ߵַ</param>
+		/// <param name="right">ұߵֵ</param>
+		/// <returns>ƴӽ</returns>
+		Value Concat(const Value& left, const Value& right);
+
+	private:
+		//ַͷַͬһηУפ
+		JetString* AllocateString(const char* string, unsigned int length);
+		//ַJET_SHORT_STRING_LENGTHʱפַ
+		Value NewString(const char* string, unsigned int length);
+		//strдstartʼlengthַϳʱstrַͼ
+		Value Substring(JetString* str, unsigned int start, unsigned int length);
+
+	public:
+
+		/// <summary>
+		/// פһеַͬݵפַʱפַ
+		/// </summary>
+		JetString* Intern(JetString* str);
+
+		/// <summary>
+		/// ͬפַᴴַ
+		/// </summary>
+		/// <returns>פַʱؿ</returns>
+		JetString* FindString(const char* string) const;
+		JetString* FindString(JetString* str) const;
+
+		/// <summary>
+		/// ʹפַĵڴ(ڳ״ļ)
+		/// </summary>
+		void PinString(JetString* str);
 		
 		/// <summary>
 		/// һԶԭ
@@ -124,17 +218,62 @@ namespace Jet
 		Value	Call(const char* m_FunctionPrototype, Value* args = 0, unsigned int numargs = 0);
 		Value	Call(const Value* m_FunctionPrototype, Value* args = 0, unsigned int numargs = 0);
 
-		//ִһڴ
+		//ִһڴ
 		void	RunGC();
 
+		//գ䴥ÿһͣô΢룬Ǻɢಽ֮
+		//0(Ĭ)ʾÿζռ
+		unsigned int GetGCPauseTarget() const		{ return m_GC.m_PauseTarget; }
+		void	SetGCPauseTarget(unsigned int microseconds)	{ m_GC.m_PauseTarget = microseconds; }
+
+		//ռʱô̲߳бǣ1(Ĭ)ʾֻõǰ̡߳Ҫڻչе
+		unsigned int GetGCThreads() const		{ return m_GC.m_Threads; }
+		void	SetGCThreads(unsigned int threads)	{ m_GC.SetThreads(threads); }
+
 		//ȡϢ
 		OutputFunction GetOutputFunction() const		{ return m_OutputFunction; }
 		void	SetOutputFunction(OutputFunction val);
+
+		//Ĵģʽ֮ĽűѾֲϵΪַĴָ
+		bool	GetRegisterMode() const		{ return m_Compiler.RegisterMode(); }
+		void	SetRegisterMode(bool enable)	{ m_Compiler.SetRegisterMode(enable); }
+
+		//Էʵ/δд
+		uint64_t GetInlineCacheHits() const		{ return m_CacheHits; }
+		uint64_t GetInlineCacheMisses() const	{ return m_CacheMisses; }
 	private:
 		//ʼִ iptr ָ
 		Value Execute(int iptr, Closure* frame);
 		//VMڲʹõĺ
 		unsigned int Call(const Value* m_FunctionPrototype, unsigned int iptr, unsigned int args);
+		//Ϊűջ֡ջargsԭسΪǰֲ
+		void EnterFrame(Closure* closure, unsigned int args);
+		//VM_CALLĿ·պõͨű(ûпɱ)ֱӽջ֡
+		//ֻղ֮ľֲfalseCallJIT·Ҳ
+		inline bool TryEnterFrame(const Value* fun, unsigned int iptr, unsigned int args);
+		//صߣֵȡѹλãջصߵָλ
+		inline unsigned int LeaveFrame();
+		//رյǰ֡дstartʼľֲϴ򿪵Ĳ(Close/TailCall)
+		void CloseCaptures(int start);
+
+		//ƶȡԱ(LoadAt/InvokeMethod)ԭңcacheΪָ
+		Value LoadMember(const Value& loc, JetString* name, InlineCache* cache = nullptr);
+		//дԱ(StoreAt)nameΪפַ
+		void StoreMember(JetObject* obj, JetString* name, const Value& val, InlineCache* cache);
+		//дԱд(StoreAt)locǶʱ
+		inline void StoreField(const Value& loc, JetString* name, const Value& val, InlineCache* cache);
+		//±д顢ַ(LoadAt/StoreAt)
+		//д빲ַ(פַ)ʱдĸø滻loctrue
+		inline Value LoadIndex(const Value& loc, Value& index);
+		inline bool StoreIndex(Value& loc, Value& index, Value& val);
+		//±겻
+		Value LoadIndexOf(const Value& loc, Value& index);
+		bool StoreIndexOf(Value& loc, Value& index, Value& val);
+		//ԭprotoʼԭname(פַ)ԭͲڷ
+		//holderΪʱֵڵĶҲʱؿ
+		Value* FindMethod(JetObject* proto, JetString* name, JetObject** holder = nullptr);
+		//ԭ˼ԭıʱãʹȫʧЧ
+		void InvalidateMethods();
 
 		//õĺ
 		void GetCode(int ptr, Closure* closure, std::string& ret, unsigned int& line);
@@ -145,10 +284,10 @@ namespace Jet
 		//ӡջ
 		static Value Callstack(JetContext* context, Value* v, int ar);
 	private:
-		//ջ
-		VMStack<Value>								m_Stack;
+		//ջÿľֲջַ֡m_SPʱֵھֲ֮
+		VMReservedStack<Value>						m_Stack;
 		//ջ
-		VMStack<std::pair<unsigned int, Closure*> > m_CallStack;
+		VMReservedStack<CallFrame>					m_CallStack;
 
 		//
 		std::unordered_map<std::string, Function*>	m_Functions;
@@ -158,6 +297,8 @@ namespace Jet
 
 		//
 		std::vector<Value>							m_Variables;
+		//m_Variablesָ룬m_Variablesӱ£JITɵĴͨдȫֱ
+		Value*										m_VariablesData;
 
 		//
 		std::unordered_map<std::string, unsigned int> m_VariableIndex;
@@ -172,6 +313,7 @@ namespace Jet
 		JetObject*			m_ArrayIterPrototype;
 		JetObject*			m_ObjectIterPrototype;
 		JetObject*			m_FunctionPrototype;
+		JetObject*			m_StringBuilderPrototype;
 
 		//requireָĻ
 		std::map<std::string, Value> m_RequireCache;
@@ -181,6 +323,17 @@ namespace Jet
 		//ڴ
 		GarbageCollector		m_GC;
 
+		//פַַͶļ
+		StringTable				m_Strings;
+
+		//ϣӣʹĳͻ޷Ԥȹ
+		uint64_t				m_HashSeed;
+
+#ifdef JET_JIT
+		//ȵ㺯Ϊ
+		JetJit					m_Jit;
+#endif
+
 		//עᵽԭ
 		std::vector<JetObject*> m_Prototypes;
 
@@ -199,14 +352,95 @@ namespace Jet
 		//ǰհ
 		Closure*	m_CurFrame;
 
-		//ֲջָstack pointer
+		//ǰջ֡Ļַָm_Stackеǰĵһֲ
 		Value*		m_SP;
-		//ֲջڱֲ?
-		Value		m_LocalStack[JET_STACK_SIZE];
 
 		//ָ
 		OutputFunction	m_OutputFunction = printf;		
+
+		//ն״״תĸ
+		Shape*			m_RootShape;
+
+		//ͳ
+		uint64_t		m_CacheHits = 0;
+		uint64_t		m_CacheMisses = 0;
+
+		//ȫַ棬(ԭ,)ֱӳ䣬汾m_MethodVersionЧ
+		MethodCacheEntry	m_Methods[JET_METHOD_CACHE_SIZE] = {};
+		unsigned int		m_MethodVersion = 1;
+		//Ԫİ汾ԭд»߿ͷļʱ
+		uint64_t			m_MetaVersion = 1;
 	};
+
+	inline bool JetContext::TryEnterFrame(const Value* fun, unsigned int iptr, unsigned int args)
+	{
+		Closure* callee = fun->m_Type == ValueType::Function ? (Closure*)fun->m_Function : nullptr;
+		Function* proto = callee ? callee->m_Prototype : nullptr;
+		if (proto == nullptr || proto->m_Args != args || proto->m_VarArg || proto->m_Generator || callee->m_Generator)
+			return false;
+
+		unsigned int base = m_Stack._size - args;
+		m_Stack.EnsureCapacity(base + proto->m_Locals + proto->m_MaxStack);
+		m_CallStack.Reserve(1);
+		vmstack_push(m_CallStack, CallFrame(iptr, m_CurFrame, m_SP));
+		m_SP = &m_Stack._data[base];
+		for (unsigned int i = args; i < proto->m_Locals; i++)
+			m_SP[i] = Value::Empty;
+		m_Stack._size = base + proto->m_Locals;
+		m_CurFrame = callee;
+		return true;
+	}
+
+	inline unsigned int JetContext::LeaveFrame()
+	{
+		const CallFrame& oframe = vmstack_peek(m_CallStack);
+		unsigned int iptr = oframe.m_IPtr;
+		*m_SP = vmstack_peek(m_Stack);
+		m_Stack._size = (unsigned int)(m_SP - m_Stack._data) + 1;
+		m_SP = oframe.m_SP;
+		m_CurFrame = oframe.m_Closure;
+		vmstack_pop(m_CallStack);
+		return iptr;
+	}
+
+	inline void JetContext::StoreField(const Value& loc, JetString* name, const Value& val, InlineCache* cache)
+	{
+		if (loc.m_Type != ValueType::Object)
+			throw RuntimeException("Could not index a non array/object value!");
+		this->StoreMember(loc.m_Object, name, val, cache);
+
+		//д
+		m_GC.Barrier(loc);
+	}
+
+	inline Value JetContext::LoadIndex(const Value& loc, Value& index)
+	{
+		//±LoadIndexOf
+		if (loc.m_Type == ValueType::Array && index.m_Type == ValueType::Int)
+		{
+			int in = (int)index.m_IntValue;
+			if (in >= (int)loc.m_Array->m_Data.size() || in < 0)
+				throw RuntimeException("Array index out of range!");
+			return loc.m_Array->m_Data[in];
+		}
+		return this->LoadIndexOf(loc, index);
+	}
+
+	inline bool JetContext::StoreIndex(Value& loc, Value& index, Value& val)
+	{
+		if (loc.m_Type == ValueType::Array && index.m_Type == ValueType::Int)
+		{
+			int in = (int)index.m_IntValue;
+			if (in >= (int)loc.m_Array->m_Data.size() || in < 0)
+				throw RuntimeException("Array index out of range!");
+			loc.m_Array->m_Data[in] = val;
+
+			//д
+			m_GC.Barrier(loc.m_Array, in);
+			return false;
+		}
+		return this->StoreIndexOf(loc, index, val);
+	}
 }
 
 #endif
\ No newline at end of file
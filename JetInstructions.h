@@ -7,79 +7,7 @@
 namespace Jet
 {
 	// ָƣڵ
-	const static char* Instructions[] = 
-	{
-		"Add",
-		"Mul",
-		"Div",
-		"Sub",
-		"Modulus",
-
-		"Negate",
-
-		"BAnd",
-		"BOr",
-		"Xor",
-		"BNot",
-		"LeftShift",
-		"RightShift",
-
-		"Eq",
-		"NotEq",
-		"Lt",
-		"Gt",
-		"LtE",
-		"GtE",
-		"Incr",
-		"Decr",
-		"Dup",
-		"Pop",
-		"LdInt",
-		"LdReal",
-		"LdNull",
-		"LdStr",
-		"LoadFunction",
-		"Jump",
-		"JumpTrue",
-		"JumpTruePeek",
-		"JumpFalse",
-		"JumpFalsePeek",
-		"NewArray",
-		"NewObject",
-
-		"Store",
-		"Load",
-		//local vars
-		"LStore",
-		"LLoad",
-		//captured vars
-		"CStore",
-		"CLoad",
-		"CInit",
-
-		"ForEach",
-
-		//index functions
-		"LoadAt",
-		"StoreAt",
-
-		//these all work on the last value in the stack
-		"ECall",
-
-		"Call",
-		"Return",
-		"Resume",
-		"Yield",
-		"Close",
-
-		//dummy instructions for the assembler/debugging
-		"Label",
-		"Local",
-		"Global",
-		"Capture",
-		"DebugLine",
-		"Function"
-	};
+	extern const char* Instructions[];
 
 	/// <summary>
 	/// ָID
@@ -139,6 +67,39 @@ namespace Jet
 
 		Close, //closes all opened closures in a function
 
+		//Call/ECall in tail position (return f(...)), the callee reuses the current frame
+		TailCall,
+		TailECall,
+
+		//superinstructions, only produced by the peephole pass
+		LtLocalsJumpFalse,		//LLoad a; LLoad b; Lt; JumpFalse
+		LtLocalImmJumpFalse,	//LLoad a; LdInt imm; Lt; JumpFalse
+		AddLocalImm,			//LLoad x; LdInt imm; Add; LStore x
+		IncrLocal,				//LLoad x; Incr/Decr; LStore x
+		InvokeMethod,			//LLoad/Load/CLoad obj; LoadAt name; ECall n (self call)
+
+		//three-address register instructions, only produced in register mode
+		//dst = m_Value3, lhs = m_Value2, rhs = m_Value (constant ~m_Value when negative)
+		AddR, SubR, MulR, DivR, ModulusR,
+		BAndR, BOrR, XorR,
+		LeftShiftR, RightShiftR,
+		EqR, NotEqR,
+		LtR, GtR,
+		LtER, GtER,
+
+		//quickened forms of the generic instructions, Execute rewrites an instruction to one
+		//of these when both operands have the same type and back when the guard fails
+		AddIntInt, AddRealReal,
+		SubIntInt, SubRealReal,
+		MulIntInt, MulRealReal,
+		DivIntInt, DivRealReal,
+		LtIntInt, LtRealReal,
+		GtIntInt, GtRealReal,
+		LtEIntInt, LtERealReal,
+		GtEIntInt, GtERealReal,
+		EqIntInt, EqRealReal,
+		NotEqIntInt, NotEqRealReal,
+
 		//dummy instructions for the assembler/debugging
 		Label,
 		Local,
@@ -0,0 +1,1083 @@
+#include "JetContext.h"
+
+#ifdef JET_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+using namespace Jet;
+
+static_assert(sizeof(Value) == 16, "the JIT templates assume 16 byte values");
+
+namespace
+{
+	enum Reg { RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+	//condition codes, the low nibble of jcc/setcc
+	enum Cond { CondB = 0x2, CondAE = 0x3, CondE = 0x4, CondNE = 0x5, CondBE = 0x6, CondA = 0x7, CondL = 0xC, CondGE = 0xD, CondLE = 0xE, CondG = 0xF };
+	//operations of the 0x81 group
+	enum AluOp { AluAdd = 0, AluSub = 5, AluCmp = 7 };
+
+	//registers while compiled code runs
+	const int Context = RBX;	//JetContext*
+	const int Frame = R12;		//m_SP, the first local of the frame
+	const int Base = R13;		//m_Stack._data
+	const int Top = R14;		//one past the top of the stack, written back to m_Stack._size when leaving or calling out
+	const int Next = R15;		//what to return to Run
+
+	//where the type and the int/real payload are in a Value. Values are copied and types written
+	//as whole qwords (the type is padded to 8 bytes), mixing sizes would stall store forwarding
+	const int TypeOffset = 0;
+	const int PayloadOffset = 8;
+
+	struct Label
+	{
+		int m_Position = -1;
+		std::vector<size_t> m_Fixups;
+	};
+
+	//just enough of an x86-64 encoder for the templates, memory operands are always [base + disp]
+	class Assembler
+	{
+	public:
+		std::vector<unsigned char> m_Code;
+
+		size_t Size() const { return m_Code.size(); }
+		void Byte(int b) { m_Code.push_back((unsigned char)b); }
+		void Dword(int d) { for (int i = 0; i < 4; i++) Byte(d >> (i*8)); }
+		void Qword(uint64_t q) { for (int i = 0; i < 8; i++) Byte((int)(q >> (i*8))); }
+
+		void Push(int r) { if (r & 8) Byte(0x41); Byte(0x50 | (r & 7)); }
+		void Pop(int r) { if (r & 8) Byte(0x41); Byte(0x58 | (r & 7)); }
+		void Ret() { Byte(0xC3); }
+
+		//mov dst, src
+		void Mov(int dst, int src) { Rex(true, src, dst); Byte(0x89); RegReg(src, dst); }
+		void Mov32(int dst, int src) { Rex(false, src, dst); Byte(0x89); RegReg(src, dst); }
+		void MovImm(int dst, uint64_t imm) { Rex(true, 0, dst); Byte(0xB8 | (dst & 7)); Qword(imm); }
+		void MovImm32(int dst, int imm) { Rex(false, 0, dst); Byte(0xB8 | (dst & 7)); Dword(imm); }
+		//mov dst, [base + disp]
+		void Load(int dst, int base, int disp) { Rex(true, dst, base); Byte(0x8B); Mem(dst, base, disp); }
+		void Load32(int dst, int base, int disp) { Rex(false, dst, base); Byte(0x8B); Mem(dst, base, disp); }
+		//movzx dst, byte [base + disp]
+		void LoadByte(int dst, int base, int disp) { Rex(false, dst, base); Byte(0x0F); Byte(0xB6); Mem(dst, base, disp); }
+		//mov [base + disp], src
+		void Store(int base, int disp, int src) { Rex(true, src, base); Byte(0x89); Mem(src, base, disp); }
+		void Store32(int base, int disp, int src) { Rex(false, src, base); Byte(0x89); Mem(src, base, disp); }
+		//mov qword [base + disp], imm (sign extended)
+		void StoreImm(int base, int disp, int imm) { Rex(true, 0, base); Byte(0xC7); Mem(0, base, disp); Dword(imm); }
+		void CmpByte(int base, int disp, int imm) { Rex(false, 0, base); Byte(0x80); Mem(7, base, disp); Byte(imm); }
+
+		//op dst, [base + disp] with op 0x03 add, 0x2B sub or 0x3B cmp
+		void Alu(int op, int dst, int base, int disp) { Rex(true, dst, base); Byte(op); Mem(dst, base, disp); }
+		//op qword [base + disp], imm
+		void AluImm(AluOp op, int base, int disp, int imm) { Rex(true, 0, base); Byte(0x81); Mem(op, base, disp); Dword(imm); }
+		void AluRegImm(AluOp op, int reg, int imm) { Rex(true, 0, reg); Byte(0x81); RegReg(op, reg); Dword(imm); }
+		void AddReg(int dst, int src) { Rex(true, src, dst); Byte(0x01); RegReg(src, dst); }
+		void SubReg(int dst, int src) { Rex(true, src, dst); Byte(0x29); RegReg(src, dst); }
+		void CmpImm32(int reg, int imm) { Rex(false, 0, reg); Byte(0x81); RegReg(7, reg); Dword(imm); }
+		void CmpReg(int x, int y) { Rex(true, y, x); Byte(0x39); RegReg(y, x); }
+		//cmp dword [base + disp], imm
+		void CmpDword(int base, int disp, int imm) { Rex(false, 0, base); Byte(0x81); Mem(7, base, disp); Dword(imm); }
+		//imul dst, [base + disp]
+		void Imul(int dst, int base, int disp) { Rex(true, dst, base); Byte(0x0F); Byte(0xAF); Mem(dst, base, disp); }
+		void Shl(int reg, int n) { Rex(true, 0, reg); Byte(0xC1); RegReg(4, reg); Byte(n); }
+		void Shr(int reg, int n) { Rex(true, 0, reg); Byte(0xC1); RegReg(5, reg); Byte(n); }
+		//eax = cond ? 1 : 0 (setcc al, movzx eax, al)
+		void SetCond(Cond cond) { Byte(0x0F); Byte(0x90 | cond); Byte(0xC0); Byte(0x0F); Byte(0xB6); Byte(0xC0); }
+
+		//scalar double op xmm, [base + disp] with op 0x10 movsd, 0x58 addsd, 0x5C subsd, 0x59 mulsd or 0x5E divsd
+		void Sd(int op, int xmm, int base, int disp) { Byte(0xF2); Rex(false, xmm, base); Byte(0x0F); Byte(op); Mem(xmm, base, disp); }
+		void StoreSd(int base, int disp, int xmm) { Byte(0xF2); Rex(false, xmm, base); Byte(0x0F); Byte(0x11); Mem(xmm, base, disp); }
+		void Ucomisd(int xmm, int base, int disp) { Byte(0x66); Rex(false, xmm, base); Byte(0x0F); Byte(0x2E); Mem(xmm, base, disp); }
+
+		void Call(int reg) { Rex(false, 0, reg); Byte(0xFF); RegReg(2, reg); }
+		void Jump(int reg) { Rex(false, 0, reg); Byte(0xFF); RegReg(4, reg); }
+		void Jump(Label& label) { Byte(0xE9); Use(label); }
+		void Jump(Cond cond, Label& label) { Byte(0x0F); Byte(0x80 | cond); Use(label); }
+		void Bind(Label& label)
+		{
+			label.m_Position = (int)Size();
+			for (auto fixup: label.m_Fixups)
+				Patch(fixup, label.m_Position);
+		}
+
+	private:
+		void Rex(bool wide, int reg, int base)
+		{
+			int rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+			if (rex != 0x40)
+				Byte(rex);
+		}
+		//modrm, sib and displacement of [base + disp]
+		void Mem(int reg, int base, int disp)
+		{
+			int mod = (disp == 0 && (base & 7) != RBP) ? 0 : (disp >= -128 && disp <= 127) ? 1 : 2;
+			Byte((mod << 6) | ((reg & 7) << 3) | (base & 7));
+			if ((base & 7) == RSP)
+				Byte(0x24);
+			if (mod == 1)
+				Byte(disp);
+			else if (mod == 2)
+				Dword(disp);
+		}
+		void RegReg(int reg, int rm) { Byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+		void Use(Label& label)
+		{
+			if (label.m_Position >= 0)
+				Dword(label.m_Position - (int)(Size() + 4));
+			else
+			{
+				label.m_Fixups.push_back(Size());
+				Dword(0);
+			}
+		}
+		void Patch(size_t at, int target)
+		{
+			int rel = target - (int)(at + 4);
+			memcpy(&m_Code[at], &rel, 4);
+		}
+	};
+
+	//a Value in memory
+	struct Slot
+	{
+		int m_Base;
+		int m_Disp;
+
+		Slot(int base, int disp) : m_Base(base), m_Disp(disp) {}
+		int Type() const { return m_Disp + TypeOffset; }
+		int Payload() const { return m_Disp + PayloadOffset; }
+	};
+
+	//where compiled code finds the state of the context, offsets from Context
+	struct Layout
+	{
+		int m_StackSize, m_StackData, m_StackCommitted;
+		int m_CallStackSize, m_CallStackData, m_CallStackCommitted;
+		int m_Variables, m_SP, m_CurFrame;
+	};
+
+	static_assert(sizeof(CallFrame) == 24, "compiled calls address the call stack as 24 byte frames");
+
+	Slot Local(int index) { return Slot(Frame, index*(int)sizeof(Value)); }
+	//n-th value from the top of the stack, starting at 1
+	Slot Stack(int n) { return Slot(Top, -n*(int)sizeof(Value)); }
+
+	//emits the code of one function: a prologue that loads the registers and jumps to the entry
+	//point it is given, then the templates in instruction order, then the epilogue
+	class Templates
+	{
+		Assembler a;
+		Function* m_Function;
+		Layout m_Layout;
+		void* m_SlowPath;
+		void** m_Transfer;
+		std::vector<Label> m_Labels;
+		Label m_Epilogue, m_ExitWithResult, m_Transferred;
+
+	public:
+		std::vector<int> m_Entries;
+
+		Templates(Function* function, const Layout& layout, void* slowpath, void** transfer)
+			: m_Function(function), m_Layout(layout), m_SlowPath(slowpath), m_Transfer(transfer)
+		{
+		}
+
+		const std::vector<unsigned char>& Code() const { return a.m_Code; }
+
+		bool Emit()
+		{
+			auto& code = m_Function->m_Instructions;
+			m_Labels.resize(code.size());
+			m_Entries.assign(code.size(), -1);
+
+			//captures of our locals are only ever opened by our own CInits
+			bool captures = false;
+			for (auto& in: code)
+				if (in.m_Instruction == InstructionType::CInit)
+					captures = true;
+
+			//int Enter(JetContext* context, Value* frame, void* entry)
+			a.Push(RBX); a.Push(R12); a.Push(R13); a.Push(R14); a.Push(R15);
+			a.Mov(Context, RDI);
+			a.Mov(Frame, RSI);
+			a.Load(Base, Context, m_Layout.m_StackData);
+			this->LoadTop();
+			a.Jump(RDX);
+
+			for (unsigned int i = 0; i < code.size(); i++)
+			{
+				a.Bind(m_Labels[i]);
+				int start = (int)a.Size();
+				const Instruction& in = code[i];
+				switch (in.m_Instruction)
+				{
+				case InstructionType::LdNull:
+					a.StoreImm(Top, TypeOffset, (int)ValueType::Null);
+					a.StoreImm(Top, PayloadOffset, 0);
+					a.AluRegImm(AluAdd, Top, sizeof(Value));
+					break;
+				case InstructionType::LdInt:
+				case InstructionType::LdReal:
+				case InstructionType::LdStr:
+					a.MovImm(RAX, (uint64_t)&m_Function->m_Constants[in.m_Value]);
+					this->Push(Slot(RAX, 0));
+					break;
+				case InstructionType::LLoad:
+					this->Push(Local(in.m_Value));
+					break;
+				case InstructionType::LStore:
+					this->Pop(Local(in.m_Value));
+					break;
+				case InstructionType::Load:
+					//m_Variables can grow, read its current data pointer from m_VariablesData
+					a.Load(RAX, Context, m_Layout.m_Variables);
+					this->Push(Slot(RAX, in.m_Value*(int)sizeof(Value)));
+					break;
+				case InstructionType::Store:
+					a.Load(RAX, Context, m_Layout.m_Variables);
+					this->Pop(Slot(RAX, in.m_Value*(int)sizeof(Value)));
+					break;
+				case InstructionType::Dup:
+					this->Push(Stack(1));
+					break;
+				case InstructionType::Pop:
+					a.AluRegImm(AluSub, Top, sizeof(Value));
+					break;
+				case InstructionType::Jump:
+					if (this->Target(in.m_Value) == false)
+						return false;
+					a.Jump(m_Labels[in.m_Value]);
+					break;
+				case InstructionType::JumpTrue:
+				case InstructionType::JumpTruePeek:
+					if (this->Target(in.m_Value) == false)
+						return false;
+					this->JumpTrue(in.m_Value, in.m_Instruction == InstructionType::JumpTruePeek);
+					break;
+				case InstructionType::JumpFalse:
+				case InstructionType::JumpFalsePeek:
+					if (this->Target(in.m_Value) == false)
+						return false;
+					this->JumpFalse(in.m_Value, in.m_Instruction == InstructionType::JumpFalsePeek);
+					break;
+				case InstructionType::Add:
+				case InstructionType::AddIntInt:
+				case InstructionType::AddRealReal:
+					this->Arithmetic(i, 0x03, 0x58, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::Sub:
+				case InstructionType::SubIntInt:
+				case InstructionType::SubRealReal:
+					this->Arithmetic(i, 0x2B, 0x5C, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::Mul:
+				case InstructionType::MulIntInt:
+				case InstructionType::MulRealReal:
+					this->Arithmetic(i, 0xAF, 0x59, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::Div:
+				case InstructionType::DivIntInt:
+				case InstructionType::DivRealReal:
+					//int division stays in the VM
+					this->Arithmetic(i, 0, 0x5E, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::Lt:
+				case InstructionType::LtIntInt:
+				case InstructionType::LtRealReal:
+					this->Compare(i, CondL, true, CondA, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::Gt:
+				case InstructionType::GtIntInt:
+				case InstructionType::GtRealReal:
+					this->Compare(i, CondG, false, CondA, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::LtE:
+				case InstructionType::LtEIntInt:
+				case InstructionType::LtERealReal:
+					this->Compare(i, CondLE, true, CondAE, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::GtE:
+				case InstructionType::GtEIntInt:
+				case InstructionType::GtERealReal:
+					this->Compare(i, CondGE, false, CondAE, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::Eq:
+				case InstructionType::EqIntInt:
+				case InstructionType::EqRealReal:
+					this->Compare(i, CondE, false, (Cond)0, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::NotEq:
+				case InstructionType::NotEqIntInt:
+				case InstructionType::NotEqRealReal:
+					this->Compare(i, CondNE, false, (Cond)0, Stack(2), Stack(2), Stack(1));
+					break;
+				case InstructionType::Incr:
+					this->AddImmediate(i, Stack(1), 1);
+					break;
+				case InstructionType::Decr:
+					this->AddImmediate(i, Stack(1), -1);
+					break;
+				case InstructionType::IncrLocal:
+				case InstructionType::AddLocalImm:
+					this->AddImmediate(i, Local(in.m_Value2), in.m_Value);
+					break;
+				case InstructionType::LtLocalsJumpFalse:
+					if (this->Target(in.m_Value) == false)
+						return false;
+					this->LessJumpFalse(i, in.m_Value, Local(in.m_Value2), Local(in.m_Value3));
+					break;
+				case InstructionType::LtLocalImmJumpFalse:
+					if (this->Target(in.m_Value) == false)
+						return false;
+					this->LessImmediateJumpFalse(i, in.m_Value, Local(in.m_Value3), in.m_Value2);
+					break;
+				case InstructionType::AddR:
+					this->Arithmetic(i, 0x03, 0x58, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::SubR:
+					this->Arithmetic(i, 0x2B, 0x5C, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::MulR:
+					this->Arithmetic(i, 0xAF, 0x59, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::DivR:
+					this->Arithmetic(i, 0, 0x5E, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::LtR:
+					this->Compare(i, CondL, true, CondA, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::GtR:
+					this->Compare(i, CondG, false, CondA, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::LtER:
+					this->Compare(i, CondLE, true, CondAE, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::GtER:
+					this->Compare(i, CondGE, false, CondAE, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::EqR:
+					this->Compare(i, CondE, false, (Cond)0, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::NotEqR:
+					this->Compare(i, CondNE, false, (Cond)0, Local(in.m_Value3), Local(in.m_Value2), this->Operand(in.m_Value));
+					break;
+				case InstructionType::Close:
+					if (captures)
+						this->SlowPath(i);
+					break;
+				case InstructionType::Modulus:
+				case InstructionType::BAnd:
+				case InstructionType::BOr:
+				case InstructionType::Xor:
+				case InstructionType::BNot:
+				case InstructionType::LeftShift:
+				case InstructionType::RightShift:
+				case InstructionType::Negate:
+				case InstructionType::ModulusR:
+				case InstructionType::BAndR:
+				case InstructionType::BOrR:
+				case InstructionType::XorR:
+				case InstructionType::LeftShiftR:
+				case InstructionType::RightShiftR:
+				case InstructionType::LoadAt:
+				case InstructionType::StoreAt:
+				case InstructionType::InvokeMethod:
+					this->SlowPath(i);
+					break;
+				case InstructionType::Call:
+					a.Load(RAX, Context, m_Layout.m_Variables);
+					this->Call(i, Slot(RAX, in.m_Value*(int)sizeof(Value)), in.m_Value2, false);
+					break;
+				case InstructionType::ECall:
+					this->Call(i, Stack(1), in.m_Value, true);
+					break;
+				case InstructionType::Return:
+					this->Return(i);
+					break;
+				default:
+					//allocations, captures, generators and tail calls are left to the interpreter
+					a.MovImm32(Next, i);
+					a.Jump(m_Epilogue);
+					start = -1;
+					break;
+				}
+				m_Entries[i] = start;
+			}
+
+			//a call or return switched to a frame that has code, continue there without leaving
+			a.Bind(m_Transferred);
+			a.Load(Frame, Context, m_Layout.m_SP);
+			a.MovImm(RAX, (uint64_t)m_Transfer);
+			a.Load(RAX, RAX, 0);
+			a.Jump(RAX);
+
+			a.Bind(m_ExitWithResult);
+			a.Mov32(Next, RAX);
+			a.Bind(m_Epilogue);
+			this->SaveTop();
+			a.Mov32(RAX, Next);
+			a.Pop(R15); a.Pop(R14); a.Pop(R13); a.Pop(R12); a.Pop(RBX);
+			a.Ret();
+			return true;
+		}
+
+	private:
+		bool Target(int target) const
+		{
+			return target >= 0 && target < (int)m_Labels.size();
+		}
+
+		//right hand operand of a register instruction, a local or a constant when negative
+		Slot Operand(int index)
+		{
+			if (index >= 0)
+				return Local(index);
+			a.MovImm(RSI, (uint64_t)&m_Function->m_Constants[~index]);
+			return Slot(RSI, 0);
+		}
+
+		void LoadTop()
+		{
+			a.Load32(RCX, Context, m_Layout.m_StackSize);
+			a.Shl(RCX, 4);
+			a.Mov(Top, Base);
+			a.AddReg(Top, RCX);
+		}
+
+		void SaveTop()
+		{
+			a.Mov(RAX, Top);
+			a.SubReg(RAX, Base);
+			a.Shr(RAX, 4);
+			a.Store32(Context, m_Layout.m_StackSize, RAX);
+		}
+
+		void Copy(Slot to, Slot from)
+		{
+			a.Load(RCX, from.m_Base, from.Type());
+			a.Load(RDX, from.m_Base, from.Payload());
+			a.Store(to.m_Base, to.Type(), RCX);
+			a.Store(to.m_Base, to.Payload(), RDX);
+		}
+
+		void Push(Slot from)
+		{
+			this->Copy(Slot(Top, 0), from);
+			a.AluRegImm(AluAdd, Top, sizeof(Value));
+		}
+
+		void Pop(Slot to)
+		{
+			a.AluRegImm(AluSub, Top, sizeof(Value));
+			this->Copy(to, Slot(Top, 0));
+		}
+
+		//runs the instruction in the VM: continues after -1, jumps to the code of the new frame
+		//after -2 and leaves the compiled code otherwise
+		void SlowPath(int iptr)
+		{
+			this->SaveTop();
+			a.Mov(RDI, Context);
+			a.MovImm32(RSI, iptr);
+			a.MovImm(RAX, (uint64_t)m_SlowPath);
+			a.Call(RAX);
+			this->LoadTop();
+			Label next;
+			a.CmpImm32(RAX, -1);
+			a.Jump(CondE, next);
+			a.CmpImm32(RAX, -2);
+			a.Jump(CondE, m_Transferred);
+			a.Jump(m_ExitWithResult);
+			a.Bind(next);
+		}
+
+		//rdx = &m_CallStack._data[r11]
+		void CallFrameAddress()
+		{
+			a.Load(RDX, Context, m_Layout.m_CallStackData);
+			a.Mov(RCX, R11);
+			a.Shl(RCX, 1);
+			a.AddReg(RCX, R11);
+			a.Shl(RCX, 3);
+			a.AddReg(RDX, RCX);
+		}
+
+		//calls of compiled script functions with their exact arity enter the frame like
+		//TryEnterFrame does and jump to the code of the callee, the rest goes to the VM
+		void Call(int iptr, Slot fun, int args, bool pop)
+		{
+			Label slow, clear, cleared;
+			a.CmpByte(fun.m_Base, fun.Type(), (int)ValueType::Function);
+			a.Jump(CondNE, slow);
+			a.Load(RSI, fun.m_Base, fun.Payload());
+			a.AluImm(AluCmp, RSI, (int)offsetof(Closure, m_Generator), 0);
+			a.Jump(CondNE, slow);
+			a.Load(RDI, RSI, (int)offsetof(Closure, m_Prototype));
+			a.CmpDword(RDI, (int)offsetof(Function, m_Args), args);
+			a.Jump(CondNE, slow);
+			a.CmpByte(RDI, (int)offsetof(Function, m_VarArg), 0);
+			a.Jump(CondNE, slow);
+			//only functions that are not generators get compiled
+			a.Load(R8, RDI, (int)offsetof(Function, m_Jit));
+			a.AluRegImm(AluCmp, R8, 0);
+			a.Jump(CondE, slow);
+			a.Load(R8, R8, (int)offsetof(JitCode, m_Entries));
+			a.Load(R8, R8, 0);
+			a.AluRegImm(AluCmp, R8, 0);
+			a.Jump(CondE, slow);
+
+			//room for the locals and temporaries of the callee and for one more call frame
+			a.Mov(R9, Top);
+			a.AluRegImm(AluSub, R9, (args + (pop ? 1 : 0))*(int)sizeof(Value));
+			a.Load32(RCX, RDI, (int)offsetof(Function, m_Locals));
+			a.Load32(RDX, RDI, (int)offsetof(Function, m_MaxStack));
+			a.AddReg(RCX, RDX);
+			a.Shl(RCX, 4);
+			a.AddReg(RCX, R9);
+			a.Load32(RDX, Context, m_Layout.m_StackCommitted);
+			a.Shl(RDX, 4);
+			a.AddReg(RDX, Base);
+			a.CmpReg(RCX, RDX);
+			a.Jump(CondA, slow);
+			a.Load32(R11, Context, m_Layout.m_CallStackSize);
+			a.Load32(RCX, Context, m_Layout.m_CallStackCommitted);
+			a.CmpReg(R11, RCX);
+			a.Jump(CondAE, slow);
+
+			//push the call frame of the caller
+			this->CallFrameAddress();
+			a.MovImm32(RAX, iptr);
+			a.Store32(RDX, (int)offsetof(CallFrame, m_IPtr), RAX);
+			a.Load(RAX, Context, m_Layout.m_CurFrame);
+			a.Store(RDX, (int)offsetof(CallFrame, m_Closure), RAX);
+			a.Store(RDX, (int)offsetof(CallFrame, m_SP), Frame);
+			a.AluRegImm(AluAdd, R11, 1);
+			a.Store32(Context, m_Layout.m_CallStackSize, R11);
+
+			//the arguments become the first locals, the others start out empty
+			a.Mov(Frame, R9);
+			a.Store(Context, m_Layout.m_SP, Frame);
+			a.Store(Context, m_Layout.m_CurFrame, RSI);
+			a.Mov(Top, Frame);
+			a.AluRegImm(AluAdd, Top, args*(int)sizeof(Value));
+			a.Load32(RCX, RDI, (int)offsetof(Function, m_Locals));
+			a.Shl(RCX, 4);
+			a.AddReg(RCX, Frame);
+			a.MovImm(RAX, (uint64_t)&Value::Empty);
+			a.Load(RDX, RAX, TypeOffset);
+			a.Load(RAX, RAX, PayloadOffset);
+			a.Bind(clear);
+			a.CmpReg(Top, RCX);
+			a.Jump(CondAE, cleared);
+			a.Store(Top, TypeOffset, RDX);
+			a.Store(Top, PayloadOffset, RAX);
+			a.AluRegImm(AluAdd, Top, sizeof(Value));
+			a.Jump(clear);
+			a.Bind(cleared);
+			a.Jump(R8);
+
+			a.Bind(slow);
+			this->SlowPath(iptr);
+		}
+
+		//returns to a compiled script frame like LeaveFrame does and jumps to the code after its
+		//call, generators, frames entered from native code and interpreted callers go to the VM
+		void Return(int iptr)
+		{
+			Label slow;
+			a.Load(RSI, Context, m_Layout.m_CurFrame);
+			a.AluImm(AluCmp, RSI, (int)offsetof(Closure, m_Generator), 0);
+			a.Jump(CondNE, slow);
+			a.Load32(R11, Context, m_Layout.m_CallStackSize);
+			a.AluRegImm(AluSub, R11, 1);
+			this->CallFrameAddress();
+			a.Load(RSI, RDX, (int)offsetof(CallFrame, m_Closure));
+			a.AluRegImm(AluCmp, RSI, 0);
+			a.Jump(CondE, slow);
+			a.Load(RDI, RSI, (int)offsetof(Closure, m_Prototype));
+			a.Load(R8, RDI, (int)offsetof(Function, m_Jit));
+			a.AluRegImm(AluCmp, R8, 0);
+			a.Jump(CondE, slow);
+			a.Load(R8, R8, (int)offsetof(JitCode, m_Entries));
+			a.Load32(RCX, RDX, (int)offsetof(CallFrame, m_IPtr));
+			a.Shl(RCX, 3);
+			a.AddReg(R8, RCX);
+			a.Load(R8, R8, sizeof(void*));
+			a.AluRegImm(AluCmp, R8, 0);
+			a.Jump(CondE, slow);
+
+			//the result takes the place of the frame
+			a.Load(R9, RDX, (int)offsetof(CallFrame, m_SP));
+			this->Copy(Local(0), Stack(1));
+			a.Mov(Top, Frame);
+			a.AluRegImm(AluAdd, Top, sizeof(Value));
+			a.Store32(Context, m_Layout.m_CallStackSize, R11);
+			a.Mov(Frame, R9);
+			a.Store(Context, m_Layout.m_SP, Frame);
+			a.Store(Context, m_Layout.m_CurFrame, RSI);
+			a.Jump(R8);
+
+			a.Bind(slow);
+			this->SlowPath(iptr);
+		}
+
+		//JumpFalse: null and zero jump
+		void JumpFalse(int target, bool peek)
+		{
+			if (peek == false)
+				a.AluRegImm(AluSub, Top, sizeof(Value));
+			Slot v = peek ? Stack(1) : Slot(Top, 0);
+			a.CmpByte(v.m_Base, v.Type(), (int)ValueType::Null);
+			a.Jump(CondE, m_Labels[target]);
+			a.AluImm(AluCmp, v.m_Base, v.Payload(), 0);
+			a.Jump(CondE, m_Labels[target]);
+		}
+
+		void JumpTrue(int target, bool peek)
+		{
+			Label skip;
+			if (peek == false)
+				a.AluRegImm(AluSub, Top, sizeof(Value));
+			Slot v = peek ? Stack(1) : Slot(Top, 0);
+			a.CmpByte(v.m_Base, v.Type(), (int)ValueType::Null);
+			a.Jump(CondE, skip);
+			a.AluImm(AluCmp, v.m_Base, v.Payload(), 0);
+			a.Jump(CondNE, m_Labels[target]);
+			a.Bind(skip);
+		}
+
+		//dst = x op y, the stack forms pass dst == x = second from the top and pop one value.
+		//intop is the add/sub opcode or 0xAF for imul, 0 to leave ints to the VM, realop the sse2 opcode
+		void Arithmetic(int iptr, int intop, int realop, Slot dst, Slot x, Slot y)
+		{
+			bool stack = x.m_Base == Top;
+			Label slow, done, notint;
+			a.LoadByte(RAX, x.m_Base, x.Type());
+			a.LoadByte(RCX, y.m_Base, y.Type());
+			if (intop)
+			{
+				a.CmpImm32(RAX, (int)ValueType::Int);
+				a.Jump(CondNE, notint);
+				a.CmpImm32(RCX, (int)ValueType::Int);
+				a.Jump(CondNE, slow);
+				a.Load(RDX, x.m_Base, x.Payload());
+				if (intop == 0xAF)
+					a.Imul(RDX, y.m_Base, y.Payload());
+				else
+					a.Alu(intop, RDX, y.m_Base, y.Payload());
+				a.Store(dst.m_Base, dst.Payload(), RDX);
+				this->Finish(dst, x, ValueType::Int, ValueType::Int, stack);
+				a.Jump(done);
+				a.Bind(notint);
+			}
+			a.CmpImm32(RAX, (int)ValueType::Real);
+			a.Jump(CondNE, slow);
+			a.CmpImm32(RCX, (int)ValueType::Real);
+			a.Jump(CondNE, slow);
+			a.Sd(0x10, 0, x.m_Base, x.Payload());
+			a.Sd(realop, 0, y.m_Base, y.Payload());
+			a.StoreSd(dst.m_Base, dst.Payload(), 0);
+			this->Finish(dst, x, ValueType::Real, ValueType::Real, stack);
+			a.Jump(done);
+			a.Bind(slow);
+			this->SlowPath(iptr);
+			a.Bind(done);
+		}
+
+		//dst = x rel y as an int. Ints compare with intcond, two reals with ucomisd (operands
+		//swapped for < and <= so unordered is false) and realcond, 0 leaves reals to the VM
+		void Compare(int iptr, Cond intcond, bool swap, Cond realcond, Slot dst, Slot x, Slot y)
+		{
+			bool stack = x.m_Base == Top;
+			Label slow, done, notint;
+			a.LoadByte(RAX, x.m_Base, x.Type());
+			a.LoadByte(RCX, y.m_Base, y.Type());
+			a.CmpImm32(RAX, (int)ValueType::Int);
+			a.Jump(CondNE, realcond ? notint : slow);
+			a.CmpImm32(RCX, (int)ValueType::Int);
+			a.Jump(CondNE, slow);
+			a.Load(RDX, x.m_Base, x.Payload());
+			a.Alu(0x3B, RDX, y.m_Base, y.Payload());
+			a.SetCond(intcond);
+			a.Store(dst.m_Base, dst.Payload(), RAX);
+			this->Finish(dst, x, ValueType::Int, ValueType::Int, stack);
+			a.Jump(done);
+			if (realcond)
+			{
+				a.Bind(notint);
+				a.CmpImm32(RAX, (int)ValueType::Real);
+				a.Jump(CondNE, slow);
+				a.CmpImm32(RCX, (int)ValueType::Real);
+				a.Jump(CondNE, slow);
+				Slot l = swap ? y : x, r = swap ? x : y;
+				a.Sd(0x10, 0, l.m_Base, l.Payload());
+				a.Ucomisd(0, r.m_Base, r.Payload());
+				a.SetCond(realcond);
+				a.Store(dst.m_Base, dst.Payload(), RAX);
+				this->Finish(dst, x, ValueType::Int, ValueType::Real, stack);
+				a.Jump(done);
+			}
+			a.Bind(slow);
+			this->SlowPath(iptr);
+			a.Bind(done);
+		}
+
+		//sets the type of the result unless it goes to the left operand which has that type already
+		void Finish(Slot dst, Slot x, ValueType type, ValueType xtype, bool stack)
+		{
+			if (dst.m_Base != x.m_Base || dst.m_Disp != x.m_Disp || type != xtype)
+				a.StoreImm(dst.m_Base, dst.Type(), (int)type);
+			if (stack)
+				a.AluRegImm(AluSub, Top, sizeof(Value));
+		}
+
+		//v += imm for ints (Incr/Decr/IncrLocal/AddLocalImm)
+		void AddImmediate(int iptr, Slot v, int imm)
+		{
+			Label slow, done;
+			a.CmpByte(v.m_Base, v.Type(), (int)ValueType::Int);
+			a.Jump(CondNE, slow);
+			a.AluImm(AluAdd, v.m_Base, v.Payload(), imm);
+			a.Jump(done);
+			a.Bind(slow);
+			this->SlowPath(iptr);
+			a.Bind(done);
+		}
+
+		//if !(x < y) goto target, the VM pushes the result of other types for a JumpFalse
+		void LessJumpFalse(int iptr, int target, Slot x, Slot y)
+		{
+			Label slow, done, notint;
+			a.LoadByte(RAX, x.m_Base, x.Type());
+			a.LoadByte(RCX, y.m_Base, y.Type());
+			a.CmpImm32(RAX, (int)ValueType::Int);
+			a.Jump(CondNE, notint);
+			a.CmpImm32(RCX, (int)ValueType::Int);
+			a.Jump(CondNE, slow);
+			a.Load(RDX, x.m_Base, x.Payload());
+			a.Alu(0x3B, RDX, y.m_Base, y.Payload());
+			a.Jump(CondGE, m_Labels[target]);
+			a.Jump(done);
+			a.Bind(notint);
+			a.CmpImm32(RAX, (int)ValueType::Real);
+			a.Jump(CondNE, slow);
+			a.CmpImm32(RCX, (int)ValueType::Real);
+			a.Jump(CondNE, slow);
+			a.Sd(0x10, 0, y.m_Base, y.Payload());
+			a.Ucomisd(0, x.m_Base, x.Payload());
+			a.Jump(CondBE, m_Labels[target]);
+			a.Jump(done);
+			a.Bind(slow);
+			this->SlowPath(iptr);
+			this->JumpFalse(target, false);
+			a.Bind(done);
+		}
+
+		void LessImmediateJumpFalse(int iptr, int target, Slot x, int imm)
+		{
+			Label slow, done;
+			a.CmpByte(x.m_Base, x.Type(), (int)ValueType::Int);
+			a.Jump(CondNE, slow);
+			a.AluImm(AluCmp, x.m_Base, x.Payload(), imm);
+			a.Jump(CondGE, m_Labels[target]);
+			a.Jump(done);
+			a.Bind(slow);
+			this->SlowPath(iptr);
+			this->JumpFalse(target, false);
+			a.Bind(done);
+		}
+	};
+
+	typedef int (*JitEnter)(JetContext* context, Value* frame, void* entry);
+}
+
+JetJit::JetJit(JetContext* context) : m_Context(context), m_Transfer(nullptr)
+{
+}
+
+JetJit::~JetJit()
+{
+	for (auto code: m_Code)
+	{
+		munmap(code->m_Memory, code->m_Size);
+		delete[] code->m_Entries;
+		delete code;
+	}
+}
+
+bool JetJit::Compile(Function* function)
+{
+	if (function->m_Jit)
+		return true;
+	//generator frames are saved and restored around yields, keep them interpreted
+	if (function->m_Generator)
+		return false;
+
+	JetContext* context = m_Context;
+	auto offset = [context](const void* member) { return (int)((const char*)member - (const char*)context); };
+	Layout layout;
+	layout.m_StackSize = offset(&context->m_Stack._size);
+	layout.m_StackData = offset(&context->m_Stack._data);
+	layout.m_StackCommitted = offset(&context->m_Stack._committed);
+	layout.m_CallStackSize = offset(&context->m_CallStack._size);
+	layout.m_CallStackData = offset(&context->m_CallStack._data);
+	layout.m_CallStackCommitted = offset(&context->m_CallStack._committed);
+	layout.m_Variables = offset(&context->m_VariablesData);
+	layout.m_SP = offset(&context->m_SP);
+	layout.m_CurFrame = offset(&context->m_CurFrame);
+	Templates templates(function, layout, (void*)&JetJit::SlowPath, &m_Transfer);
+	if (templates.Emit() == false)
+		return false;
+
+	//write the code, then make it executable and read only
+	auto& bytes = templates.Code();
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t size = (bytes.size() + page - 1) / page * page;
+	void* memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		return false;
+	memcpy(memory, bytes.data(), bytes.size());
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(memory, size);
+		return false;
+	}
+
+	JitCode* code = new JitCode;
+	code->m_Memory = memory;
+	code->m_Size = size;
+	code->m_Entries = new void*[templates.m_Entries.size()];
+	for (unsigned int i = 0; i < templates.m_Entries.size(); i++)
+		code->m_Entries[i] = templates.m_Entries[i] >= 0 ? (char*)memory + templates.m_Entries[i] : nullptr;
+	m_Code.push_back(code);
+	function->m_Jit = code;
+	return true;
+}
+
+void* JetJit::Entry(int iptr)
+{
+	//a call made from compiled code may have entered another function, count it like the interpreter does
+	Function* function = m_Context->m_CurFrame->m_Prototype;
+	if (function->m_Jit == nullptr && (--function->m_Hotness != 0 || this->Compile(function) == false))
+		return nullptr;
+	return function->m_Jit->m_Entries[iptr];
+}
+
+int JetJit::Transfer(int iptr)
+{
+	m_Transfer = this->Entry(iptr);
+	return m_Transfer ? -2 : iptr;
+}
+
+void JetJit::Run(int& iptr)
+{
+	void* entry = this->Entry(iptr);
+	if (entry == nullptr)
+		return;
+
+	//all compiled functions share the prologue and epilogue, any of them can be entered through.
+	//Calls and returns between compiled frames stay inside, so once out the interpreter takes over
+	int next = ((JitEnter)m_Context->m_CurFrame->m_Prototype->m_Jit->m_Memory)(m_Context, m_Context->m_SP, entry);
+	if (next < -1)
+	{
+		//the exception could not unwind through the compiled code, raise it here
+		iptr = -3 - next;
+		std::exception_ptr exception = m_Exception;
+		m_Exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+	iptr = next;
+}
+
+#define JIT_CACHE()	(in->m_Value2 >= 0 ? &function->m_Caches[in->m_Value2] : nullptr)
+//stack operands of binary instructions, b is popped and a holds the result
+#define JIT_BINARY()	const Value& b = vmstack_peek(stack); --stack._size; Value& a = vmstack_peek(stack);
+
+int JetJit::SlowPath(JetContext* context, int iptr)
+{
+	Closure* frame = context->m_CurFrame;
+	Function* function = frame->m_Prototype;
+	const Instruction* in = &function->m_Instructions[iptr];
+	const Value* constants = function->m_Constants.data();
+	auto& stack = context->m_Stack;
+	Value* sp = context->m_SP;
+	try
+	{
+		switch (in->m_Instruction)
+		{
+		case InstructionType::Add: case InstructionType::AddIntInt: case InstructionType::AddRealReal:
+			{ JIT_BINARY(); VALUES_OP(a, b, +, += ); break; }
+		case InstructionType::Sub: case InstructionType::SubIntInt: case InstructionType::SubRealReal:
+			{ JIT_BINARY(); VALUES_OP(a, b, -, -= ); break; }
+		case InstructionType::Mul: case InstructionType::MulIntInt: case InstructionType::MulRealReal:
+			{ JIT_BINARY(); VALUES_OP(a, b, *, *= ); break; }
+		case InstructionType::Div: case InstructionType::DivIntInt: case InstructionType::DivRealReal:
+			{ JIT_BINARY(); VALUES_OP(a, b, /, /= ); break; }
+		case InstructionType::Modulus:		{ JIT_BINARY(); a %= b; break; }
+		case InstructionType::BAnd:			{ JIT_BINARY(); a &= b; break; }
+		case InstructionType::BOr:			{ JIT_BINARY(); a |= b; break; }
+		case InstructionType::Xor:			{ JIT_BINARY(); a ^= b; break; }
+		case InstructionType::LeftShift:	{ JIT_BINARY(); a <<= b; break; }
+		case InstructionType::RightShift:	{ JIT_BINARY(); a >>= b; break; }
+		case InstructionType::Eq: case InstructionType::EqIntInt: case InstructionType::EqRealReal:
+			{ JIT_BINARY(); VALUES_CMP(a, a, b, == ); break; }
+		case InstructionType::NotEq: case InstructionType::NotEqIntInt: case InstructionType::NotEqRealReal:
+			{ JIT_BINARY(); VALUES_CMP(a, a, b, != ); break; }
+		case InstructionType::Lt: case InstructionType::LtIntInt: case InstructionType::LtRealReal:
+			{ JIT_BINARY(); VALUES_CMP(a, a, b, < ); break; }
+		case InstructionType::Gt: case InstructionType::GtIntInt: case InstructionType::GtRealReal:
+			{ JIT_BINARY(); VALUES_CMP(a, a, b, > ); break; }
+		case InstructionType::LtE: case InstructionType::LtEIntInt: case InstructionType::LtERealReal:
+			{ JIT_BINARY(); VALUES_CMP(a, a, b, <= ); break; }
+		case InstructionType::GtE: case InstructionType::GtEIntInt: case InstructionType::GtERealReal:
+			{ JIT_BINARY(); VALUES_CMP(a, a, b, >= ); break; }
+		case InstructionType::BNot:
+			{
+				Value& a = vmstack_peek(stack);
+				a = ~a;
+				break;
+			}
+		case InstructionType::Negate:
+			vmstack_peek(stack).Negate();
+			break;
+		case InstructionType::Incr:
+			vmstack_peek(stack).Increase();
+			break;
+		case InstructionType::Decr:
+			vmstack_peek(stack).Decrease();
+			break;
+		case InstructionType::IncrLocal:
+			VALUES_INCR_LOCAL(sp, in);
+			break;
+		case InstructionType::AddLocalImm:
+			{
+				Value& a = sp[in->m_Value2];
+				const Value b(in->m_Value);
+				VALUES_OP(a, b, +, += );
+				break;
+			}
+		case InstructionType::LtLocalsJumpFalse:
+			{
+				//the compiled code jumps on the result
+				Value r;
+				VALUES_CMP(r, sp[in->m_Value2], sp[in->m_Value3], < );
+				vmstack_push(stack, r);
+				break;
+			}
+		case InstructionType::LtLocalImmJumpFalse:
+			{
+				Value b(in->m_Value2);
+				Value r;
+				VALUES_CMP(r, sp[in->m_Value3], b, < );
+				vmstack_push(stack, r);
+				break;
+			}
+		case InstructionType::AddR:			VALUES_REGISTER_OP(sp, constants, in, +, += ); break;
+		case InstructionType::SubR:			VALUES_REGISTER_OP(sp, constants, in, -, -= ); break;
+		case InstructionType::MulR:			VALUES_REGISTER_OP(sp, constants, in, *, *= ); break;
+		case InstructionType::DivR:			VALUES_REGISTER_OP(sp, constants, in, /, /= ); break;
+		case InstructionType::ModulusR:		VALUES_REGISTER_ASSIGN(sp, constants, in, %= ); break;
+		case InstructionType::BAndR:		VALUES_REGISTER_ASSIGN(sp, constants, in, &= ); break;
+		case InstructionType::BOrR:			VALUES_REGISTER_ASSIGN(sp, constants, in, |= ); break;
+		case InstructionType::XorR:			VALUES_REGISTER_ASSIGN(sp, constants, in, ^= ); break;
+		case InstructionType::LeftShiftR:	VALUES_REGISTER_ASSIGN(sp, constants, in, <<= ); break;
+		case InstructionType::RightShiftR:	VALUES_REGISTER_ASSIGN(sp, constants, in, >>= ); break;
+		case InstructionType::EqR:			VALUES_REGISTER_CMP(sp, constants, in, == ); break;
+		case InstructionType::NotEqR:		VALUES_REGISTER_CMP(sp, constants, in, != ); break;
+		case InstructionType::LtR:			VALUES_REGISTER_CMP(sp, constants, in, < ); break;
+		case InstructionType::GtR:			VALUES_REGISTER_CMP(sp, constants, in, > ); break;
+		case InstructionType::LtER:			VALUES_REGISTER_CMP(sp, constants, in, <= ); break;
+		case InstructionType::GtER:			VALUES_REGISTER_CMP(sp, constants, in, >= ); break;
+		case InstructionType::LoadAt:
+			if (in->m_Value >= 0)
+			{
+				Value& loc = vmstack_peek(stack);
+				loc = context->LoadMember(loc, constants[in->m_Value].m_String, JIT_CACHE());
+			}
+			else
+			{
+				Value v = context->LoadIndex(vmstack_peekn(stack, 2), vmstack_peek(stack));
+				vmstack_popn(stack, 2);
+				vmstack_push(stack, v);
+			}
+			break;
+		case InstructionType::StoreAt:
+			if (in->m_Value >= 0)
+			{
+				context->StoreField(vmstack_peek(stack), constants[in->m_Value].m_String, vmstack_peekn(stack, 2), JIT_CACHE());
+				vmstack_popn(stack, 2);
+			}
+			else if (context->StoreIndex(vmstack_peekn(stack, 2), vmstack_peekn(stack, 1), vmstack_peekn(stack, 3)) && in->m_Value3)
+			{
+				//the copy of a shared string is stored back by the instructions after the jump
+				vmstack_peekn(stack, 3) = vmstack_peekn(stack, 2);
+				vmstack_popn(stack, 2);
+				return context->m_Jit.Transfer(iptr + 2);
+			}
+			else
+			{
+				vmstack_popn(stack, 3);
+			}
+			break;
+		case InstructionType::Call:
+		case InstructionType::ECall:
+		case InstructionType::InvokeMethod:
+			{
+				Value fun;
+				unsigned int args;
+				if (in->m_Instruction == InstructionType::Call)
+				{
+					fun = context->m_Variables[in->m_Value];
+					args = in->m_Value2;
+				}
+				else if (in->m_Instruction == InstructionType::ECall)
+				{
+					stack.Pop(fun);
+					args = in->m_Value;
+				}
+				else
+				{
+					const Value& self = stack._data[stack._size - in->m_Value3];
+					fun = context->LoadMember(self, constants[in->m_Value].m_String, JIT_CACHE());
+					args = in->m_Value3;
+				}
+
+				//exact arity calls of plain script functions enter the frame like VM_CALL does
+				if (context->TryEnterFrame(&fun, iptr, args))
+					return context->m_Jit.Transfer(0);
+
+				//native functions return here, other script functions now run in their own frame
+				//and go on from their first instruction
+				int next = (int)context->Call(&fun, iptr, args);
+				if (context->m_CurFrame != frame || next != iptr)
+					return context->m_Jit.Transfer(next + 1);
+				break;
+			}
+		case InstructionType::Close:
+			context->CloseCaptures(in->m_Value);
+			break;
+		case InstructionType::Return:
+			{
+				//returning to a script frame, the interpreter takes generators and leaving Execute
+				if (frame->m_Generator || vmstack_peek(context->m_CallStack).m_Closure == nullptr)
+					return iptr;
+
+				int next = (int)context->LeaveFrame() + 1;
+				return context->m_Jit.Transfer(next);
+			}
+		default:
+			return iptr;
+		}
+	}
+	catch (...)
+	{
+		context->m_Jit.m_Exception = std::current_exception();
+		return -3 - iptr;
+	}
+	return -1;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _JET_JIT_HEADER
+#define _JET_JIT_HEADER
+
+#include "Value.h"
+#include <vector>
+#include <exception>
+
+//baseline JIT: hot functions are translated to x86-64 machine code, one template per instruction.
+//Only built for x86-64 Linux (System V calling convention, mmap), define JET_NO_JIT to leave it out.
+//The templates assume the plain 16 byte Value, so it is also left out with JET_NAN_BOXING
+#if defined(__x86_64__) && defined(__linux__) && !defined(JET_NO_JIT) && !defined(JET_NAN_BOXING)
+#define JET_JIT
+#endif
+
+//calls plus loop iterations after which a function gets compiled
+#define JET_JIT_THRESHOLD 1000
+
+namespace Jet
+{
+	class JetContext;
+
+	/// <summary>
+	/// machine code of one function. Instructions the templates handle have an entry point,
+	/// the others exit back to the interpreter and have none
+	/// </summary>
+	struct JitCode
+	{
+		void*				m_Memory;
+		size_t				m_Size;
+		//one per instruction, compiled calls and returns index it directly
+		void**				m_Entries;
+	};
+
+#ifdef JET_JIT
+	/// <summary>
+	/// compiles functions of one context and runs their code on its stack.
+	/// Compiled code keeps the top of the stack in a register and calls back into the VM for
+	/// everything but the int/real fast paths. Calls of compiled script functions and returns to
+	/// compiled frames switch frames in machine code and jump straight to the code of the new one
+	/// </summary>
+	class JetJit
+	{
+	public:
+		JetJit(JetContext* context);
+		~JetJit();
+
+		//translates the function, returns false if it can not be compiled
+		bool Compile(Function* function);
+
+		//runs compiled code of the current frame from iptr if it has an entry point there,
+		//iptr is then the next instruction for the interpreter or the one that raised an error
+		void Run(int& iptr);
+
+	private:
+		//runs the instruction at iptr of the current frame in the VM: returns -1 to continue in
+		//compiled code, -2 to continue at m_Transfer in a new frame, an instruction to continue at
+		//in the interpreter or -3 - iptr after an error
+		static int SlowPath(JetContext* context, int iptr);
+
+		//entry point at iptr of the current frame, compiles the function once it is hot
+		void* Entry(int iptr);
+		//-2 with m_Transfer set if the current frame can go on in compiled code at iptr, else iptr
+		int Transfer(int iptr);
+
+		JetContext*				m_Context;
+		std::vector<JitCode*>	m_Code;
+
+		//error raised by SlowPath, rethrown by Run once out of the compiled code
+		std::exception_ptr		m_Exception;
+		void*					m_Transfer;
+	};
+#endif
+}
+
+#endif
@@ -107,6 +107,12 @@ int64_t fibo(int64_t n)
 		return fibo(n - 1) + fibo(n - 2);
 }
 
+//output function of contexts whose errors are expected
+int QuietOutput(const char* format, ...)
+{
+	return 0;
+}
+
 void CTest()
 {
 	INT64 start, end, rate;
@@ -537,6 +543,374 @@ int main(int argc, char* argv[])
 					throw CompilerException("", 0, "== operator precedence test failed\n");
 				}
 
+				//tail call test, return f(...) reuses the frame so the depth is not limited by the call stack
+				try
+				{
+					tcontext.Script("fun tloop(n, acc) { if (n == 0) return acc; return tloop(n - 1, acc + n); }"
+						"global tl = tloop(100000, 0);"
+						"fun teven(n) { if (n == 0) return 1; return todd(n - 1); }"
+						"fun todd(n) { if (n == 0) return 0; return teven(n - 1); }"
+						"global te = teven(300001);"
+						"local tstep = null; tstep = fun(n, acc) { if (n == 0) return acc; return tstep(n - 1, acc + 2); };"
+						"global ts = tstep(300000, 0);");
+					if ((int64_t)tcontext["tl"] != 5000050000LL || (int)tcontext["te"] != 0 || (int)tcontext["ts"] != 600000)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Tail call test failed!\n");
+				}
+
+				//deep recursion test, the stacks grow past their old fixed sizes and overflow with an
+				//exception that leaves the context usable
+				try
+				{
+					tcontext.Script("fun deep(n) { if (n == 0) return 0; return 1 + deep(n - 1); }"
+						"global dp = deep(50000);"
+						"fun wide(n) { local a = n; local b = a * 2; local c = b + 1; local d = [a, b, c]; if (n == 0) return 0; return d[0] + wide(n - 1); }"
+						"global dw = wide(20000);");
+					if ((int)tcontext["dp"] != 50000 || (int64_t)tcontext["dw"] != 200010000)
+						throw 7;
+
+					//the call stack printed for the overflow would be a quarter million lines long
+					JetContext ocontext;
+					ocontext.SetOutputFunction(QuietOutput);
+					ocontext.Script("fun endless(n) { return 1 + endless(n + 1); } fun shallow(n) { if (n == 0) return 0; return 1 + shallow(n - 1); }");
+					bool overflowed = false;
+					try
+					{
+						ocontext.Script("endless(0);");
+					}
+					catch (RuntimeException)
+					{
+						overflowed = true;
+					}
+					ocontext.Script("global dp2 = shallow(1000);");
+					if (overflowed == false || (int)ocontext["dp2"] != 1000)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Deep recursion test failed!\n");
+				}
+
+				//JIT test, functions get compiled after JET_JIT_THRESHOLD calls and hand natives,
+				//members, string indexing and reals back to the VM
+				try
+				{
+					tcontext["jitnative"] = [](JetContext* context, Value* args, int nargs)
+					{
+						return Value((int64_t)args[0] * 2);
+					};
+					tcontext.Script("fun hot(o, i) { o.n += jitnative(i); o[\"k\" + (i % 3)] = i; return o.n + \"abc\"[i % 3] + 0.5; }"
+						"global hotobj = {n = 0};"
+						"global hotsum = 0;"
+						"for (local hi = 0; hi < 3000; hi++) hotsum += hot(hotobj, hi);"
+						"global gcount = 0;"
+						"fun bumpg() { gcount += 1; return gcount; }"
+						"for (local gi = 0; gi < 2000; gi++) bumpg();");
+					if ((int64_t)tcontext["hotobj"]["n"] != 8997000 || (int)tcontext["hotobj"]["k2"] != 2999)
+						throw 7;
+					if ((double)tcontext["hotsum"] != 9000294500.0)
+						throw 7;
+
+					//calls between compiled functions stay in machine code unless the arguments do not match
+					tcontext.Script("fun jfib(n) { if (n < 2) return n; return jfib(n - 1) + jfib(n - 2); }"
+						"global jf = jfib(24);"
+						"fun jopt(a, b) { if (b == null) return a; return a + b; }"
+						"global jo = 0; for (local ji = 0; ji < 3000; ji++) jo += jopt(ji) + jopt(ji, 1);");
+					if ((int)tcontext["jf"] != 46368 || (int64_t)tcontext["jo"] != 9000000)
+						throw 7;
+
+					//new globals move the variables of compiled code
+					std::string globals;
+					for (int i = 0; i < 200; i++)
+						globals += "global jg" + std::to_string(i) + " = " + std::to_string(i) + ";";
+					tcontext.Script((globals + "for (local gj = 0; gj < 10; gj++) bumpg();").c_str());
+					if ((int)tcontext["gcount"] != 2010 || (int)tcontext["jg199"] != 199)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "JIT test failed!\n");
+				}
+
+				//int limits test, with JET_NAN_BOXING ints past 48 bits become reals instead of wrapping
+				try
+				{
+					tcontext.Script("global ia = 140737488355327;"
+						"global ib = ia + 1;"
+						"global ic = 0 - ia; ic -= 2;"
+						"global id = ia * 4;");
+					if ((int64_t)tcontext["ia"] != 140737488355327LL)
+						throw 7;
+					if ((double)tcontext["ib"] != 140737488355328.0 || (double)tcontext["ic"] != -140737488355329.0)
+						throw 7;
+					if ((double)tcontext["id"] != 562949953421308.0)
+						throw 7;
+
+					//negative ints mixed with reals keep their sign, in the instructions and through arguments
+					tcontext.Script("fun mixed(a, b) { return [a + b, a - b, a * b, a / b, a % b]; }"
+						"global im = [-1 + 0.5, -3 * 2.0, -7 - 0.5, -7 / 2.0, -7 % 2.5];"
+						"global imf = mixed(-1, 0.5);"
+						"global imh = 0.5; for (local imi = 0; imi < 3000; imi++) { local imr = mixed(-3, 2.0); imh += imr[2]; }");
+					const double mixedim[] = { -0.5, -6.0, -7.5, -3.5, -2.0 };
+					const double mixedimf[] = { -0.5, -1.5, -0.5, -2.0, -0.0 };
+					for (int mi = 0; mi < 5; mi++)
+						if ((double)tcontext["im"][(int64_t)mi] != mixedim[mi] || (double)tcontext["imf"][(int64_t)mi] != mixedimf[mi])
+							throw 7;
+					if ((double)tcontext["imh"] != -17999.5)
+						throw 7;
+
+					//the register instructions have their own int fast path
+					JetContext rcontext;
+					rcontext.SetRegisterMode(true);
+					rcontext.Script("fun limits(a, b) { local r = a + b; local m = a * 4; local s = r - m; return [r, m, s]; }"
+						"global ir = limits(140737488355327, 1);");
+					if ((double)rcontext["ir"][(int64_t)0] != 140737488355328.0 || (double)rcontext["ir"][(int64_t)1] != 562949953421308.0)
+						throw 7;
+					if ((double)rcontext["ir"][(int64_t)2] != -422212465065980.0)
+						throw 7;
+					rcontext.Script("fun rmixed(a, b) { local r = a + b; local m = a * b; local s = a - b; local d = a / b; return [r, m, s, d]; }"
+						"global irm = rmixed(-3, 2.0);");
+					if ((double)rcontext["irm"][(int64_t)0] != -1.0 || (double)rcontext["irm"][(int64_t)1] != -6.0)
+						throw 7;
+					if ((double)rcontext["irm"][(int64_t)2] != -5.0 || (double)rcontext["irm"][(int64_t)3] != -1.5)
+						throw 7;
+#ifdef JET_NAN_BOXING
+					//results past int64 as well
+					tcontext.Script("global ig = ia * ia;");
+					rcontext.Script("fun square(a) { local r = a * a; return r; } global ig = square(140737488355327);");
+					if ((double)tcontext["ig"] != 140737488355327.0*140737488355327.0 || (double)rcontext["ig"] != 140737488355327.0*140737488355327.0)
+						throw 7;
+#endif
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Int limits test failed!\n");
+				}
+
+				//shape test, objects with other key orders, too many keys, keys that are not strings or
+				//too many transitions from one shape still read right through the same inline cache
+				try
+				{
+					tcontext.Script("fun sgetx(o) { return o.x; }"
+						"global sorders = [{x = 1, y = 2}, {y = 3, x = 4}, {z = 0, x = 5}, {x = 6}];"
+						"global ssum = 0; for (local si = 0; si < 3000; si++) ssum += sgetx(sorders[si % 4]);"
+						"local sbig = {x = 7}; for (local sj = 0; sj < 100; sj++) sbig[\"k\" + sj] = sj;"
+						"global sbigx = sgetx(sbig); global sbigk = sbig.k99; global sbigsize = sbig:size();"
+						"local smixed = {x = 8, y = 9}; smixed[2.5] = 1; global smixedx = sgetx(smixed); global smixedy = smixed.y;"
+						"global sfan = 0; for (local sk = 0; sk < 400; sk++) { local so = {x = sk}; so[\"f\" + sk] = 1; sfan += sgetx(so) + so[\"f\" + sk]; }");
+					if ((int)tcontext["ssum"] != 12000 || (int)tcontext["sfan"] != 80200)
+						throw 7;
+					if ((int)tcontext["sbigx"] != 7 || (int)tcontext["sbigk"] != 99 || (int)tcontext["sbigsize"] != 101)
+						throw 7;
+					if ((int)tcontext["smixedx"] != 8 || (int)tcontext["smixedy"] != 9)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Shape test failed!\n");
+				}
+
+				//method cache test, a cached method is looked up again after it is replaced on the
+				//prototype chain, the chain changes or a closer object gets its own
+				try
+				{
+					tcontext.Script("global mroot = { val = fun(self) { return 1; } };"
+						"global mmid = setprototype({}, mroot);"
+						"global mobj = setprototype({}, mmid);"
+						"fun mcall(o) { return o:val(); }"
+						"global mres = [];"
+						"fun mrun() { local r = 0; for (local mi = 0; mi < 1500; mi++) r += mcall(mobj); mres:add(r); }"
+						"mrun();"
+						"mroot.val = fun(self) { return 2; }; mrun();"
+						"setprototype(mmid, { val = fun(self) { return 3; } }); mrun();"
+						"mmid.val = fun(self) { return 4; }; mrun();"
+						"mobj.val = fun(self) { return 5; }; mrun();"
+						"global mstr = 0; for (local mj = 0; mj < 1500; mj++) { if (\"abc\".missing == null) mstr += \"abc\":length(); }");
+					for (int mi = 0; mi < 5; mi++)
+						if ((int)tcontext["mres"][(int64_t)mi] != 1500*(mi + 1))
+							throw 7;
+					if ((int)tcontext["mstr"] != 4500)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Method cache test failed!\n");
+				}
+
+				//metamethod test, the metamethods cached for an object are looked up again after one is
+				//replaced or removed on the prototype chain or the chain changes
+				try
+				{
+					tcontext.Script("global xtop = {};"
+						"global xmid = setprototype({ _add = fun(a, b) { return 1; } }, xtop);"
+						"global xobj = setprototype({}, xmid);"
+						"global xres = [];"
+						"fun xrun() { local r = 0; for (local xi = 0; xi < 1500; xi++) r += xobj + 1; xres:add(r); }"
+						"xrun();"
+						"xmid._add = fun(a, b) { return 2; }; xrun();"
+						"xmid._add = null; xtop._add = fun(a, b) { return 3; }; xrun();"
+						"setprototype(xmid, { _add = fun(a, b) { return 4; } }); xrun();"
+						"setprototype(xobj, { _add = fun(a, b) { return 5; } }); xrun();"
+						"getprototype(xobj)._call = fun(n, self) { return n * 2; };"
+						"global xcall = xobj(21);");
+					for (int xi = 0; xi < 5; xi++)
+						if ((int)tcontext["xres"][(int64_t)xi] != 1500*(xi + 1))
+							throw 7;
+					if ((int)tcontext["xcall"] != 42)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Metamethod test failed!\n");
+				}
+
+				//hash table test, objects in dictionary mode grow through many rehashes and still find
+				//every string, real and object key
+				try
+				{
+					tcontext.Script("local wd = {}; wd[0.5] = 0;"
+						"for (local wi = 0; wi < 20000; wi++) wd[\"w\" + wi] = wi;"
+						"global wsum = 0; for (local wj = 0; wj < 20000; wj++) wsum += wd[\"w\" + wj];"
+						"global wsize = wd:size(); global wmiss = wd[\"w20000\"];"
+						"local wr = {}; for (local wk = 0; wk < 3000; wk++) wr[wk + 0.25] = wk;"
+						"global wrsum = 0; for (local wm = 0; wm < 3000; wm++) wrsum += wr[wm + 0.25];"
+						"local wo = {}; local wkeys = []; for (local wn = 0; wn < 500; wn++) { local wkey = {}; wkeys:add(wkey); wo[wkey] = wn; }"
+						"global wosum = 0; for (local wp = 0; wp < 500; wp++) wosum += wo[wkeys[wp]];"
+						"global wcount = 0; for (local wv in wr) wcount++;");
+					if ((int64_t)tcontext["wsum"] != 199990000 || (int)tcontext["wsize"] != 20001 || tcontext["wmiss"].m_Type != ValueType::Null)
+						throw 7;
+					if ((int)tcontext["wrsum"] != 4498500 || (int)tcontext["wosum"] != 124750 || (int)tcontext["wcount"] != 3000)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Hash table test failed!\n");
+				}
+
+				//array part test, int keys move between the array part and the hash part as the object
+				//fills up from either end, gets far or negative keys, holes and reals that are no ints
+				try
+				{
+					tcontext.Script("local adense = {}; for (local ai = 0; ai < 1000; ai++) adense[ai] = ai * 2;"
+						"global adsum = 0; for (local aj = 0; aj < 1000; aj++) adsum += adense[aj];"
+						"adense[100000] = 5; adense[-1] = 6; adense.name = 7; adense[1000] = 8;"
+						"global adsize = adense:size(); global adfar = adense[100000]; global adneg = adense[-1]; global adnext = adense[1000];"
+						"local arev = {}; for (local ak = 511; ak >= 0; ak--) arev[ak] = ak;"
+						"global arsum = 0; for (local am = 0; am < 512; am++) arsum += arev[am];"
+						"global arsize = arev:size();"
+						"local ahole = {}; for (local an = 0; an < 64; an++) ahole[an] = an; ahole[10] = null; ahole[20] = null;"
+						"global ahsize = ahole:size(); global ahten = ahole[10];"
+						"local areal = {}; areal[0] = 1; areal[1.0] = 2; areal[2.5] = 3; global areal1 = areal[1]; global areal25 = areal[2.5];");
+					if ((int)tcontext["adsum"] != 999000 || (int)tcontext["adsize"] != 1004)
+						throw 7;
+					if ((int)tcontext["adfar"] != 5 || (int)tcontext["adneg"] != 6 || (int)tcontext["adnext"] != 8)
+						throw 7;
+					if ((int)tcontext["arsum"] != 130816 || (int)tcontext["arsize"] != 512)
+						throw 7;
+					if ((int)tcontext["ahsize"] != 62 || tcontext["ahten"].m_Type != ValueType::Null)
+						throw 7;
+					if (tcontext["areal1"].m_Type != ValueType::Null || (int)tcontext["areal25"] != 3)
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Array part test failed!\n");
+				}
+
+				//string store test, stores into a constant copy it into the variable and leave the constant alone
+				try
+				{
+					tcontext.Script("local cs = \"hello\"; cs[0] = 'j';"
+						"global cs1 = cs; global cs2 = \"hello\";"
+						"global cg = \"hello\"; cg[4] = 'a';"
+						"global cgrid = [\"....\", \"....\"]; cgrid[1][2] = '#';"
+						"global chot = null; for (local ci = 0; ci < 3000; ci++) { local cw = \"hot\"; cw[0] = 'n'; chot = cw; }");
+					if (tcontext["cs1"].ToString() != "jello" || tcontext["cs2"].ToString() != "hello" || tcontext["cg"].ToString() != "hella")
+						throw 7;
+					if (tcontext["cgrid"][(int64_t)0].ToString() != "...." || tcontext["cgrid"][(int64_t)1].ToString() != "..#.")
+						throw 7;
+					if (tcontext["chot"].ToString() != "not")
+						throw 7;
+
+					//short strings built at runtime share one string and are copied on write too
+					tcontext.Script("global cshort1 = \"ke\" + \"y\"; global cshort2 = \"k\" + \"ey\";"
+						"global cshort3 = \"k\" + \"ey\"; cshort3[0] = 'b';");
+					if (tcontext["cshort1"].m_String != tcontext["cshort2"].m_String)
+						throw 7;
+					if (tcontext["cshort2"].ToString() != "key" || tcontext["cshort3"].ToString() != "bey")
+						throw 7;
+
+					//and so do stores into the pieces of a rope, which keeps reading the old characters
+					tcontext.Script("local cp = \"\"; for (local cj = 0; cj < 10; cj++) cp = cp + \"piece\" + cj;"
+						"global crope = cp + \"end\"; cp[0] = 'P'; global cpiece = cp;"
+						"global cflat = crope + \"!\"; crope[5] = '_';");
+					if (tcontext["cpiece"].ToString() != "Piece0piece1piece2piece3piece4piece5piece6piece7piece8piece9")
+						throw 7;
+					if (tcontext["crope"].ToString() != "piece_piece1piece2piece3piece4piece5piece6piece7piece8piece9end")
+						throw 7;
+					if (tcontext["cflat"].ToString() != "piece0piece1piece2piece3piece4piece5piece6piece7piece8piece9end!")
+						throw 7;
+
+					//the parent of a view is copied as well, a view gets characters of its own
+					tcontext.Script("global cparent = crope + \"\"; global cview = cparent:sub(6, 48); global csub = cview:sub(6, 36);"
+						"cparent[6] = 'P'; cview[0] = 'V';");
+					if (tcontext["cparent"].ToString() != "piece_Piece1piece2piece3piece4piece5piece6piece7piece8piece9end")
+						throw 7;
+					if (tcontext["cview"].ToString() != "Viece1piece2piece3piece4piece5piece6piece7piece8")
+						throw 7;
+					if (tcontext["csub"].ToString() != "piece2piece3piece4piece5piece6piece7")
+						throw 7;
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "String store test failed!\n");
+				}
+
+				//incremental gc test, views and flattened strings outlive their parents and stores into
+				//old objects and arrays between steps are not lost, with gen2 marked by one or more threads
+				try
+				{
+					const unsigned int gcsettings[][2] = { { 100, 1 }, { 100, 3 }, { 0, 3 } };//pause target, threads
+					for (auto& setting: gcsettings)
+					{
+						JetContext gcontext;
+						gcontext.SetGCPauseTarget(setting[0]);
+						gcontext.SetGCThreads(setting[1]);
+						gcontext.Script("local rope = \"\";"
+							"for (local i = 0; i < 500; i++) rope = rope + \"piece\" + i + \",\";"
+							"global ropelen = rope:length();"
+							"global ropechar = rope[5];"
+							"global view = rope:sub(5, 40);"
+							"local sb = StringBuilder(\"start:\");"
+							"for (local j = 0; j < 300; j++) { sb:append(\"x\", j); sb:appendNumber(j * 0.5); }"
+							"local built = sb:toString();"
+							"global tail = built:sub(built:length() - 40);"
+							"rope = null; sb = null; built = null;"
+							"global olda = []; global oldo = {};"
+							"gc(); gc(); gc(); gc(); gc();"
+							"for (local k = 0; k < 20000; k++) { olda:add({v = k}); oldo[k % 97] = {w = k, s = \"str_\" + k + \"_long_enough_to_be_heap\"}; local junk = {x = k}; }"
+							"for (local m = 0; m < 20000; m += 3) olda[m] = {v = m};"
+							"gc(); gc();"
+							"global sa = 0; for (local n = 0; n < 20000; n++) sa += olda[n].v;"
+							"global so = 0; for (local p = 0; p < 97; p++) so += (oldo[p].w) + (oldo[p].s:length());");
+						if ((int)gcontext["ropelen"] != 4390 || (int)gcontext["ropechar"] != '0')
+							throw 7;
+						if (gcontext["view"].ToString() != "0,piece1,piece2,piece3,piece4,piece5,pie")
+							throw 7;
+						if (gcontext["tail"].ToString() != "97148.500000x298149.000000x299149.500000")
+							throw 7;
+						if ((int64_t)gcontext["sa"] != 199990000 || (int64_t)gcontext["so"] != 1938351)
+							throw 7;
+					}
+				}
+				catch(...)
+				{
+					throw CompilerException("", 0, "Incremental GC test failed!\n");
+				}
+
 				tcontext.Script("apples = {};", "Test 2");
 				tcontext.Script("while(1) { print(\"this should print\"); break; print(\"this should not print\"); continue; } ", "Test 3");
 				tcontext.Script("test = [5,6,7,6,\"hello\"]; return 1;", "Test 4");
@@ -561,6 +935,12 @@ int main(int argc, char* argv[])
 				printf("%s\n",E.reason.c_str());
 			}
 		}
+		else if (strcmp(command2, "regvm") == 0 && arg[0] == 0)
+		{
+			//лĴģʽںջģʽԱ
+			context.SetRegisterMode(!context.GetRegisterMode());
+			printf("Register mode %s\n", context.GetRegisterMode() ? "on" : "off");
+		}
 		else if (strcmp(command2, "quit") == 0 && arg[0] == 0)
 		{
 			break;
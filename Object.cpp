@@ -1,19 +1,49 @@
 #include "Value.h"
 #include "JetContext.h"
 
+#ifdef JET_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 using namespace Jet;
 
-size_t stringhash(const char* str)
+//splitmix64 finalizer, spreads every input bit over the whole hash
+static inline uint64_t HashMix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+//bit i is set for every control byte i of the group equal to c
+static inline unsigned int MatchGroup(const unsigned char* group, unsigned char c)
 {
-	/*size_t hash = *str;
-	while (*(str++))
-	hash += *str;*/
+#ifdef JET_SSE2
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < JET_OBJECT_GROUP; i++)
+		mask |= (unsigned int)(group[i] == c) << i;
+	return mask;
+#endif
+}
 
-	size_t hash = 5381;
-	char c;
-	while (c = *str++)
-		hash = ((hash << 5) + hash) + c;
-	return hash;
+static inline unsigned int LowestBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, mask);
+	return (unsigned int)i;
+#else
+	return (unsigned int)__builtin_ctz(mask);
+#endif
 }
 
 JetObject::JetObject(JetContext* jcontext)
@@ -21,274 +51,586 @@ JetObject::JetObject(JetContext* jcontext)
 	m_Grey = this->m_Mark = false;
 	m_RefCount = 0;
 	m_Type = ValueType::Object;
+	m_MethodCached = false;
+	m_Age = JET_NURSERY_AGE;//prototypes are not collected, the gc resets it for everything else
 
 	m_Prototype = jcontext->m_ObjectPrototype;
 	m_Context = jcontext;
 	m_Size = 0;
-	m_NodeCount = 2;
-	m_Nodes = new ObjNode[2];
+	m_NodeCount = 0;
+	m_Shape = jcontext->m_RootShape;
+	m_Slots = 0;
+	m_Nodes = 0;
+	m_Ctrl = 0;
+	m_TableSize = 0;
+	m_Array = 0;
+	m_ArraySize = 0;
+	m_Meta = 0;
 }
 
 JetObject::~JetObject()
 {
+	delete[] m_Slots;
 	delete[] m_Nodes;
+	delete[] m_Ctrl;
+	delete[] m_Array;
+	delete m_Meta;
+}
+
+Shape::Shape(Shape* parent) : m_Parent(parent)
+{
+	if (parent)
+		this->m_Keys = parent->m_Keys;
+}
+
+Shape::~Shape()
+{
+	for (auto ii: this->m_Transitions)
+		delete ii.second;
+}
+
+int Shape::Find(JetString* key) const
+{
+	for (unsigned int i = 0; i < this->m_Keys.size(); i++)
+	{
+		if (this->m_Keys[i].m_String == key)
+			return i;
+	}
+	return -1;
+}
+
+Shape* Shape::Transition(JetContext* context, JetString* key)
+{
+	auto ii = this->m_Transitions.find(key);
+	if (ii != this->m_Transitions.end())
+		return ii->second;
+
+	if (this->m_Keys.size() >= JET_MAX_SHAPE_SLOTS || this->m_Transitions.size() >= JET_MAX_SHAPE_TRANSITIONS)
+		return 0;
+
+	//the key is kept alive for as long as the context lives
+	context->PinString(key);
+
+	auto shape = new Shape(this);
+	shape->m_Keys.push_back(Value(key));
+	this->m_Transitions[key] = shape;
+	return shape;
 }
 
 std::size_t JetObject::key(const Value* v) const
 {
+	uint64_t bits = 0;
 	switch(v->m_Type)
 	{
 	case ValueType::Null:
-		return 0;
+		break;
 	case ValueType::Array:
 	case ValueType::Userdata:
 	case ValueType::Function:
 	case ValueType::Object:
-		return (size_t)v->m_Array;
+		bits = (uint64_t)(size_t)(JetArray*)v->m_Array;
+		break;
 	case ValueType::Int:
-		return (size_t)v->m_IntValue;
+		bits = (uint64_t)v->m_IntValue;
+		break;
 	case ValueType::Real:
-		return (size_t)v->m_RealValue;
+		{
+			//0.0 and -0.0 are the same key
+			double d = v->m_RealValue;
+			if (d != 0.0)
+				memcpy(&bits, &d, sizeof(d));
+			break;
+		}
 	case ValueType::String:
-		return stringhash(v->m_String->m_Data);
+		bits = v->m_String->m_Hash;
+		break;
 	case ValueType::NativeFunction:
-		return (size_t)v->m_NativeFunction;
+		bits = (uint64_t)(size_t)(JetNativeFunc)v->m_NativeFunction;
+		break;
 	}
-	return 0;
+	return (size_t)HashMix(bits ^ this->m_Context->m_HashSeed);
 }
 
-//just looks for a node
-ObjNode* JetObject::findNode(const Value* key)
+//just looks for a value
+Value* JetObject::findValue(const Value* key)
 {
-	ObjNode* node = &this->m_Nodes[this->key(key)%this->m_NodeCount];
-	if (node->first.m_Type != ValueType::Null)
+	//a string that was never interned can not be a key
+	if (key->m_Type == ValueType::String)
 	{
-		do
-		{
-			if (node->first == *key)
-				return node;//we found it
-			else
-				node = node->next;
-		}
-		while(node);
-	}	
-	return 0;
+		JetString* str = this->m_Context->FindString(key->m_String);
+		return str ? this->findValue(str) : 0;
+	}
+
+	if (auto slot = this->arraySlot(key))
+		return slot->m_Type != ValueType::Null ? slot : 0;
+
+	//shapes only ever hold string keys
+	if (this->m_Shape)
+		return 0;
+
+	ObjNode* node = this->findNode(key);
+	return node ? &node->second : 0;
+}
+
+Value* JetObject::findValue(const char* key)
+{
+	JetString* str = this->m_Context->FindString(key);
+	return str ? this->findValue(str) : 0;
 }
 
-ObjNode* JetObject::findNode(const char* key)
+Value* JetObject::findValue(JetString* key)
 {
-	ObjNode* node = &this->m_Nodes[stringhash(key)%this->m_NodeCount];
-	if (node->first.m_Type != ValueType::Null)
+	if (this->m_Shape)
 	{
-		do
-		{
-			if (node->first.m_Type == ValueType::String && strcmp(node->first.m_String->m_Data, key) == 0)
-				return node;//we found it
-			else
-				node = node->next;
-		}
-		while(node);
-	}	
-	return 0;
+		int slot = this->m_Shape->Find(key);
+		return slot >= 0 ? &this->m_Slots[slot] : 0;
+	}
+
+	Value k(key);
+	ObjNode* node = this->findNode(&k);
+	return node ? &node->second : 0;
 }
 
-//finds node for key or creates one if doesnt exist
-ObjNode* JetObject::getNode(const Value* key)
+//finds the value for key or creates one if doesnt exist
+Value* JetObject::getValue(const Value* key)
 {
-	ObjNode* mpnode = &this->m_Nodes[this->key(key)%this->m_NodeCount];//node in the main position
-	if (mpnode->first.m_Type != ValueType::Null)
+	if (key->m_Type == ValueType::String)
+		return this->getValue(this->m_Context->Intern(key->m_String));
+
+	if (this->m_MethodCached)
+		this->m_Context->InvalidateMethods();
+	if (key->m_Type == ValueType::Int)
 	{
-		ObjNode* node = mpnode;
-		while(node->next)//go down the linked list of nodes
+		if (auto slot = this->arraySlot(key))
+			return slot;
+		if (this->m_Shape == 0)
 		{
-			if (node->first == *key)
-				return node;//we found it
-			else
-				node = node->next;
+			ObjNode* node = this->findNode(key);
+			if (node)
+				return &node->second;
 		}
-		if (node->first == *key)
-			return node;//we found it
 
-		if (this->m_Size == this->m_NodeCount)//regrow if we are out of room
+		//like the hash part grows, the array part only grows when the hash part is
+		//full or would have to give up its shape, so the cost is amortized
+		if ((this->m_Shape || this->m_Size == this->m_NodeCount) && this->Rebalance(key))
 		{
-			this->resize();
-			return this->getNode(key);
+			if (auto slot = this->arraySlot(key))
+				return slot;
 		}
+	}
 
-		ObjNode* onode = &this->m_Nodes[this->key(&mpnode->first)%this->m_NodeCount];//get the main position of the node in our main position
+	if (this->m_Shape)
+		this->ToDictionary();
+	return &this->getNode(key)->second;
+}
 
-		ObjNode* newnode = this->getFreePosition();//find an open node to insert into
+//the b for which 2^(b-1) < x <= 2^b
+static unsigned int CeilLog2(uint64_t x)
+{
+	unsigned int b = 0;
+	while (((uint64_t)1 << b) < x)
+		b++;
+	return b;
+}
 
-		if (onode != mpnode)//is this node not in the main position?
+bool JetObject::Rebalance(const Value* key)
+{
+	//nums[b] counts the keys k with 2^(b-1) < k+1 <= 2^b
+	unsigned int nums[JET_MAX_ARRAY_BITS + 1] = {0};
+	unsigned int total = 0;
+	auto count = [&](int64_t k)
+	{
+		if (k >= 0 && k < ((int64_t)1 << JET_MAX_ARRAY_BITS))
 		{
-			//relocate the node and relink it in, then insert the new node at its position
-			while (onode->next != mpnode) onode = onode->next;
+			nums[CeilLog2((uint64_t)k + 1)]++;
+			total++;
+		}
+	};
+	for (unsigned int i = 0; i < this->m_ArraySize; i++)
+		if (this->m_Array[i].m_Type != ValueType::Null)
+			count(i);
+	if (this->m_Shape == 0)
+	{
+		for (unsigned int i = 0; i < this->m_Size; i++)
+			if (this->m_Nodes[i].first.m_Type == ValueType::Int)
+				count(this->m_Nodes[i].first.m_IntValue);
+	}
+	count(key->m_IntValue);
 
-			this->Barrier();
+	unsigned int used = 0, size = 0;
+	for (unsigned int b = 0, twotob = 1; b <= JET_MAX_ARRAY_BITS && twotob/2 < total; b++, twotob *= 2)
+	{
+		used += nums[b];
+		if (used > twotob/2)
+			size = twotob;
+	}
+	if (size <= this->m_ArraySize)
+		return false;
 
-			onode->next = newnode;
-			*newnode = *mpnode;
-			mpnode->next = 0;
-			mpnode->second = Value();
-			mpnode->first = *key;
-			m_Size++;
+	this->Barrier();
 
-			return mpnode;
+	auto old = this->m_Array;
+	this->m_Array = new Value[size];
+	for (unsigned int i = 0; i < this->m_ArraySize; i++)
+		this->m_Array[i] = old[i];
+	this->m_ArraySize = size;
+	delete[] old;
+
+	//take the keys that are now in range out of the hash part, the rest keeps its order
+	if (this->m_Shape == 0)
+	{
+		unsigned int n = 0;
+		for (unsigned int i = 0; i < this->m_Size; i++)
+		{
+			auto& node = this->m_Nodes[i];
+			if (auto slot = this->arraySlot(&node.first))
+				*slot = node.second;
+			else
+				this->m_Nodes[n++] = node;
 		}
-		else
+		if (n != this->m_Size)
 		{
-			this->Barrier();
+			this->m_Size = n;
+			this->Rehash(this->m_TableSize);
+		}
+	}
+	return true;
+}
 
-			//insert the new node and just link in, we had a hash collision
-			newnode->first = *key;
-			newnode->next = 0;
-			node->next = newnode;//link the new one into the chain
-			m_Size++;
+Value* JetObject::getValue(const char* key)
+{
+	return this->getValue(this->m_Context->Intern(key));
+}
+
+Value* JetObject::getValue(JetString* key)
+{
+	//the key might get added, which moves values the method cache points to,
+	//metamethod tables hold copies of the values of keys starting with _
+	if (this->m_MethodCached)
+	{
+		this->m_Context->InvalidateMethods();
+		if (key->m_Data[0] == '_')
+			this->m_Context->m_MetaVersion++;
+	}
+
+	if (this->m_Shape)
+	{
+		int slot = this->m_Shape->Find(key);
+		if (slot >= 0)
+			return &this->m_Slots[slot];
 
-			return newnode;
+		Shape* shape = this->m_Shape->Transition(this->m_Context, key);
+		if (shape)
+		{
+			this->Append(shape);
+			return &this->m_Slots[this->m_Size-1];
 		}
+
+		this->ToDictionary();
+	}
+
+	Value k(key);
+	return &this->getNode(&k)->second;
+}
+
+void JetObject::Append(Shape* shape)
+{
+	if (this->m_Size == this->m_NodeCount)
+	{
+		auto t = this->m_Slots;
+		this->m_NodeCount = this->m_NodeCount ? this->m_NodeCount*2 : 2;
+		this->m_Slots = new Value[this->m_NodeCount];
+		for (unsigned int i = 0; i < this->m_Size; i++)
+			this->m_Slots[i] = t[i];
+		delete[] t;
 	}
 
 	this->Barrier();
 
-	//main position for key is open, just insert
-	mpnode->first = *key;
-	mpnode->next = 0;
-	m_Size++;
+	this->m_Shape = shape;
+	this->m_Size++;
+}
 
-	return mpnode;
+void JetObject::ToDictionary()
+{
+	auto shape = this->m_Shape;
+	auto slots = this->m_Slots;
+	auto count = this->m_Size;
+
+	this->m_Shape = 0;
+	this->m_Slots = 0;
+	this->m_Size = 0;
+	this->m_NodeCount = 0;
+	unsigned int size = JET_OBJECT_GROUP;
+	while (size*7/8 < count + 1)
+		size *= 2;
+	this->Rehash(size);
+
+	//the keys are the strings held by the shape, so they stay alive,
+	//and they go in in slot order so iteration order is kept
+	for (unsigned int i = 0; i < count; i++)
+		this->getNode(&shape->m_Keys[i])->second = slots[i];
+
+	delete[] slots;
 }
 
-//this method allocates new key strings
-ObjNode* JetObject::getNode(const char* key)
+JetObject::Iterator JetObject::find(const Value& key)
 {
-	ObjNode* mpnode = &this->m_Nodes[stringhash(key)%this->m_NodeCount];//node in the main position
-	if (mpnode->first.m_Type != ValueType::Null)
+	if (key.m_Type == ValueType::String)
 	{
-		ObjNode* node = mpnode;
-		while (node->next)
-		{
-			if (node->first.m_Type == ValueType::String && strcmp(node->first.m_String->m_Data, key) == 0)
-				return node;//we found it
-			else
-				node = node->next;
-		}
+		JetString* str = this->m_Context->FindString(key.m_String);
+		return str ? this->find(str) : this->end();
+	}
 
-		if (node->first.m_Type == ValueType::String && strcmp(node->first.m_String->m_Data, key) == 0)
-			return node;//we found it
+	if (auto slot = this->arraySlot(&key))
+		return slot->m_Type != ValueType::Null ? Iterator(this, (unsigned int)key.m_IntValue) : this->end();
 
-		if (this->m_Size == this->m_NodeCount)//regrow if we are out of room
-		{
-			this->resize();
-			return this->getNode(key);
-		}
+	if (this->m_Shape)
+		return this->end();
 
-		ObjNode* onode = &this->m_Nodes[this->key(&mpnode->first)%this->m_NodeCount];//get the main position of the node in our main position
+	ObjNode* node = this->findNode(&key);
+	return node ? Iterator(this, this->m_ArraySize + (unsigned int)(node - this->m_Nodes)) : this->end();
+}
 
-		ObjNode* newnode = this->getFreePosition();//find an open node to insert into
+JetObject::Iterator JetObject::find(const char* key)
+{
+	JetString* str = this->m_Context->FindString(key);
+	return str ? this->find(str) : this->end();
+}
 
-		if (onode != mpnode)//is this node not in the main position?
-		{
-			//relocate the node and relink it in, then insert the new node at its position
-			while (onode->next != mpnode) onode = onode->next;
+JetObject::Iterator JetObject::find(JetString* key)
+{
+	if (this->m_Shape)
+	{
+		int slot = this->m_Shape->Find(key);
+		return slot >= 0 ? Iterator(this, this->m_ArraySize + slot) : this->end();
+	}
 
-			this->Barrier();
+	Value k(key);
+	ObjNode* node = this->findNode(&k);
+	return node ? Iterator(this, this->m_ArraySize + (unsigned int)(node - this->m_Nodes)) : this->end();
+}
 
-			onode->next = newnode;
-			*newnode = *mpnode;
-			mpnode->next = 0;
-			mpnode->second = Value();
-			mpnode->first = m_Context->CreateNewString(key);
-			m_Size++;
+//iterator positions are the array part indices followed by the slots or nodes
+unsigned int JetObject::next(unsigned int i) const
+{
+	for (; i < this->m_ArraySize; i++)
+		if (this->m_Array[i].m_Type != ValueType::Null)
+			return i;
 
-			return mpnode;
-		}
-		else
-		{
-			this->Barrier();
+	//slots and nodes are both dense and in insertion order
+	return i - this->m_ArraySize < this->m_Size ? i : (unsigned int)-1;
+}
+
+ObjEntry JetObject::entry(unsigned int i)
+{
+	if (i < this->m_ArraySize)
+		return ObjEntry { Value((int64_t)i), this->m_Array[i] };
+
+	i -= this->m_ArraySize;
+	if (this->m_Shape)
+		return ObjEntry { this->m_Shape->m_Keys[i], this->m_Slots[i] };
+	return ObjEntry { this->m_Nodes[i].first, this->m_Nodes[i].second };
+}
 
-			//insert the new node and just link in, we had a hash collision
-			newnode->first = m_Context->CreateNewString(key);
-			newnode->next = 0;
-			node->next = newnode;//link the new one into the chain
-			m_Size++;
+size_t JetObject::size() const
+{
+	size_t count = this->m_Size;
+	for (unsigned int i = 0; i < this->m_ArraySize; i++)
+		if (this->m_Array[i].m_Type != ValueType::Null)
+			count++;
+	return count;
+}
+
+//just looks for a node
+ObjNode* JetObject::findNode(const Value* key)
+{
+	return this->findNode(key, this->key(key));
+}
 
-			return newnode;
+ObjNode* JetObject::findNode(const Value* key, size_t hash)
+{
+	unsigned char h2 = (unsigned char)(hash & 0x7F);
+	const unsigned int* index = (const unsigned int*)(this->m_Ctrl + this->m_TableSize);
+	unsigned int groupmask = this->m_TableSize/JET_OBJECT_GROUP - 1;
+	unsigned int group = (unsigned int)(hash >> 7) & groupmask;
+
+	//triangular probing over the groups visits each of them once
+	for (unsigned int step = 1; ; step++)
+	{
+		const unsigned char* ctrl = this->m_Ctrl + group*JET_OBJECT_GROUP;
+		for (unsigned int match = MatchGroup(ctrl, h2); match; match &= match - 1)
+		{
+			ObjNode* node = &this->m_Nodes[index[group*JET_OBJECT_GROUP + LowestBit(match)]];
+			if (node->first == *key)
+				return node;//we found it
 		}
+
+		//nothing is ever removed, so an empty position ends the probe sequence
+		if (MatchGroup(ctrl, JET_OBJECT_EMPTY))
+			return 0;
+		group = (group + step) & groupmask;
 	}
+}
 
-	this->Barrier();
+//finds node for key or creates one if doesnt exist
+ObjNode* JetObject::getNode(const Value* key)
+{
+	size_t hash = this->key(key);
+	ObjNode* node = this->findNode(key, hash);
+	if (node)
+		return node;
 
-	//main position for key is open, just insert
-	mpnode->first = m_Context->CreateNewString(key);
-	mpnode->next = 0;
-	m_Size++;
+	//regrow if we are out of room, the table stays at most 7/8 full
+	if (this->m_Size == this->m_NodeCount)
+		this->Rehash(this->m_TableSize*2);
+
+	this->Barrier();
 
-	return mpnode;
+	this->Insert(hash, this->m_Size);
+	node = &this->m_Nodes[this->m_Size++];
+	node->first = *key;
+	node->second = Value();
+	return node;
 }
 
-ObjNode* JetObject::getFreePosition()
+void JetObject::Insert(size_t hash, unsigned int node)
 {
-	for (unsigned int i = 0; i < this->m_NodeCount; i++)
+	//the first empty position of the probe sequence, where lookups would stop
+	unsigned int* index = (unsigned int*)(this->m_Ctrl + this->m_TableSize);
+	unsigned int groupmask = this->m_TableSize/JET_OBJECT_GROUP - 1;
+	unsigned int group = (unsigned int)(hash >> 7) & groupmask;
+	for (unsigned int step = 1; ; step++)
 	{
-		if (this->m_Nodes[i].first.m_Type == ValueType::Null)
-			return &this->m_Nodes[i];
+		unsigned char* ctrl = this->m_Ctrl + group*JET_OBJECT_GROUP;
+		unsigned int empty = MatchGroup(ctrl, JET_OBJECT_EMPTY);
+		if (empty)
+		{
+			unsigned int pos = LowestBit(empty);
+			ctrl[pos] = (unsigned char)(hash & 0x7F);
+			index[group*JET_OBJECT_GROUP + pos] = node;
+			return;
+		}
+		group = (group + step) & groupmask;
 	}
-	return 0;
 }
 
-void JetObject::resize()
+void JetObject::Rehash(unsigned int size)
 {
-	//change resize rate, this is just a quickie
-	auto t = this->m_Nodes;
-	this->m_Nodes = new ObjNode[this->m_NodeCount*2];//lets be dumb atm
-	auto osize = this->m_NodeCount;
-	this->m_NodeCount *= 2;
-	this->m_Size = 0;//cheat
-	for (unsigned int i = 0; i < osize; i++)
+	delete[] this->m_Ctrl;
+	this->m_TableSize = size;
+	//control bytes followed by the index of the node at each position
+	this->m_Ctrl = new unsigned char[size + size*sizeof(unsigned int)];
+	memset(this->m_Ctrl, JET_OBJECT_EMPTY, size);
+
+	//nodes keep their order, only their positions in the table change
+	auto nodes = this->m_Nodes;
+	this->m_NodeCount = size/8*7;
+	this->m_Nodes = new ObjNode[this->m_NodeCount];
+	for (unsigned int i = 0; i < this->m_Size; i++)
 	{
-		//reinsert into hashtable
-		ObjNode* n = &t[i];
+		this->m_Nodes[i] = nodes[i];
+		this->Insert(this->key(&nodes[i].first), i);
+	}
+
+	delete[] nodes;
+}
 
-		ObjNode* np = this->getNode(&n->first);
-		np->second = n->second;
+void JetObject::SetPrototype(JetObject* obj)
+{
+	if (this->m_MethodCached)
+	{
+		this->m_Context->InvalidateMethods();
+		this->m_Context->m_MetaVersion++;
 	}
+	this->m_Prototype = obj;
+	this->Barrier();
+}
 
-	delete[] t;
+const Value* JetObject::GetMetamethod(Metamethod method)
+{
+	auto meta = this->m_Meta;
+	if (meta == 0 || meta->m_Version != this->m_Context->m_MetaVersion)
+		meta = this->UpdateMetamethods();
+	return (meta->m_Present >> (int)method) & 1 ? &meta->m_Methods[(int)method] : 0;
+}
+
+MetaTable* JetObject::UpdateMetamethods()
+{
+	if (this->m_Meta == 0)
+		this->m_Meta = new MetaTable;
+
+	//from now on writing a metamethod anywhere on the chain has to invalidate the table
+	for (auto obj = this; obj; obj = obj->m_Prototype)
+		obj->m_MethodCached = true;
+
+	auto meta = this->m_Meta;
+	meta->m_Version = this->m_Context->m_MetaVersion;
+	meta->m_Present = 0;
+	for (int i = 0; i < (int)Metamethod::Count; i++)
+	{
+		meta->m_Methods[i] = Value();
+		//names that were never interned can not be keys of any object
+		auto name = this->m_Context->FindString(MetamethodNames[i]);
+		if (name == 0)
+			continue;
+		for (auto obj = this; obj; obj = obj->m_Prototype)
+		{
+			auto v = obj->findValue(name);
+			if (v && v->m_Type != ValueType::Null)
+			{
+				meta->m_Methods[i] = *v;
+				meta->m_Present |= 1u << i;
+				break;
+			}
+		}
+	}
+	return meta;
 }
 
 //try not to use these in the vm
+//the caller may store into the returned value, so these do the write barrier
 Value& JetObject::operator [](const Value& key)
 {
-	ObjNode* node = this->getNode(&key);
-	return node->second;
+	this->Barrier();
+	return *this->getValue(&key);
 }
 
 //special operator for strings to deal with insertions
 Value& JetObject::operator [](const char* key)
 {
-	ObjNode* node = this->getNode(key);
-	return node->second;
+	this->Barrier();
+	return *this->getValue(key);
 }
 
 void JetObject::DebugPrint()
 {
 	printf("JetObject Changed:\n");
-	for (unsigned int i = 0; i < this->m_NodeCount; i++)
+	for (unsigned int i = 0; i < this->m_ArraySize; i++)
+	{
+		auto v = this->m_Array[i].ToString();
+		printf("[%d] %s   Array\n", i, v.c_str());
+	}
+	if (this->m_Shape)
+	{
+		for (unsigned int i = 0; i < this->m_Size; i++)
+		{
+			auto k = this->m_Shape->m_Keys[i].ToString();
+			auto v = this->m_Slots[i].ToString();
+			printf("[%d] %s    %s   Slot\n", i, k.c_str(), v.c_str());
+		}
+		return;
+	}
+	for (unsigned int i = 0; i < this->m_Size; i++)
 	{
 		auto k = this->m_Nodes[i].first.ToString();
 		auto v = this->m_Nodes[i].second.ToString();
-		printf("[%d] %s    %s   Hash: %i\n", i, k.c_str(), v.c_str(), (this->key(&this->m_Nodes[i].first)%this->m_NodeCount));
+		printf("[%d] %s    %s   Group: %d\n", i, k.c_str(), v.c_str(), (int)((this->key(&this->m_Nodes[i].first) >> 7) & (this->m_TableSize/JET_OBJECT_GROUP - 1)));
 	}
 }
 
 //use this function
 void JetObject::Barrier()
 {
-	if (this->m_Mark)
-	{
-		//reset to grey and push back for reprocessing
-		this->m_Mark = false;
-		this->m_Context->m_GC.m_Greys.Push(this);//push to grey stack
-	}
-}
\ No newline at end of file
+	this->m_Context->m_GC.Barrier(this);
+}
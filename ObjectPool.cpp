@@ -0,0 +1,38 @@
+#include "ObjectPool.h"
+#include <cstring>
+
+using namespace Jet;
+
+ObjectPool::ObjectPool()
+{
+	memset(m_Free, 0, sizeof(m_Free));
+	m_Top = m_End = 0;
+}
+
+ObjectPool::~ObjectPool()
+{
+	for (auto page: m_Pages)
+	{
+		JET_POOL_UNPOISON(page, JET_POOL_PAGE_SIZE);
+		delete[] page;
+	}
+}
+
+void* ObjectPool::Carve(size_t c)
+{
+	size_t size = (c + 1)*JET_POOL_GRANULE;
+	if ((size_t)(m_End - m_Top) < size)
+	{
+		//the few bytes left in the old page are not worth a free list entry
+		char* page = new char[JET_POOL_PAGE_SIZE];
+		JET_POOL_POISON(page, JET_POOL_PAGE_SIZE);
+		m_Pages.push_back(page);
+		m_Top = page;
+		m_End = page + JET_POOL_PAGE_SIZE;
+	}
+
+	void* block = m_Top;
+	m_Top += size;
+	JET_POOL_UNPOISON(block, size);
+	return block;
+}
@@ -0,0 +1,83 @@
+#ifndef _JET_OBJECTPOOL_HEADER
+#define _JET_OBJECTPOOL_HEADER
+
+#include <cstddef>
+#include <vector>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define JET_POOL_POISON(p, size) ASAN_POISON_MEMORY_REGION(p, size)
+#define JET_POOL_UNPOISON(p, size) ASAN_UNPOISON_MEMORY_REGION(p, size)
+#else
+#define JET_POOL_POISON(p, size)
+#define JET_POOL_UNPOISON(p, size)
+#endif
+
+//blocks are handed out in size classes of this many bytes
+#define JET_POOL_GRANULE 16
+//larger blocks go straight to operator new
+#define JET_POOL_MAX_SIZE 256
+//size classes are carved out of pages of this size
+#define JET_POOL_PAGE_SIZE (64*1024)
+
+namespace Jet
+{
+	/// <summary>
+	/// allocator for the objects of one garbage collector. Small blocks come from free lists
+	/// of fixed size classes carved out of large pages, so allocating and freeing an object is
+	/// a couple of pointer moves and objects of one kind end up next to each other.
+	/// Freed blocks go back to their free list, pages are only returned when the pool dies
+	/// </summary>
+	class ObjectPool
+	{
+		struct Block
+		{
+			Block* m_Next;
+		};
+
+		Block*				m_Free[JET_POOL_MAX_SIZE/JET_POOL_GRANULE];
+		std::vector<char*>	m_Pages;
+		char*				m_Top;//unused rest of the newest page
+		char*				m_End;
+
+	public:
+		ObjectPool();
+		~ObjectPool();
+
+		inline void* Allocate(size_t size)
+		{
+			if (size > JET_POOL_MAX_SIZE)
+				return ::operator new(size);
+
+			size_t c = (size - 1)/JET_POOL_GRANULE;
+			Block* block = m_Free[c];
+			if (block == 0)
+				return this->Carve(c);
+
+			JET_POOL_UNPOISON(block, (c + 1)*JET_POOL_GRANULE);
+			m_Free[c] = block->m_Next;
+			return block;
+		}
+
+		//size must be the one the block was allocated with
+		inline void Release(void* p, size_t size)
+		{
+			if (size > JET_POOL_MAX_SIZE)
+			{
+				::operator delete(p);
+				return;
+			}
+
+			size_t c = (size - 1)/JET_POOL_GRANULE;
+			Block* block = (Block*)p;
+			block->m_Next = m_Free[c];
+			m_Free[c] = block;
+			JET_POOL_POISON(block, (c + 1)*JET_POOL_GRANULE);
+		}
+
+	private:
+		//a new block of size class c from the rest of the newest page
+		void* Carve(size_t c);
+	};
+}
+#endif
@@ -0,0 +1,130 @@
+#include "ParallelMark.h"
+
+#ifdef JET_PARALLEL_GC
+using namespace Jet;
+
+ParallelMarker::ParallelMarker(unsigned int threads) : m_Idle(0), m_Job(0), m_Generation(0), m_Running(0), m_Stop(false)
+{
+	for (unsigned int i = 0; i < threads; i++)
+		this->m_Workers.push_back(new MarkWorker(i));
+
+	//worker 0 is the thread that runs the collection
+	for (unsigned int i = 1; i < threads; i++)
+		this->m_Threads.emplace_back(&ParallelMarker::Loop, this, i);
+}
+
+ParallelMarker::~ParallelMarker()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_Lock);
+		this->m_Stop = true;
+	}
+	this->m_Start.notify_all();
+	for (auto& thread: this->m_Threads)
+		thread.join();
+
+	for (auto worker: this->m_Workers)
+		delete worker;
+}
+
+void ParallelMarker::Run(const std::function<void(unsigned int)>& job)
+{
+	this->m_Idle = 0;
+	{
+		std::lock_guard<std::mutex> lock(this->m_Lock);
+		this->m_Job = &job;
+		this->m_Running = (unsigned int)this->m_Threads.size();
+		this->m_Generation++;
+	}
+	this->m_Start.notify_all();
+
+	job(0);
+
+	std::unique_lock<std::mutex> lock(this->m_Lock);
+	this->m_Done.wait(lock, [this] { return this->m_Running == 0; });
+	this->m_Job = 0;
+}
+
+void ParallelMarker::Loop(unsigned int index)
+{
+	unsigned int generation = 0;
+	while (true)
+	{
+		const std::function<void(unsigned int)>* job;
+		{
+			std::unique_lock<std::mutex> lock(this->m_Lock);
+			this->m_Start.wait(lock, [&] { return this->m_Stop || this->m_Generation != generation; });
+			if (this->m_Stop)
+				return;
+			generation = this->m_Generation;
+			job = this->m_Job;
+		}
+
+		(*job)(index);
+
+		std::lock_guard<std::mutex> lock(this->m_Lock);
+		if (--this->m_Running == 0)
+			this->m_Done.notify_one();
+	}
+}
+
+void ParallelMarker::Share(MarkWorker& me)
+{
+	//the top half, the rest keeps me busy until someone steals it
+	unsigned int half = me.m_Greys.size()/2;
+	std::lock_guard<std::mutex> lock(me.m_Lock);
+	for (unsigned int i = me.m_Greys.size() - half; i < me.m_Greys.size(); i++)
+		me.m_Shared.push_back(me.m_Greys._data[i]);
+	me.m_Greys.QuickPop(half);
+	me.m_Available = me.m_Shared.size();
+}
+
+bool ParallelMarker::Steal(MarkWorker& me)
+{
+	//my own shared greys first, then half of those of the next worker that has some
+	unsigned int count = this->Count();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		auto& victim = *this->m_Workers[(me.m_Index + i) % count];
+		if (victim.m_Available.load(std::memory_order_relaxed) == 0)
+			continue;
+
+		std::lock_guard<std::mutex> lock(victim.m_Lock);
+		size_t n = &victim == &me ? victim.m_Shared.size() : (victim.m_Shared.size() + 1)/2;
+		for (size_t j = 0; j < n; j++)
+		{
+			me.m_Greys.Push(victim.m_Shared.front());
+			victim.m_Shared.pop_front();
+		}
+		victim.m_Available = victim.m_Shared.size();
+		if (n > 0)
+			return true;
+	}
+	return false;
+}
+
+bool ParallelMarker::Take(MarkWorker& me)
+{
+	while (this->Steal(me) == false)
+	{
+		//only a busy worker shares greys and an idle one has none left, so once all of them
+		//are idle the marking is done
+		unsigned int count = this->Count();
+		this->m_Idle++;
+		while (true)
+		{
+			if (this->m_Idle == count)
+				return false;
+
+			bool work = false;
+			for (auto worker: this->m_Workers)
+				work |= worker->m_Available.load(std::memory_order_relaxed) > 0;
+			if (work)
+				break;
+			std::this_thread::yield();
+		}
+		this->m_Idle--;
+	}
+	return true;
+}
+#endif
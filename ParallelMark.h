@@ -0,0 +1,145 @@
+#ifndef _JET_PARALLELMARK_HEADER
+#define _JET_PARALLELMARK_HEADER
+
+#include "Value.h"
+#include "VMStack.h"
+
+//gen2 collections can mark with several threads, see GarbageCollector::SetThreads.
+//There are no threads on emscripten, define JET_NO_PARALLEL_GC to leave it out elsewhere
+#if !defined(EMSCRIPTEN) && !defined(JET_NO_PARALLEL_GC)
+#define JET_PARALLEL_GC
+#endif
+
+//a marking thread with more greys than this hands some over for the others to steal
+#define JET_GC_SHARE 64
+
+#ifdef JET_PARALLEL_GC
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Jet
+{
+	//grey bits are claimed by whichever thread reaches the object first
+	inline bool GreyLoad(const bool& flag)
+	{
+#ifdef _MSC_VER
+		return *(const volatile bool*)&flag;
+#else
+		return __atomic_load_n(&flag, __ATOMIC_RELAXED);
+#endif
+	}
+
+	//true if this thread turned the flag on
+	inline bool GreyClaim(bool& flag)
+	{
+#ifdef _MSC_VER
+		return _InterlockedExchange8((volatile char*)&flag, 1) == 0;
+#else
+		return __atomic_exchange_n(&flag, true, __ATOMIC_RELAXED) == false;
+#endif
+	}
+
+	//turns on a flag that several threads may set at once
+	inline void GreyStore(bool& flag)
+	{
+#ifdef _MSC_VER
+		*(volatile bool*)&flag = true;
+#else
+		__atomic_store_n(&flag, true, __ATOMIC_RELAXED);
+#endif
+	}
+
+	/// <summary>
+	/// state of one marking thread. It works off its own grey stack without locking and puts
+	/// what the collector needs afterwards into its own lists
+	/// </summary>
+	struct MarkWorker
+	{
+		unsigned int			m_Index;
+		VMStack<Value>			m_Greys;
+		std::vector<Value>		m_Remembered;
+		std::vector<JetString*>	m_Views;
+
+		std::mutex				m_Lock;//guards m_Shared
+		std::deque<Value>		m_Shared;//greys the other threads may steal
+		std::atomic<size_t>		m_Available;//size of m_Shared, read without the lock
+
+		MarkWorker(unsigned int index) : m_Index(index), m_Available(0) {}
+
+		//pushes v if no thread got to it first, notes whether it stays in the nursery.
+		//Next to the rest of the tracing in GarbageCollector.cpp
+		void Trace(const Value& v, bool& young);
+
+		//closures on different threads can share a capture, each of them marks it
+		void MarkCapture(Capture* uv)
+		{
+			GreyStore(uv->m_Grey);
+			GreyStore(uv->m_Mark);
+		}
+	};
+
+	/// <summary>
+	/// threads that mark together. The thread running the collection is worker 0 and the others
+	/// wait in a pool between collections. A worker that runs out of greys steals half of the
+	/// ones another worker shared, marking is done once all of them are out of work
+	/// </summary>
+	class ParallelMarker
+	{
+	public:
+		ParallelMarker(unsigned int threads);
+		~ParallelMarker();
+
+		ParallelMarker(const ParallelMarker&) = delete;
+		ParallelMarker& operator=(const ParallelMarker&) = delete;
+
+		unsigned int Count() const { return (unsigned int)this->m_Workers.size(); }
+		MarkWorker& Worker(unsigned int i) { return *this->m_Workers[i]; }
+
+		//runs job on every worker at once and returns when all of them are done
+		void Run(const std::function<void(unsigned int)>& job);
+
+		//the next grey for me, false once no worker has any left
+		inline bool Next(MarkWorker& me, Value& obj)
+		{
+			if (me.m_Greys.size() == 0 && this->Take(me) == false)
+				return false;
+
+			obj = me.m_Greys.Pop();
+			if (me.m_Greys.size() > JET_GC_SHARE && me.m_Available.load(std::memory_order_relaxed) == 0)
+				this->Share(me);
+			return true;
+		}
+
+	private:
+		void Share(MarkWorker& me);
+		//refills the grey stack of me from its shared greys or another worker
+		bool Steal(MarkWorker& me);
+		//waits for work to steal, false once all workers wait
+		bool Take(MarkWorker& me);
+		void Loop(unsigned int index);
+
+		std::vector<MarkWorker*>	m_Workers;
+		std::vector<std::thread>	m_Threads;
+		std::atomic<unsigned int>	m_Idle;
+
+		std::mutex					m_Lock;
+		std::condition_variable		m_Start;
+		std::condition_variable		m_Done;
+		const std::function<void(unsigned int)>* m_Job;
+		unsigned int				m_Generation;//counts Run calls, wakes the pool
+		unsigned int				m_Running;//pool threads still in the job
+		bool						m_Stop;
+	};
+}
+#endif
+
+#endif
@@ -0,0 +1,93 @@
+#include "StringTable.h"
+#include <cstring>
+
+using namespace Jet;
+
+StringTable::StringTable()
+{
+	m_Capacity = 256;
+	m_Count = 0;
+	m_Slots = new JetString*[m_Capacity];
+	memset(m_Slots, 0, sizeof(JetString*)*m_Capacity);
+}
+
+StringTable::~StringTable()
+{
+	delete[] m_Slots;
+}
+
+JetString* StringTable::Find(const char* str, unsigned int length, unsigned int hash) const
+{
+	unsigned int mask = m_Capacity - 1;
+	for (unsigned int i = hash & mask; m_Slots[i]; i = (i + 1) & mask)
+	{
+		JetString* s = m_Slots[i];
+		if (s->m_Hash == hash && s->m_Length == length && memcmp(s->m_Data, str, length) == 0)
+			return s;
+	}
+	return 0;
+}
+
+void StringTable::Add(JetString* str)
+{
+	//keep the load under one half so probe sequences stay short
+	if ((m_Count + 1)*2 > m_Capacity)
+		this->Grow();
+
+	unsigned int mask = m_Capacity - 1;
+	unsigned int i = str->m_Hash & mask;
+	while (m_Slots[i])
+		i = (i + 1) & mask;
+	m_Slots[i] = str;
+	str->m_Interned = true;
+	m_Count++;
+}
+
+void StringTable::Remove(JetString* str)
+{
+	unsigned int mask = m_Capacity - 1;
+	unsigned int i = str->m_Hash & mask;
+	while (m_Slots[i] != str)
+	{
+		if (m_Slots[i] == 0)
+			return;
+		i = (i + 1) & mask;
+	}
+	str->m_Interned = false;
+	m_Count--;
+
+	//shift later entries of the cluster back so no lookup stops at the hole
+	for (unsigned int j = (i + 1) & mask; m_Slots[j]; j = (j + 1) & mask)
+	{
+		unsigned int home = m_Slots[j]->m_Hash & mask;
+		//move the entry unless its home lies cyclically in (i, j]
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			m_Slots[i] = m_Slots[j];
+			i = j;
+		}
+	}
+	m_Slots[i] = 0;
+}
+
+void StringTable::Grow()
+{
+	auto old = m_Slots;
+	auto capacity = m_Capacity;
+
+	m_Capacity *= 2;
+	m_Slots = new JetString*[m_Capacity];
+	memset(m_Slots, 0, sizeof(JetString*)*m_Capacity);
+
+	unsigned int mask = m_Capacity - 1;
+	for (unsigned int i = 0; i < capacity; i++)
+	{
+		if (old[i] == 0)
+			continue;
+		unsigned int j = old[i]->m_Hash & mask;
+		while (m_Slots[j])
+			j = (j + 1) & mask;
+		m_Slots[j] = old[i];
+	}
+	delete[] old;
+}
@@ -0,0 +1,46 @@
+#ifndef _JET_STRINGTABLE_HEADER
+#define _JET_STRINGTABLE_HEADER
+
+#include "Value.h"
+
+namespace Jet
+{
+	//djb2 over the characters, cached in JetString::m_Hash
+	inline unsigned int StringHash(const char* str, unsigned int length)
+	{
+		unsigned int hash = 5381;
+		for (unsigned int i = 0; i < length; i++)
+			hash = ((hash << 5) + hash) + (unsigned char)str[i];
+		return hash;
+	}
+
+	/// <summary>
+	/// intern table of a context, holds at most one string per content.
+	/// Open addressing with linear probing; it does not keep its strings alive,
+	/// the GC removes them when they are freed
+	/// </summary>
+	class StringTable
+	{
+		JetString**		m_Slots;
+		unsigned int	m_Capacity;	//power of two
+		unsigned int	m_Count;
+	public:
+		StringTable();
+		~StringTable();
+
+		//the interned string with this content, or null
+		JetString* Find(const char* str, unsigned int length, unsigned int hash) const;
+
+		//adds a string whose content is not in the table yet and marks it interned
+		void Add(JetString* str);
+
+		//takes an interned string out again
+		void Remove(JetString* str);
+
+		unsigned int Size() const { return m_Count; }
+
+	private:
+		void Grow();
+	};
+}
+#endif
@@ -0,0 +1,107 @@
+#include "VMStack.h"
+
+#if defined(EMSCRIPTEN)
+#include <cstdlib>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace Jet;
+
+#if defined(EMSCRIPTEN)
+//no virtual memory, the whole reservation is allocated at once
+
+size_t StackMemory::PageSize()
+{
+	return 4096;
+}
+
+void* StackMemory::Reserve(size_t bytes)
+{
+	return malloc(bytes);
+}
+
+bool StackMemory::Commit(void* p, size_t bytes)
+{
+	return true;
+}
+
+void StackMemory::Decommit(void* p, size_t bytes)
+{
+}
+
+void StackMemory::Release(void* p, size_t bytes)
+{
+	free(p);
+}
+
+#elif defined(_WIN32)
+
+size_t StackMemory::PageSize()
+{
+	static size_t size = 0;
+	if (size == 0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		size = info.dwPageSize;
+	}
+	return size;
+}
+
+void* StackMemory::Reserve(size_t bytes)
+{
+	return VirtualAlloc(0, bytes, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool StackMemory::Commit(void* p, size_t bytes)
+{
+	return VirtualAlloc(p, bytes, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+
+void StackMemory::Decommit(void* p, size_t bytes)
+{
+	VirtualFree(p, bytes, MEM_DECOMMIT);
+}
+
+void StackMemory::Release(void* p, size_t bytes)
+{
+	VirtualFree(p, 0, MEM_RELEASE);
+}
+
+#else
+
+size_t StackMemory::PageSize()
+{
+	static size_t size = (size_t)sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+void* StackMemory::Reserve(size_t bytes)
+{
+	void* p = mmap(0, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return p == MAP_FAILED ? 0 : p;
+}
+
+bool StackMemory::Commit(void* p, size_t bytes)
+{
+	return mprotect(p, bytes, PROT_READ | PROT_WRITE) == 0;
+}
+
+void StackMemory::Decommit(void* p, size_t bytes)
+{
+	//drop the pages and make the range inaccessible again
+	madvise(p, bytes, MADV_DONTNEED);
+	mprotect(p, bytes, PROT_NONE);
+}
+
+void StackMemory::Release(void* p, size_t bytes)
+{
+	munmap(p, bytes);
+}
+
+#endif
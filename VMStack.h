@@ -3,6 +3,8 @@
 #define _VMSTACK
 
 #include "JetExceptions.h"
+#include <new>
+#include <cstddef>
 
 namespace Jet
 {
@@ -96,11 +98,200 @@ namespace Jet
 			v= _data[_size - 1];
 		}
 
+		//grows when full, the collector can have any number of grey objects waiting
 		void Push(const T& item)
 		{
 			if (_size >= _max)
+				this->Grow();
+
+			_data[_size++] = item;
+		}
+
+		void Grow()
+		{
+			T* data = new T[_max*2];
+			for (unsigned int i = 0; i < _size; i++)
+				data[i] = _data[i];
+			delete[] _data;
+			_data = data;
+			_max *= 2;
+		}
+
+		unsigned int size() const
+		{
+			return _size;
+		}
+	};
+
+	//virtual memory for VMReservedStack, see VMStack.cpp
+	namespace StackMemory
+	{
+		size_t PageSize();
+		//reserves address space without backing it, returns null on failure
+		void* Reserve(size_t bytes);
+		bool Commit(void* p, size_t bytes);
+		void Decommit(void* p, size_t bytes);
+		void Release(void* p, size_t bytes);
+	}
+
+	//stack that reserves address space for max elements up front and only commits memory as
+	//it grows, so the elements never move. The page after the reservation is never committed
+	//and acts as a guard page. Push does no bounds check: the VM makes room for a whole frame
+	//with EnsureCapacity/Reserve when it enters the frame
+	template<class T>
+	class VMReservedStack
+	{
+		const char* overflow_error;
+		unsigned int _max;
+		size_t _committedbytes;
+		size_t _reservedbytes;//guard page included
+
+		static size_t Chunk()
+		{
+			//commit in 64k steps to keep the number of system calls down
+			size_t page = StackMemory::PageSize();
+			return page > 65536 ? page : 65536 / page * page;
+		}
+
+		void Commit(size_t bytes)
+		{
+			if (bytes <= _committedbytes)
+				return;
+			if (StackMemory::Commit((char*)_data + _committedbytes, bytes - _committedbytes) == false)
+				throw RuntimeException("Could not commit stack memory");
+			unsigned int count = (unsigned int)(bytes / sizeof(T));
+			if (count > _max)
+				count = _max;
+			for (unsigned int i = _committed; i < count; i++)
+				new (&_data[i]) T();
+			_committed = count;
+			_committedbytes = bytes;
+		}
+
+	public:
+		T*	_data = nullptr;
+		unsigned int _size;
+		unsigned int _committed;//number of elements backed by memory, compiled code checks it for room
+
+		VMReservedStack(unsigned int max, const char* error = "Stack Overflow")
+		{
+			size_t page = StackMemory::PageSize();
+			overflow_error = error;
+			_size = 0;
+			_max = max;
+			_committed = 0;
+			_committedbytes = 0;
+			_reservedbytes = ((size_t)max * sizeof(T) + page - 1) / page * page + page;
+			_data = (T*)StackMemory::Reserve(_reservedbytes);
+			if (_data == nullptr)
+				throw RuntimeException("Could not reserve stack memory");
+			this->Grow(1);
+		}
+
+		~VMReservedStack()
+		{
+			for (unsigned int i = 0; i < _committed; i++)
+				_data[i].~T();
+			StackMemory::Release(_data, _reservedbytes);
+		}
+
+		VMReservedStack(const VMReservedStack&) = delete;
+		VMReservedStack& operator=(const VMReservedStack&) = delete;
+
+		//makes sure the elements below end are committed
+		inline void EnsureCapacity(unsigned int end)
+		{
+			if (end > _committed)
+				this->Grow(end);
+		}
+
+		//room for count more pushes
+		inline void Reserve(unsigned int count)
+		{
+			this->EnsureCapacity(_size + count);
+		}
+
+		void Grow(unsigned int end)
+		{
+			if (end > _max)
 				throw RuntimeException(overflow_error);
 
+			//at least double the committed part
+			size_t want = (size_t)end;
+			if (want < (size_t)_committed * 2)
+				want = (size_t)_committed * 2;
+			if (want > _max)
+				want = _max;
+
+			size_t chunk = Chunk();
+			size_t bytes = (want * sizeof(T) + chunk - 1) / chunk * chunk;
+			size_t limit = _reservedbytes - StackMemory::PageSize();
+			if (bytes > limit)
+				bytes = limit;
+			this->Commit(bytes);
+		}
+
+		//gives back the memory above the top of the stack, keeping at least keep elements
+		void Shrink(unsigned int keep)
+		{
+			size_t need = _size > keep ? _size : keep;
+			size_t chunk = Chunk();
+			size_t bytes = (need * sizeof(T) + chunk - 1) / chunk * chunk;
+			if (bytes >= _committedbytes)
+				return;
+
+			unsigned int count = (unsigned int)(bytes / sizeof(T));
+			for (unsigned int i = count; i < _committed; i++)
+				_data[i].~T();
+			StackMemory::Decommit((char*)_data + bytes, _committedbytes - bytes);
+			_committed = count;
+			_committedbytes = bytes;
+		}
+
+		unsigned int capacity() const
+		{
+			return _committed;
+		}
+
+		T Pop()
+		{
+			if (_size == 0)
+				throw RuntimeException("Tried to pop empty stack!");
+			return _data[--_size];
+		}
+
+		void Pop(T& v)
+		{
+			if (_size == 0)
+				throw RuntimeException("Tried to pop empty stack!");
+			v = _data[--_size];
+		}
+
+		inline void QuickPop(unsigned int times = 1)
+		{
+			_size -= times;
+		}
+
+		T& operator[](unsigned int pos)
+		{
+			if (pos >= this->_committed)
+				throw RuntimeException("Bad Stack Index");
+
+			return _data[pos];
+		}
+
+		T& Peek(int offset=0)
+		{
+			return _data[_size - 1-offset];
+		}
+
+		void Peek(T& v) const
+		{
+			v = _data[_size - 1];
+		}
+
+		inline void Push(const T& item)
+		{
 			_data[_size++] = item;
 		}
 
@@ -116,6 +307,6 @@ namespace Jet
 #define vmstack_pop(stack) --stack._size
 #define vmstack_popn(stack,n) stack._size-=n
 #define vmstack_push(stack,v) stack._data[stack._size++] = v
-#define vmstack_push_top(stack) stack._data[stack._size++] = stack._data[stack._size - 1];
+#define vmstack_push_top(stack) do { auto _top = stack._data[stack._size - 1]; stack._data[stack._size++] = _top; } while (0)
 }
 #endif
\ No newline at end of file
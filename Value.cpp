@@ -4,6 +4,8 @@
 using namespace Jet;
 #undef Yield
 
+const char* Jet::MetamethodNames[(int)Metamethod::Count] = { "_add", "_sub", "_mul", "_div", "_mod", "_bor", "_band", "_xor", "_ls", "_rs", "_or", "_and", "_bnot", "_neg", "_cmp", "_incr", "_decr", "_call", "_gc" };
+
 Generator::Generator(JetContext* context, Closure* closure, unsigned int args)
 {
 	m_State = GeneratorState::Suspended;
@@ -25,15 +27,15 @@ Generator::Generator(JetContext* context, Closure* closure, unsigned int args)
 	}
 	else if (closure->m_Prototype->m_VarArg)
 	{
-		m_Stack[closure->m_Prototype->m_Locals-1] = context->CreateNewArray();
-		auto arr = &m_Stack[closure->m_Prototype->m_Locals-1].m_Array->m_Data;
+		m_Stack[closure->m_Prototype->m_Args] = context->CreateNewArray();
+		auto arr = &m_Stack[closure->m_Prototype->m_Args].m_Array->m_Data;
 		arr->resize(args - closure->m_Prototype->m_Args);
 		for (int i = (int)args - 1; i >= 0; i--)
 		{
 			if (i < (int)closure->m_Prototype->m_Args)
 				context->m_Stack.Pop(m_Stack[i]);
 			else
-				context->m_Stack.Pop((*arr)[i]);
+				context->m_Stack.Pop((*arr)[i - closure->m_Prototype->m_Args]);
 		}
 	}
 	else
@@ -61,6 +63,7 @@ void Generator::Yield(JetContext* m_Context, unsigned int iptr)
 	//store stack
 	for (unsigned int i = 0; i < this->m_Closure->m_Prototype->m_Locals; i++)
 		this->m_Stack[i] = m_Context->m_SP[i];
+	m_Context->m_GC.Barrier(Value(this->m_Closure));
 }
 
 unsigned int Generator::Resume(JetContext* context)
@@ -72,12 +75,22 @@ unsigned int Generator::Resume(JetContext* context)
 
 	this->m_State = GeneratorState::Running;
 
+	//the frame starts where the caller pushed the value to resume with
+	auto prototype = this->m_Closure->m_Prototype;
+	unsigned int base = context->m_Stack.size() - 1;
+	Value in = context->m_Stack._data[base];
+	context->m_Stack.EnsureCapacity(base + prototype->m_Locals + prototype->m_MaxStack + 1);
+
 	//restore stack
-	for (unsigned int i = 0; i < this->m_Closure->m_Prototype->m_Locals; i++)
-		context->m_SP[i] = this->m_Stack[i];
+	Value* sp = &context->m_Stack._data[base];
+	for (unsigned int i = 0; i < prototype->m_Locals; i++)
+		sp[i] = this->m_Stack[i];
+	context->m_Stack._size = base + prototype->m_Locals;
+	context->m_SP = sp;
 
-	if (this->m_CurrentIPtr == 0)
-		context->m_Stack.Pop();
+	//a suspended generator continues after its yield, which evaluates to the value passed in
+	if (this->m_CurrentIPtr != 0)
+		context->m_Stack.Push(in);
 
 	return this->m_CurrentIPtr;
 }
@@ -99,7 +112,6 @@ Value::Value(JetString* str)
 		return;
 
 	m_Type = ValueType::String;
-	m_Length = (unsigned int)strlen(str->m_Data);
 	m_String = str;
 }
 
@@ -271,17 +283,17 @@ std::string Value::ToString(int depth) const
 	case ValueType::Real:
 		return std::to_string(this->m_RealValue);
 	case ValueType::String:
-		return this->m_String->m_Data;
+		return std::string(Flatten(this->m_String)->m_Data, this->m_String->m_Length);
 	case ValueType::Function:
-		return "[Function "+this->m_Function->m_Prototype->m_Name+" " + std::to_string((unsigned int)this->m_Function)+"]";
+		return "[Function "+this->m_Function->m_Prototype->m_Name+" " + std::to_string((size_t)(Closure*)this->m_Function)+"]";
 	case ValueType::NativeFunction:
-		return "[NativeFunction "+std::to_string((unsigned int)this->m_Function)+"]";
+		return "[NativeFunction "+std::to_string((size_t)(Closure*)this->m_Function)+"]";
 	case ValueType::Array:
 		{
 			std::string str = "[\n";
 
 			if (depth++ > 3)
-				return "[Array " + std::to_string((int)this->m_Array)+"]";
+				return "[Array " + std::to_string((size_t)(JetArray*)this->m_Array)+"]";
 
 			int i = 0;
 			for (auto ii: this->m_Array->m_Data)
@@ -299,7 +311,7 @@ std::string Value::ToString(int depth) const
 			std::string str = "{\n";
 
 			if (depth++ > 3)
-				return "[Object " + std::to_string((int)this->m_Object)+"]";
+				return "[Object " + std::to_string((size_t)(JetObject*)this->m_Object)+"]";
 
 			for (auto ii: *this->m_Object)
 			{
@@ -313,7 +325,7 @@ std::string Value::ToString(int depth) const
 		}
 	case ValueType::Userdata:
 		{
-			return "[Userdata "+std::to_string((int)this->m_UserData)+"]";
+			return "[Userdata "+std::to_string((size_t)(JetUserdata*)this->m_UserData)+"]";
 		}
 	default:
 		return "";
@@ -325,84 +337,46 @@ void Value::SetPrototype(JetObject* obj)
 	switch (this->m_Type)
 	{
 	case ValueType::Object:
-		this->m_Object->m_Prototype = obj;
+		this->m_Object->SetPrototype(obj);
+		break;
 	case ValueType::Userdata:
 		this->m_UserData->m_Prototype = obj;
+		if (obj)
+			obj->m_Context->m_GC.Barrier(*this);
+		break;
 	default:
 		throw RuntimeException("Cannot set prototype of non-object or non-userdata!");
 	}
 }
 
-Value Value::CallMetamethod(JetObject* table, const char* name, const Value* other)
+Value Value::CallMetamethod(JetObject* table, Metamethod method, const Value* other)
 {
-	auto node = table->m_Prototype->findNode(name);
-	if (node == 0)
-	{
-		auto obj = table->m_Prototype;
-		while(obj)
-		{
-			node = obj->findNode(name);
-			if (node)
-				break;
-			obj = obj->m_Prototype;
-		}
-	}
-
-	if (node)
+	auto proto = table->m_Prototype;
+	auto value = proto ? proto->GetMetamethod(method) : 0;
+	if (value)
 	{
 		Value args[2];
 		args[0] = *this;
 		if (other)
 			args[1] = *other;
-		return table->m_Prototype->m_Context->Call(&node->second, (Value*)&args, other ? 2 : 1);
+		//the table could be looked up again during the call
+		Value fun = *value;
+		return proto->m_Context->Call(&fun, (Value*)&args, other ? 2 : 1);
 	}
 
-	throw RuntimeException("Cannot " + (std::string)(name+1) + " two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[(int)other->m_Type]);
+	throw RuntimeException("Cannot " + (std::string)(MetamethodNames[(int)method]+1) + " two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[other ? (int)other->m_Type : 0]);
 }
 
-Value Value::CallMetamethod(const char* name, const Value* other)
+Value Value::CallMetamethod(Metamethod method, const Value* other)
 {
-	auto node = this->m_Object->m_Prototype->findNode(name);
-	if (node == 0)
-	{
-		auto obj = this->m_Object->m_Prototype;
-		while(obj)
-		{
-			node = obj->findNode(name);
-			if (node)
-				break;
-			obj = obj->m_Prototype;
-		}
-	}
-
-	if (node)
-	{
-		Value args[2];
-		args[0] = *this;
-		if (other)
-			args[1] = *other;
-		return this->m_Object->m_Prototype->m_Context->Call(&node->second, (Value*)&args, other ? 2 : 1);
-	}
-
-	throw RuntimeException("Cannot " + (std::string)(name+1) + " two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[(int)other->m_Type]);
+	return this->CallMetamethod(this->m_Object, method, other);
 }
 
-bool Value::TryCallMetamethod(const char* name, const Value* iargs, int numargs, Value* out) const
+bool Value::TryCallMetamethod(Metamethod method, const Value* iargs, int numargs, Value* out) const
 {
-	auto node = this->m_Object->m_Prototype->findNode(name);
-	if (node == 0)
-	{
-		auto obj = this->m_Object->m_Prototype;
-		while(obj)
-		{
-			node = obj->findNode(name);
-			if (node)
-				break;
-			obj = obj->m_Prototype;
-		}
-	}
-
-	if (node)
+	auto proto = this->m_Object->m_Prototype;
+	auto value = proto ? proto->GetMetamethod(method) : 0;
+	if (value)
 	{
 		//fix this not working with arguments > 1
 		Value* args = (Value*)alloca(sizeof(Value)*(numargs+1));
@@ -412,7 +386,8 @@ bool Value::TryCallMetamethod(const char* name, const Value* iargs, int numargs,
 			args[i] = iargs[i];
 
 		//help, calling this derps up curframe
-		*out = this->m_Object->m_Prototype->m_Context->Call(&node->second, args, numargs+1);
+		Value fun = *value;
+		*out = proto->m_Context->Call(&fun, args, numargs+1);
 		return true;
 	}
 	return false;
@@ -455,7 +430,23 @@ bool Value::operator== (const Value& other) const
 	case ValueType::NativeFunction:
 		return other.m_NativeFunction == this->m_NativeFunction;
 	case ValueType::String:
-		return strcmp(other.m_String->m_Data, this->m_String->m_Data) == 0;
+		{
+			//interned strings are unique by content, others compare the cached hash first
+			JetString* a = this->m_String;
+			JetString* b = other.m_String;
+			if (a == b)
+				return true;
+			if (a->m_Interned && b->m_Interned)
+				return false;
+			if (a->m_Length != b->m_Length)
+				return false;
+			Flatten(a);
+			Flatten(b);
+			//views are not hashed until they need to be
+			if (a->m_Hashed && b->m_Hashed && a->m_Hash != b->m_Hash)
+				return false;
+			return memcmp(a->m_Data, b->m_Data, a->m_Length) == 0;
+		}
 	case ValueType::Null:
 		return true;
 	case ValueType::Object:
@@ -471,6 +462,7 @@ Value& Value::operator[] (int64_t key)
 	switch (m_Type)
 	{
 	case ValueType::Array:
+		this->m_Array->m_Context->m_GC.Barrier(this->m_Array, (unsigned int)key);
 		return this->m_Array->m_Data[(size_t)key];
 	case ValueType::Object:
 		return (*this->m_Object)[key];
@@ -498,6 +490,7 @@ Value& Value::operator[] (const Value& key)
 	{
 	case ValueType::Array:
 		{
+			this->m_Array->m_Context->m_GC.Barrier(this->m_Array, (unsigned int)key.m_RealValue);
 			return this->m_Array->m_Data[(int)key.m_RealValue];
 		}
 	case ValueType::Object:
@@ -521,7 +514,7 @@ Value Value::operator+( const Value &other )
 		else if (other.m_Type == ValueType::String)
 		{
 			if (other.m_String->m_Context == nullptr) return *this;
-			std::string str = this->ToString() + std::string(other.m_String->m_Data);
+			std::string str = this->ToString() + std::string(Flatten(other.m_String)->m_Data, other.m_String->m_Length);
 			return other.m_String->m_Context->CreateNewString(str.c_str(), true);
 		}
 		break;
@@ -533,24 +526,22 @@ Value Value::operator+( const Value &other )
 		else if (other.m_Type == ValueType::String)
 		{
 			if (other.m_String->m_Context == nullptr) return *this;
-			std::string str = this->ToString() + std::string(other.m_String->m_Data);
+			std::string str = this->ToString() + std::string(Flatten(other.m_String)->m_Data, other.m_String->m_Length);
 			return other.m_String->m_Context->CreateNewString(str.c_str(), true);
 		}
 		break;
 	case ValueType::String:
 	{
 		if (this->m_String->m_Context == nullptr) return *this;
-		std::string str = std::string(this->m_String->m_Data) + other.ToString();
-		return this->m_String->m_Context->CreateNewString(str.c_str(), true);
-		break;
+		return this->m_String->m_Context->Concat(*this, other);
 	}
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_add", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Add, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_add", &other);
+			return this->CallMetamethod(Metamethod::Add, &other);
 		//throw JetRuntimeException("Cannot Add A String");
 		//if (other.type == ValueType::String)
 		//return Value((std::string(other.string.data) + std::string(this->string.data)).c_str());
@@ -579,11 +570,11 @@ Value Value::operator-( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_sub", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Sub, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_sub", &other);
+			return this->CallMetamethod(Metamethod::Sub, &other);
 		break;
 	}
 
@@ -608,11 +599,11 @@ Value Value::operator*( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_mul", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Mul, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_mul", &other);
+			return this->CallMetamethod(Metamethod::Mul, &other);
 		break;
 	}
 
@@ -637,11 +628,11 @@ Value Value::operator/( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_div", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Div, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_div", &other);
+			return this->CallMetamethod(Metamethod::Div, &other);
 		break;
 	}
 
@@ -674,11 +665,11 @@ Value Value::operator%( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_mod", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Mod, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_mod", &other);
+			return this->CallMetamethod(Metamethod::Mod, &other);
 		break;
 	}
 
@@ -703,11 +694,11 @@ Value Value::operator|( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_bor", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Bor, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_bor", &other);
+			return this->CallMetamethod(Metamethod::Bor, &other);
 		break;
 	}
 
@@ -732,11 +723,11 @@ Value Value::operator&( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_band", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Band, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_band", &other);
+			return this->CallMetamethod(Metamethod::Band, &other);
 		break;
 	}
 
@@ -761,11 +752,11 @@ Value Value::operator^( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_xor", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Xor, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_xor", &other);
+			return this->CallMetamethod(Metamethod::Xor, &other);
 		break;
 	}
 
@@ -790,11 +781,11 @@ Value Value::operator<<( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_ls", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Ls, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_ls", &other);
+			return this->CallMetamethod(Metamethod::Ls, &other);
 		break;
 	}
 
@@ -819,11 +810,11 @@ Value Value::operator>>( const Value &other )
 		break;
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_rs", &other);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Rs, &other);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_rs", &other);
+			return this->CallMetamethod(Metamethod::Rs, &other);
 		break;
 	}
 
@@ -841,8 +832,9 @@ void Value::operator+=(const Value &other)
 			{
 				case ValueType::Real:
 				{
+					double a = (double)m_IntValue;
 					m_Type = ValueType::Real;
-					m_RealValue = (double)m_IntValue + other.m_RealValue;
+					m_RealValue = a + other.m_RealValue;
 					return;
 				}
 				case ValueType::Int:
@@ -853,7 +845,7 @@ void Value::operator+=(const Value &other)
 				case ValueType::String:
 				{
 					if (other.m_String->m_Context == nullptr) return;
-					std::string str = this->ToString() + std::string(other.m_String->m_Data);
+					std::string str = this->ToString() + std::string(Flatten(other.m_String)->m_Data, other.m_String->m_Length);
 					m_Type = ValueType::String;
 					*this = other.m_String->m_Context->CreateNewString(str.c_str(), true);
 					return;
@@ -878,7 +870,7 @@ void Value::operator+=(const Value &other)
 				case ValueType::String:
 				{
 					if (other.m_String->m_Context == nullptr) return;
-					std::string str = this->ToString() + std::string(other.m_String->m_Data);
+					std::string str = this->ToString() + std::string(Flatten(other.m_String)->m_Data, other.m_String->m_Length);
 					*this = other.m_String->m_Context->CreateNewString(str.c_str(), true);
 					return;
 				}
@@ -888,16 +880,14 @@ void Value::operator+=(const Value &other)
 		case ValueType::String:
 		{
 			if (this->m_String->m_Context == nullptr) return;
-			std::string str = std::string(this->m_String->m_Data) + other.ToString();
-			*this = this->m_String->m_Context->CreateNewString(str.c_str(), true);
+			*this = this->m_String->m_Context->Concat(*this, other);
 			return;
-			break;
 		}
 		case ValueType::Userdata:
 		{
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_add", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Add, &other);
 				return;
 			}
 			break;
@@ -906,10 +896,13 @@ void Value::operator+=(const Value &other)
 		{
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_add", &other);
+				*this = this->CallMetamethod(Metamethod::Add, &other);
 				return;
 			}
+			break;
 		}
+		default:
+			break;
 	}
 
 	throw RuntimeException("Cannot add two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[(int)other.m_Type]);
@@ -923,8 +916,9 @@ void Value::operator-=(const Value &other)
 		{
 			if (other.m_Type == ValueType::Real)
 			{
+				double a = (double)m_IntValue;
 				m_Type = ValueType::Real;
-				m_RealValue = (double)m_IntValue - other.m_RealValue;
+				m_RealValue = a - other.m_RealValue;
 				return;
 			}
 			else if (other.m_Type == ValueType::Int)
@@ -943,7 +937,7 @@ void Value::operator-=(const Value &other)
 			}
 			else if (other.m_Type == ValueType::Int)
 			{
-				m_RealValue -= (double)other.m_RealValue;
+				m_RealValue -= (double)other.m_IntValue;
 				return;
 			}
 			break;
@@ -952,7 +946,7 @@ void Value::operator-=(const Value &other)
 		{
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_sub", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Sub, &other);
 				return;
 			}
 			break;
@@ -961,11 +955,13 @@ void Value::operator-=(const Value &other)
 		{
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_sub", &other);
+				*this = this->CallMetamethod(Metamethod::Sub, &other);
 				return;
 			}
 			break;
 		}
+		default:
+			break;
 	}
 
 	throw RuntimeException("Cannot subtract two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[(int)other.m_Type]);
@@ -978,8 +974,9 @@ void Value::operator*=(const Value &other)
 		case ValueType::Int:
 			if (other.m_Type == ValueType::Real)
 			{
+				double a = (double)m_IntValue;
 				m_Type = ValueType::Real;
-				m_RealValue = (double)m_IntValue * other.m_RealValue;
+				m_RealValue = a * other.m_RealValue;
 				return;
 			}
 			else if (other.m_Type == ValueType::Int)
@@ -996,24 +993,26 @@ void Value::operator*=(const Value &other)
 			}
 			else if (other.m_Type == ValueType::Int)
 			{
-				m_RealValue *= (double)other.m_RealValue;
+				m_RealValue *= (double)other.m_IntValue;
 				return;
 			}
 			break;
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_mul", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Mul, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_mul", &other);
+				*this = this->CallMetamethod(Metamethod::Mul, &other);
 				return;
 			}
 			break;
+		default:
+			break;
 	}
 
 	throw RuntimeException("Cannot multiply two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[(int)other.m_Type]);
@@ -1026,8 +1025,9 @@ void Value::operator/=(const Value &other)
 		case ValueType::Int:
 			if (other.m_Type == ValueType::Real)
 			{
+				double a = (double)m_IntValue;
 				m_Type = ValueType::Real;
-				m_RealValue = (double)m_IntValue / other.m_RealValue;
+				m_RealValue = a / other.m_RealValue;
 				return;
 			}
 			else if (other.m_Type == ValueType::Int)
@@ -1044,24 +1044,26 @@ void Value::operator/=(const Value &other)
 			}
 			else if (other.m_Type == ValueType::Int)
 			{
-				m_RealValue /= (double)other.m_RealValue;
+				m_RealValue /= (double)other.m_IntValue;
 				return;
 			}
 			break;
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_div", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Div, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_div", &other);
+				*this = this->CallMetamethod(Metamethod::Div, &other);
 				return;
 			}
 			break;
+		default:
+			break;
 	}
 
 	throw RuntimeException("Cannot divide two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[(int)other.m_Type]);
@@ -1074,8 +1076,9 @@ void Value::operator%=(const Value &other)
 		case ValueType::Int:
 			if (other.m_Type == ValueType::Real)
 			{
+				double a = (double)m_IntValue;
 				m_Type = ValueType::Real;
-				m_RealValue = fmod((double)m_IntValue, other.m_RealValue);
+				m_RealValue = fmod(a, other.m_RealValue);
 				return;
 			}
 			else if (other.m_Type == ValueType::Int)
@@ -1099,17 +1102,19 @@ void Value::operator%=(const Value &other)
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_mod", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Mod, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_mod", &other);
+				*this = this->CallMetamethod(Metamethod::Mod, &other);
 				return;
 			}
 			break;
+		default:
+			break;
 	}
 
 	throw RuntimeException("Cannot modulus two non-numeric types! " + (std::string)ValueTypes[(int)this->m_Type] + " and " + (std::string)ValueTypes[(int)other.m_Type]);
@@ -1148,14 +1153,14 @@ void Value::operator|=(const Value &other)
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_or", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Or, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_or", &other);
+				*this = this->CallMetamethod(Metamethod::Or, &other);
 				return;
 			}
 			break;
@@ -1197,14 +1202,14 @@ void Value::operator&=(const Value &other)
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_and", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::And, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_and", &other);
+				*this = this->CallMetamethod(Metamethod::And, &other);
 				return;
 			}
 			break;
@@ -1246,14 +1251,14 @@ void Value::operator^=(const Value &other)
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_xor", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Xor, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_xor", &other);
+				*this = this->CallMetamethod(Metamethod::Xor, &other);
 				return;
 			}
 			break;
@@ -1295,14 +1300,14 @@ void Value::operator<<=(const Value &other)
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_ls", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Ls, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_ls", &other);
+				*this = this->CallMetamethod(Metamethod::Ls, &other);
 				return;
 			}
 			break;
@@ -1344,14 +1349,14 @@ void Value::operator>>=(const Value &other)
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_rs", &other);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Rs, &other);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_rs", &other);
+				*this = this->CallMetamethod(Metamethod::Rs, &other);
 				return;
 			}
 			break;
@@ -1370,11 +1375,11 @@ Value Value::operator~()
 		return Value(~(int64_t)m_RealValue);
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_bnot", 0);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Bnot, 0);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_bnot", 0);
+			return this->CallMetamethod(Metamethod::Bnot, 0);
 		break;
 	}
 
@@ -1391,11 +1396,11 @@ Value Value::operator-()
 		return Value(-m_RealValue);
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
-			return this->CallMetamethod(this->m_UserData->m_Prototype, "_neg", 0);
+			return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Neg, 0);
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
-			return this->CallMetamethod("_neg", 0);
+			return this->CallMetamethod(Metamethod::Neg, 0);
 		break;
 	}
 
@@ -1426,8 +1431,8 @@ int64_t Jet::Value::Compare(const Value& o)
 		{
 			if (o.m_Type == ValueType::String)
 			{
-				if (o.m_String->m_Data == m_String->m_Data) return 0;
-				return strcmp(o.m_String->m_Data, this->m_String->m_Data);
+				if (o.m_String == m_String) return 0;
+				return strcmp(Terminate(o.m_String)->m_Data, Terminate(this->m_String)->m_Data);
 			}
 		}
 		case ValueType::Null:
@@ -1440,7 +1445,7 @@ int64_t Jet::Value::Compare(const Value& o)
 			if (this->m_UserData->m_Prototype)
 			{
 				if (o.m_Type == ValueType::Userdata && this->m_UserData == o.m_UserData) return 0;
-				return this->CallMetamethod(this->m_UserData->m_Prototype, "_cmp", &o).m_IntValue;
+				return this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Cmp, &o).m_IntValue;
 			}				
 			break;
 		}
@@ -1449,14 +1454,14 @@ int64_t Jet::Value::Compare(const Value& o)
 			if (this->m_Object->m_Prototype)
 			{
 				if (o.m_Type == ValueType::Object &&this->m_Object == o.m_Object) return 0;
-				return this->CallMetamethod("_cmp", &o).m_IntValue;
+				return this->CallMetamethod(Metamethod::Cmp, &o).m_IntValue;
 			}
 			break;
 		}
 		default:
 		{
 			if (o.m_Type == ValueType::Null) return 1;
-			if (o.m_Type == m_Type) return ((int64_t)o.m_Array - (int64_t)this->m_Array);
+			if (o.m_Type == m_Type) return ((int64_t)(JetArray*)o.m_Array - (int64_t)(JetArray*)this->m_Array);
 			break;
 		}
 	}
@@ -1477,14 +1482,14 @@ void Jet::Value::Negate()
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_neg", 0);
+				*this = this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Neg, 0);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_neg", 0);
+				*this = this->CallMetamethod(Metamethod::Neg, 0);
 				return;
 			}
 			break;
@@ -1506,14 +1511,14 @@ void Jet::Value::Increase()
 		case ValueType::Userdata:
 			if (this->m_UserData->m_Prototype)
 			{
-				this->CallMetamethod(this->m_UserData->m_Prototype, "_incr", 0);
+				this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Incr, 0);
 				return;
 			}
 			break;
 		case ValueType::Object:
 			if (this->m_Object->m_Prototype)
 			{
-				this->CallMetamethod("_incr", 0);
+				this->CallMetamethod(Metamethod::Incr, 0);
 				return;
 			}
 			break;
@@ -1539,14 +1544,14 @@ void Jet::Value::Decrease()
 	case ValueType::Userdata:
 		if (this->m_UserData->m_Prototype)
 		{
-			this->CallMetamethod(this->m_UserData->m_Prototype, "_decr", 0);
+			this->CallMetamethod(this->m_UserData->m_Prototype, Metamethod::Decr, 0);
 			return;
 		}
 		break;
 	case ValueType::Object:
 		if (this->m_Object->m_Prototype)
 		{
-			this->CallMetamethod("_decr", 0);
+			this->CallMetamethod(Metamethod::Decr, 0);
 			return;
 		}
 		break;
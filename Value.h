@@ -10,6 +10,14 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <cstring>
+#include <cstdint>
+
+//Value is a type tag plus an 8 byte union (16 bytes). Define JET_NAN_BOXING to pack every
+//value into one 8 byte word instead: reals are stored as plain doubles, everything else in
+//the payload of a NaN. Ints are then limited to 48 bits and become reals when they overflow,
+//pointers must fit in 48 bits (true for x64 user space)
+//#define JET_NAN_BOXING
 
 #undef Yield
 
@@ -19,9 +27,13 @@ namespace Jet
 	struct	Function;
 	struct	Capture;
 	class	JetObject;
+	struct	ObjNode;
+	struct	Shape;
 	struct	Generator;
 	class	JetContext;	
 	class	GarbageCollector;
+	struct	JitCode;
+	class	JetJit;
 
 	/// <summary>
 	/// ֵ
@@ -46,6 +58,38 @@ namespace Jet
 	/// ͵
 	/// </summary>
 	static const char* ValueTypes[] = { "Null", "Int", "Real", "NativeFunction", "String", "Object", "Array", "Function", "Userdata" };
+
+	/// <summary>
+	/// Ԫԭ»߿ͷЩ
+	/// </summary>
+	enum class Metamethod:char
+	{
+		Add = 0,
+		Sub,
+		Mul,
+		Div,
+		Mod,
+		Bor,
+		Band,
+		Xor,
+		Ls,
+		Rs,
+		Or,
+		And,
+		Bnot,
+		Neg,
+		Cmp,
+		Incr,
+		Decr,
+		Call,
+		Gc,
+		Count,
+	};
+
+	/// <summary>
+	/// Ԫļ
+	/// </summary>
+	extern const char* MetamethodNames[(int)Metamethod::Count];
 	
 	/// <summary>
 	/// GCֵ
@@ -56,9 +100,18 @@ namespace Jet
 		bool		m_Mark;
 		bool		m_Grey;
 		ValueType	m_Type;
-		int			m_RefCount;	//used for native functions
+		unsigned char	m_RefCount;	//must match GarbageCollector::gcval
+		unsigned char	m_Age;
+		unsigned int	m_Length;	//used for strings
+		unsigned int	m_Hash;		//used for strings, hash of the characters
+		bool		m_Interned;	//used for strings, in the context's intern table
+		bool		m_Pinned;	//used for strings, referenced for the life of the context
+		bool		m_Piece = false;	//used for strings, part of a rope or parent of a view, its characters must not change
+		bool		m_Hashed = true;	//used for strings, false for views until m_Hash is needed
 		t			m_Data;
 		JetContext* m_Context = nullptr;
+		GCVal*		m_Left = nullptr;	//used for ropes, the two halves until m_Data gets built; for views the parent
+		GCVal*		m_Right = nullptr;
 		GCVal() { }
 
 		GCVal(t tt)
@@ -69,17 +122,57 @@ namespace Jet
 	
 	/// <summary>
 	/// ַ
+	/// Ͷļפַ(m_Interned)ͬפַֻһֱӱȽָ룻
+	/// פַٱ޸
+	/// ϳƴӽ(rope)m_DataΪգֻ¼룬ȡַ(±ꡢϣȽϡ)ʱչƽ
+	/// ϳӴͼ(view)m_Dataָ򸸴(m_Left)еַһ0βֻʣͼʱGCͼƳ
 	/// </summary>
-	struct String
+	typedef GCVal<char*> JetString;
+
+	//ĸθƵµm_Dataвϣ
+	void FlattenRope(JetString* str);
+
+	//ȡַm_Datam_Hash֮ǰ
+	inline JetString* Flatten(JetString* str)
 	{
-		bool mark, grey;
-		unsigned char refcount;
+		if (str->m_Data == 0)
+			FlattenRope(str);
+		return str;
+	}
 
-		unsigned int length;
-		unsigned int hash;
-		//string data would be stored after this point
-	};
-	typedef GCVal<char*> JetString;
+	inline bool IsView(JetString* str)
+	{
+		return str->m_Data && str->m_Left;
+	}
+
+	//ͼַƵԼm_DataУø
+	void DetachView(JetString* str);
+
+	//ͼm_Hash
+	void HashView(JetString* str);
+
+	//ȡm_Hash֮ǰãͼʱϣ
+	inline JetString* Hash(JetString* str)
+	{
+		if (str->m_Hashed == false)
+			HashView(str);
+		return str;
+	}
+
+	//Ҫ0βm_Dataʱ(Cַatoistrcmp)ãڸĩβͼ︴Ƴ
+	inline JetString* Terminate(JetString* str)
+	{
+		Flatten(str);
+		if (str->m_Data[str->m_Length] != 0)
+			DetachView(str);
+		return str;
+	}
+
+	//ַͷַͬһηУַͷ棻չƽַǵ
+	inline char* InlineData(JetString* str)
+	{
+		return (char*)(str + 1);
+	}
 
 	
 	/// <summary>
@@ -96,7 +189,9 @@ namespace Jet
 		bool	m_Grey;
 		ValueType m_Type;
 		unsigned char m_RefCount;		
-		JetContext* m_Context;
+		unsigned char m_Age;
+		JetContext* m_Context;//JetObject::m_Contextλͬ
+		unsigned int m_Dirty;//ϴα֮һдԪأռֻ￪ʼ±飬ռȰ
 		_JetArrayBacking m_Data;
 	};
 	//typedef GCVal<_JetArrayBacking> JetArray;
@@ -115,6 +210,7 @@ namespace Jet
 		bool		m_Grey;
 		ValueType	m_Type;
 		unsigned char m_RefCount;
+		unsigned char m_Age;
 		void*		m_Data;
 		JetObject*	m_Prototype;
 
@@ -131,33 +227,53 @@ namespace Jet
 	/// </summary>
 	typedef Value(*JetNativeFunc)(JetContext*,Value*, int);
 	
-	//each instruction can have a double, or two integers
+	//each instruction is an opcode with a short and an int operand
 	/// <summary>
-	/// ָ
+	/// ָ(8ֽڶʽ)
+	/// ӺFunctionĳУָֻ
 	/// </summary>
 	struct Instruction
 	{
 		//ָID
 		InstructionType m_Instruction;
 
-		//ָ
-		union
-		{
-			struct
-			{
-				int				m_Value;
-				union
-				{
-					int			m_Value2;
-					Function*	m_Function;
-					JetString*	m_StringLiteral ;
-					const char* m_String;
-				};
-			};
-
-			int64_t		m_IntValue;			//
-			double		m_RealValue;		//ʵ
-		};
+		//ָеľֲšInvokeMethodĲ
+		unsigned char	m_Value3;
+
+		//ڶհ㼶upvalueš
+		short			m_Value2;
+
+		//ššתĿꡢԪ
+		//LoadAt/StoreAtΪ-1ʱʾջ
+		int				m_Value;
+	};
+
+	/// <summary>
+	/// Է(LoadAt/StoreAt/InvokeMethod)
+	/// ״ᱻͷҲı䣬״ͬ˵ͬһλ
+	/// </summary>
+	struct InlineCache
+	{
+		Shape*			m_Shape;		//ߵ״ձʾδ
+		Shape*			m_HolderShape;	//ȡm_Holder״д룺Ӹü֮ǰ״
+		JetObject*		m_Holder;		//ձʾڽΪߵֱԭ
+		unsigned int	m_Slot;			//ڵĲλ
+	};
+
+	//ȫַ2
+#define JET_METHOD_CACHE_SIZE 256
+
+	/// <summary>
+	/// ȫַһԭm_Prototypeʼԭm_NameĽ
+	/// һӼıԭͶʹm_VersionʧЧֵĵֱַӻ
+	/// </summary>
+	struct MethodCacheEntry
+	{
+		JetObject*		m_Prototype;
+		JetString*		m_Name;			//פַ
+		Value*			m_Value;		//ձʾԭûиü
+		JetObject*		m_Holder;		//m_ValueڵĶ
+		unsigned int	m_Version;
 	};
 
 	/// <summary>
@@ -165,26 +281,12 @@ namespace Jet
 	/// </summary>
 	struct Function
 	{
-		~Function()
-		{
-			for (auto ii: this->m_Instructions)
-				if (ii.m_Instruction != InstructionType::CLoad 
-					&& ii.m_Instruction != InstructionType::CInit
-					&& ii.m_Instruction != InstructionType::LoadFunction 
-					&& ii.m_Instruction != InstructionType::LdStr 
-					&& ii.m_Instruction != InstructionType::LdInt
-					&& ii.m_Instruction != InstructionType::LdReal 
-					&& ii.m_Instruction != InstructionType::Call
-					&& ii.m_Instruction != InstructionType::Load
-					&& ii.m_Instruction != InstructionType::Store
-					&& ii.m_Instruction != InstructionType::CStore)
-					delete[] ii.m_String;
-		}
-
 		//
 		unsigned int m_Args;
 		//ֲ
 		unsigned int m_Locals;
+		//ֲ֮ʱֵϽ(ÿָѹһֵ)뺯ʱһԼջռ
+		unsigned int m_MaxStack;
 		//UpValue
 		unsigned int m_UpValues;
 		//ǷǱκ
@@ -195,9 +297,19 @@ namespace Jet
 		JetContext* m_Context;		
 		//ָ
 		std::vector<Instruction>	m_Instructions;
+		//(LdInt/LdReal/LdStrԼLoadAt/StoreAt)
+		std::vector<Value>			m_Constants;
+		//LoadFunctionõĺԭ
+		std::vector<Function*>		m_Prototypes;
+		//Էʵ棬űָm_Value2
+		std::vector<InlineCache>	m_Caches;
 
 		//еĺ
 		std::string					m_Name;
+
+		//뱻JIT뻹ʣĵѭm_JitΪĻ(JetJit)
+		int							m_Hotness;
+		JitCode*					m_Jit;
 	
 		//Ϣ
 		struct DebugInfo
@@ -220,6 +332,7 @@ namespace Jet
 		bool m_Grey;
 		Jet::ValueType	m_Type;
 		unsigned char	m_RefCount;
+		unsigned char	m_Age;
 
 		Function*		m_Prototype;//details about the function
 		Generator*		m_Generator;
@@ -230,35 +343,277 @@ namespace Jet
 		Closure*		m_Prev;//parent closure, used for searching for captures
 	};
 
+#ifdef JET_NAN_BOXING
+	/// <summary>
+	/// NaNװ䣺ʵֱӱΪdoubleͱڸNaNĵ48λУ16λΪͱǩ
+	/// 0xFFF8ӲĬNaNΪǩʹãдNaN淶Ϊ0x7FF8000000000000
+	/// </summary>
+	namespace NanBox
+	{
+		const uint64_t TagMask		= 0xFFFF000000000000ull;
+		const uint64_t PayloadMask	= 0x0000FFFFFFFFFFFFull;
+		const uint64_t CanonicalNaN	= 0x7FF8000000000000ull;
+		const int64_t  MaxInt		= (1ll << 47) - 1;
+		const int64_t  MinInt		= -(1ll << 47);
+
+		//͵ıǩRealûбǩ
+		inline uint64_t Tag(ValueType t)
+		{
+			return (uint64_t)(0xFFF1 + (int)t + ((int)t >= (int)ValueType::Function ? 1 : 0)) << 48;
+		}
+
+		inline bool IsTagged(uint64_t bits)
+		{
+			uint64_t hi = bits >> 48;
+			return hi > 0xFFF0 && hi != 0xFFF8;
+		}
+
+		inline ValueType Type(uint64_t bits)
+		{
+			static const ValueType types[16] = { ValueType::Real, ValueType::Null, ValueType::Int, ValueType::Real,
+				ValueType::NativeFunction, ValueType::String, ValueType::Object, ValueType::Array, ValueType::Real,
+				ValueType::Function, ValueType::Userdata, ValueType::Capture, ValueType::Real, ValueType::Real,
+				ValueType::Real, ValueType::Real };
+			return IsTagged(bits) ? types[(bits >> 48) & 15] : ValueType::Real;
+		}
+
+		inline uint64_t Real(double d)
+		{
+			uint64_t bits;
+			if (d != d)
+				return CanonicalNaN;
+			memcpy(&bits, &d, sizeof(bits));
+			return bits;
+		}
+
+		//48λתΪʵ
+		inline uint64_t Int(int64_t v)
+		{
+			if (v > MaxInt || v < MinInt)
+				return Real((double)v);
+			return Tag(ValueType::Int) | ((uint64_t)v & PayloadMask);
+		}
+
+		//a op bint64ʱtrue߸ʵ
+		inline bool AddOverflow(int64_t a, int64_t b, int64_t& r)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_add_overflow(a, b, &r);
+#else
+			if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+				return true;
+			r = a + b;
+			return false;
+#endif
+		}
+
+		inline bool SubOverflow(int64_t a, int64_t b, int64_t& r)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_sub_overflow(a, b, &r);
+#else
+			if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+				return true;
+			r = a - b;
+			return false;
+#endif
+		}
+
+		inline bool MulOverflow(int64_t a, int64_t b, int64_t& r)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_mul_overflow(a, b, &r);
+#else
+			if (a != 0 && b != 0)
+			{
+				if (a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+					: (b > 0 ? a < INT64_MIN / b : b < INT64_MAX / a))
+					return true;
+			}
+			r = a * b;
+			return false;
+#endif
+		}
+	}
+
+	//ֶValueNaNװʱԿͨṹһm_Typem_IntValueȳԱ
+	//Ƕֻͬһ64λ֣ͬһunionдͨmemcpyⲻͬԱ֮ı
+
+	struct NanWord
+	{
+		uint64_t m_Bits;
+
+		inline uint64_t Bits() const	{ uint64_t bits; memcpy(&bits, this, sizeof(bits)); return bits; }
+		inline void SetBits(uint64_t bits)	{ memcpy(this, &bits, sizeof(bits)); }
+	};
+
+	//ͣдʱ48λͷװģʽһֻıǩ
+	struct NanTypeField : NanWord
+	{
+		operator ValueType() const	{ return NanBox::Type(Bits()); }
+		explicit operator int() const	{ return (int)NanBox::Type(Bits()); }
+
+		bool operator==(ValueType t) const
+		{
+			if (t == ValueType::Real)
+				return !NanBox::IsTagged(Bits());
+			return (Bits() & NanBox::TagMask) == NanBox::Tag(t);
+		}
+		bool operator!=(ValueType t) const	{ return !(*this == t); }
+
+		NanTypeField& operator=(ValueType t)
+		{
+			uint64_t bits = Bits();
+			if (t == ValueType::Real)
+			{
+				if (NanBox::IsTagged(bits))
+					SetBits(bits & NanBox::PayloadMask);
+			}
+			else
+				SetBits(NanBox::Tag(t) | (bits & NanBox::PayloadMask));
+			return *this;
+		}
+	};
+
+	//IntʵдʱõInt(תΪʵ)ֻдغ
+	struct NanIntField : NanWord
+	{
+		//ʵԭʼλȡͷװģʽunionĶһ(תһ)
+		operator int64_t() const
+		{
+			uint64_t bits = Bits();
+			if (!NanBox::IsTagged(bits))
+				return (int64_t)bits;
+			return ((int64_t)(bits << 16)) >> 16;
+		}
+
+		NanIntField& operator=(int64_t v)
+		{
+			uint64_t bits = Bits();
+			uint64_t tag = bits & NanBox::TagMask;
+			if (tag == NanBox::Tag(ValueType::Int) || !NanBox::IsTagged(bits))
+				SetBits(NanBox::Int(v));
+			else
+				SetBits(tag | ((uint64_t)v & NanBox::PayloadMask));
+			return *this;
+		}
+
+		//int64ʱȵõתֱʵ
+		NanIntField& operator+=(int64_t v)
+		{
+			int64_t a = *this, r;
+			if (NanBox::AddOverflow(a, v, r))
+				return this->Overflow((double)a + (double)v);
+			return *this = r;
+		}
+		NanIntField& operator-=(int64_t v)
+		{
+			int64_t a = *this, r;
+			if (NanBox::SubOverflow(a, v, r))
+				return this->Overflow((double)a - (double)v);
+			return *this = r;
+		}
+		NanIntField& operator*=(int64_t v)
+		{
+			int64_t a = *this, r;
+			if (NanBox::MulOverflow(a, v, r))
+				return this->Overflow((double)a * (double)v);
+			return *this = r;
+		}
+		NanIntField& operator/=(int64_t v)	{ return *this = (int64_t)*this / v; }
+		NanIntField& operator%=(int64_t v)	{ return *this = (int64_t)*this % v; }
+		NanIntField& operator&=(int64_t v)	{ return *this = (int64_t)*this & v; }
+		NanIntField& operator|=(int64_t v)	{ return *this = (int64_t)*this | v; }
+		NanIntField& operator^=(int64_t v)	{ return *this = (int64_t)*this ^ v; }
+		NanIntField& operator<<=(int64_t v)	{ return *this = (int64_t)*this << v; }
+		NanIntField& operator>>=(int64_t v)	{ return *this = (int64_t)*this >> v; }
+		NanIntField& operator++()	{ return *this += 1; }
+		NanIntField& operator--()	{ return *this -= 1; }
+		int64_t operator++(int)	{ int64_t v = *this; *this = v + 1; return v; }
+		int64_t operator--(int)	{ int64_t v = *this; *this = v - 1; return v; }
+
+	private:
+		//NanBox::Intг48λһIntʵͲ
+		NanIntField& Overflow(double d)
+		{
+			SetBits(NanBox::Real(d));
+			return *this;
+		}
+	};
+
+	//ʵдֵReal
+	struct NanRealField : NanWord
+	{
+		operator double() const
+		{
+			double d;
+			memcpy(&d, this, sizeof(d));
+			return d;
+		}
+
+		NanRealField& operator=(double d)	{ SetBits(NanBox::Real(d)); return *this; }
+
+		NanRealField& operator+=(double v)	{ return *this = (double)*this + v; }
+		NanRealField& operator-=(double v)	{ return *this = (double)*this - v; }
+		NanRealField& operator*=(double v)	{ return *this = (double)*this * v; }
+		NanRealField& operator/=(double v)	{ return *this = (double)*this / v; }
+		NanRealField& operator++()	{ return *this += 1; }
+		NanRealField& operator--()	{ return *this -= 1; }
+		double operator++(int)	{ double v = *this; *this = v + 1; return v; }
+		double operator--(int)	{ double v = *this; *this = v - 1; return v; }
+	};
+
+	//ָ룺ֻдغɣm_Type
+	template<class T>
+	struct NanPtrField : NanWord
+	{
+		operator T() const	{ return (T)(uintptr_t)(this->Bits() & NanBox::PayloadMask); }
+		T operator->() const	{ return (T)(uintptr_t)(this->Bits() & NanBox::PayloadMask); }
+
+		NanPtrField& operator=(T p)
+		{
+			this->SetBits((this->Bits() & NanBox::TagMask) | ((uint64_t)(uintptr_t)p & NanBox::PayloadMask));
+			return *this;
+		}
+	};
+#endif
+
 	/// <summary>
 	/// ֵ
 	/// </summary>
 	struct Value
 	{
+#ifdef JET_NAN_BOXING
+		union
+		{
+			NanTypeField				m_Type;
+			NanIntField					m_IntValue;
+			NanRealField				m_RealValue;
+
+			NanPtrField<JetString*>		m_String;
+			NanPtrField<JetObject*>		m_Object;
+			NanPtrField<JetArray*>		m_Array;
+			NanPtrField<JetUserdata*>	m_UserData;
+			NanPtrField<Closure*>		m_Function;	//jet function
+
+			NanPtrField<JetNativeFunc>	m_NativeFunction;		//native func
+		};
+#else
 		ValueType				m_Type;
 		union
 		{
 			int64_t				m_IntValue;
 			double				m_RealValue;
-			
-			struct
-			{
-				union
-				{
-					JetString*		m_String;
-					JetObject*		m_Object;
-					JetArray*		m_Array;
-					JetUserdata*	m_UserData;
-					Closure*		m_Function;	//jet function
-				};
-				union
-				{
-					unsigned int	m_Length;	//used for strings
-				};
-			};
-
-			JetNativeFunc			m_NativeFunction;		//native func
+
+			JetString*			m_String;
+			JetObject*			m_Object;
+			JetArray*			m_Array;
+			JetUserdata*		m_UserData;
+			Closure*			m_Function;	//jet function
+
+			JetNativeFunc		m_NativeFunction;		//native func
 		};
+#endif
 
 		Value();
 
@@ -305,7 +660,7 @@ namespace Jet
 		{
 			if (m_Type == ValueType::Int)		return (int)m_IntValue;
 			else if (m_Type == ValueType::Real)	return (int)m_RealValue;
-			else if (m_Type == ValueType::String) return atoi(m_String->m_Data);
+			else if (m_Type == ValueType::String) return atoi(Terminate(m_String)->m_Data);
 			throw RuntimeException("Cannot convert type " + (std::string)ValueTypes[(int)this->m_Type] + " to int!");
 		}
 
@@ -313,7 +668,7 @@ namespace Jet
 		{
 			if (m_Type == ValueType::Int)		return m_IntValue;
 			if (m_Type == ValueType::Real)	return (int64_t)m_RealValue;
-			else if (m_Type == ValueType::String) return _atoi64(m_String->m_Data);
+			else if (m_Type == ValueType::String) return _atoi64(Terminate(m_String)->m_Data);
 			throw RuntimeException("Cannot convert type " + (std::string)ValueTypes[(int)this->m_Type] + " to int!");
 		}
 
@@ -321,7 +676,7 @@ namespace Jet
 		{
 			if (m_Type == ValueType::Int)		return (double)m_IntValue;
 			if (m_Type == ValueType::Real)	return m_RealValue;
-			else if (m_Type == ValueType::String) return atof(m_String->m_Data);
+			else if (m_Type == ValueType::String) return atof(Terminate(m_String)->m_Data);
 
 			throw RuntimeException("Cannot convert type " + (std::string)ValueTypes[(int)this->m_Type] + " to real!");
 		}
@@ -398,10 +753,11 @@ namespace Jet
 		static Value	Zero;
 		static Value	One;
 	private:
-		Value CallMetamethod(const char* name, const Value* other);
-		Value CallMetamethod(JetObject* table, const char* name, const Value* other);
+		//ԪtableԭͿʼԭңԶݵtableΪԭͣΪԼ
+		Value CallMetamethod(JetObject* table, Metamethod method, const Value* other);
+		Value CallMetamethod(Metamethod method, const Value* other);
 
-		bool TryCallMetamethod(const char* name, const Value* args, int numargs, Value* out) const;
+		bool TryCallMetamethod(Metamethod method, const Value* args, int numargs, Value* out) const;
 
 		friend class JetContext;
 	};
@@ -415,13 +771,13 @@ namespace Jet
 		{\
 		switch (a.m_Type)	{\
 			case ValueType::Int:	{	\
-				if (b.m_Type == ValueType::Real)		{	a.m_Type = ValueType::Real;	a.m_RealValue = (double)a.m_IntValue op b.m_RealValue;	}\
+				if (b.m_Type == ValueType::Real)		{	double a_ = (double)a.m_IntValue;	a.m_Type = ValueType::Real;	a.m_RealValue = a_ op b.m_RealValue;	}\
 								else if (b.m_Type == ValueType::Int)	{	a.m_IntValue op2 b.m_IntValue;}\
 								else									{	a op2 b;	}\
 				break;				}\
 			case ValueType::Real:	{\
 				if (b.m_Type == ValueType::Real)		{	a.m_RealValue op2 b.m_RealValue;		}\
-								else if (b.m_Type == ValueType::Int)	{	a.m_RealValue op2 (double)b.m_RealValue;	}\
+								else if (b.m_Type == ValueType::Int)	{	a.m_RealValue op2 (double)b.m_IntValue;	}\
 								else									{	a op2 b;	}\
 				break;				}\
 			default:a op2 b; break;\
@@ -433,13 +789,13 @@ namespace Jet
 			{\
 			switch (a.m_Type)	{\
 			case ValueType::Int:	{	\
-				if (b.m_Type == ValueType::Real)		{	r.m_IntValue = (int)(((double)a.m_IntValue - b.m_RealValue) op 0);	}\
-				else if (b.m_Type == ValueType::Int)	{	r.m_IntValue=(int)((a.m_IntValue - b.m_IntValue) op 0);}\
+				if (b.m_Type == ValueType::Real)		{	r.m_IntValue = (int)((double)a.m_IntValue op b.m_RealValue);	}\
+				else if (b.m_Type == ValueType::Int)	{	r.m_IntValue=(int)(a.m_IntValue op b.m_IntValue);}\
 				else									{	r.m_IntValue=(int)(a.Compare(b) op 0);	}\
 				break;				}\
 			case ValueType::Real:	{\
-				if (b.m_Type == ValueType::Real)		{	r.m_IntValue=(int)((a.m_RealValue - b.m_RealValue) op 0);		}\
-				else if (b.m_Type == ValueType::Int)	{	r.m_IntValue=(int)((a.m_RealValue - (double)b.m_RealValue) op 0);	}\
+				if (b.m_Type == ValueType::Real)		{	r.m_IntValue=(int)(a.m_RealValue op b.m_RealValue);		}\
+				else if (b.m_Type == ValueType::Int)	{	r.m_IntValue=(int)(a.m_RealValue op (double)b.m_IntValue);	}\
 				else									{	r.m_IntValue=(int)(a.Compare(b) op 0);	}\
 				break;				}\
 			default:r.m_IntValue=(int)(a.Compare(b) op 0); break;\
@@ -447,6 +803,49 @@ namespace Jet
 			r.m_Type=ValueType::Int;\
 			}
 
+	//ΪĴָ;ֲָ㣬JIT·
+	//ĴָҲxΪʱǳ~xǾֲx
+#define VALUES_RK(sp,constants,x) ((x) >= 0 ? (sp)[(x)] : (constants)[~(x)])
+
+	//sp[m_Value3] = sp[m_Value2] op RK(m_Value)ʱ߿·ȸƣΪܾǲ
+	//ͬop2㣬NaNװʱĽתΪʵ
+#define VALUES_REGISTER_OP(sp,constants,in,op,op2) \
+		{\
+		const Value& a_ = (sp)[(in)->m_Value2];\
+		const Value& b_ = VALUES_RK(sp, constants, (in)->m_Value);\
+		Value r_ = a_;\
+		if (a_.m_Type == ValueType::Int && b_.m_Type == ValueType::Int) { r_.m_IntValue op2 b_.m_IntValue; }\
+		else { VALUES_OP(r_, b_, op, op2); }\
+		(sp)[(in)->m_Value3] = r_;\
+		}
+
+	//ûп·ļĴָȡģΪ:VALUES_REGISTER_ASSIGN(sp,constants,in,%=);
+#define VALUES_REGISTER_ASSIGN(sp,constants,in,op2) \
+		{\
+		Value a_ = (sp)[(in)->m_Value2];\
+		a_ op2 VALUES_RK(sp, constants, (in)->m_Value);\
+		(sp)[(in)->m_Value3] = a_;\
+		}
+
+	//sp[m_Value3] = sp[m_Value2] op RK(m_Value)ıȽϽ
+#define VALUES_REGISTER_CMP(sp,constants,in,op) \
+		{\
+		Value& a_ = (sp)[(in)->m_Value2];\
+		const Value& b_ = VALUES_RK(sp, constants, (in)->m_Value);\
+		Value r_;\
+		VALUES_CMP(r_, a_, b_, op);\
+		(sp)[(in)->m_Value3] = r_;\
+		}
+
+	//ֲm_Value2m_Value(1-1)
+#define VALUES_INCR_LOCAL(sp,in) \
+		{\
+		Value& a_ = (sp)[(in)->m_Value2];\
+		if (a_.m_Type == ValueType::Int)	a_.m_IntValue += (in)->m_Value;\
+		else if ((in)->m_Value > 0)			a_.Increase();\
+		else								a_.Decrease();\
+		}
+
 	/// <summary>
 	/// հĲֵ
 	/// </summary>
@@ -456,6 +855,7 @@ namespace Jet
 		bool m_Grey;
 		Jet::ValueType	m_Type;
 		unsigned char	m_RefCount;
+		unsigned char	m_Age;
 
 		Value*			m_Ptr;//points to self when closed, or stack when open
 		Value			m_Value;
@@ -468,7 +868,7 @@ namespace Jet
 	};
 
 	/// <summary>
-	/// ڵ㣬ڶڲʵMap
+	/// ڵ㣬ֵģʽ°˳ܴŵļֵ
 	/// </summary>
 	struct ObjNode
 	{
@@ -476,78 +876,122 @@ namespace Jet
 		Value		first;
 		// Value
 		Value		second;
-		// Next
-		ObjNode*	next;
+	};
+
+	//ֵģʽĹϣ̽⣬ÿĿֽ
+#define JET_OBJECT_GROUP 16
+	//λõĿֽڣλõĿֽΪϣĵ7λ
+#define JET_OBJECT_EMPTY 0x80
+	//鲿ֵ󳤶Ϊ2ôη
+#define JET_MAX_ARRAY_BITS 26
+	//x86SSE2һαȽһֽڣJET_NO_SIMDʹֽڱȽ
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(JET_NO_SIMD)
+#define JET_SSE2
+#endif
+
+	//״ĲλļתΪֵģʽ
+#define JET_MAX_SHAPE_SLOTS 64
+	//һ״ת¼״תΪֵģʽ
+#define JET_MAX_SHAPE_TRANSITIONS 256
+
+	/// <summary>
+	/// ״()¼λӳ
+	/// Ĳ˳ͬĶͬһ״״JetContextУֱJetContextͷ
+	/// </summary>
+	struct Shape
+	{
+		Shape*		m_Parent;
+		//ÿλļַ״(AddRef)
+		std::vector<Value>	m_Keys;
+		//һ¼õ״פַΪ
+		std::unordered_map<JetString*, Shape*> m_Transitions;
+
+		Shape(Shape* parent);
+		~Shape();
+
+		//Ҽ(פַ)ڵĲλʱ-1
+		int Find(JetString* key) const;
+
+		//¼״ʱ0
+		Shape* Transition(JetContext* context, JetString* key);
+	};
+
+	/// <summary>
+	/// ʱõļֵ
+	/// </summary>
+	struct ObjEntry
+	{
+		const Value		first;	//鲿ֵļڴУֵ
+		Value&			second;
 	};
 
 	/// <summary>
 	/// ڲԪصĵ
+	/// Ȱ±鲿֣״ģʽ°λֵģʽ°ڵ
 	/// </summary>
 	template <class T> class ObjIterator
 	{
-		typedef ObjNode Node;
 		typedef ObjIterator<T> Iterator;
-		Node*		ptr;
-		JetObject*	parent;
+		JetObject*		parent;
+		unsigned int	index;
 	public:
 		ObjIterator()
 		{
 			this->parent = 0;
-			this->ptr = 0;
+			this->index = (unsigned int)-1;
 		}
 
 		ObjIterator(JetObject* p)
 		{
 			this->parent = p;
-			this->ptr = 0;
+			this->index = (unsigned int)-1;
 		}
 
-		ObjIterator(JetObject* p, Node* node)
+		ObjIterator(JetObject* p, unsigned int i)
 		{
 			this->parent = p;
-			this->ptr = node;
+			this->index = i;
 		}
 
 		bool operator==(const Iterator& other)
 		{
-			return ptr == other.ptr;
+			return this->index == other.index;
 		}
 
 		bool operator!=(const Iterator& other)
 		{
-			return this->ptr != other.ptr;
+			return this->index != other.index;
 		}
 
 		Iterator& operator++()
 		{
-			if (ptr && ((this->ptr-this->parent->m_Nodes) < ((int)this->parent->m_NodeCount-1)))
-			{
-				do
-				{
-					this->ptr++;
-					if (ptr->first.m_Type != ValueType::Null)
-						return *this;
-				}
-				while ((this->ptr-this->parent->m_Nodes) < ((int)this->parent->m_NodeCount-1));
-			}
-			this->ptr = 0;
-
+			this->index = this->parent->next(this->index + 1);
 			return *this;
 		};
 
-		Node*& operator->() const
-		{	// return pointer to class object
-			return (Node*&)this->ptr;//this does pointer magic and gives a reference to the pair containing the key and value
-		}
-
-		Node& operator*()
+		ObjEntry operator*()
 		{
-			return *this->ptr;
+			return this->parent->entry(this->index);
 		}
 	};
 
+	/// <summary>
+	/// 󻺴ԪӸöʼԭҸԪĽ
+	/// 汾JetContext::m_MetaVersionʱҪ²
+	/// </summary>
+	struct MetaTable
+	{
+		uint64_t		m_Version;
+		//iλʾеiԪ
+		uint32_t		m_Present;
+		Value			m_Methods[(int)Metamethod::Count];
+	};
+
 	/// <summary>
 	/// ű
+	/// ״ģʽڹShapeУֵλm_Slots
+	/// ַ̫ʱתΪֵģʽʹm_Nodesϣ
+	/// 0m_ArraySize-1鲿m_ArrayУֵʾ
 	/// </summary>
 	class JetObject
 	{
@@ -555,58 +999,77 @@ namespace Jet
 		friend struct Value;
 		friend class GarbageCollector;
 		friend class JetContext;
+		friend class JetJit;
 
 		//gc header
 		bool	m_Mark;
 		bool	m_Grey;
 		Jet::ValueType	m_Type;
 		unsigned char	m_RefCount;
+		unsigned char	m_Age;
+		//ԪĲҾ˸öӼд»߿ͷļıԭʱҪʹʧЧ
+		bool			m_MethodCached;
 
 		JetContext*		m_Context;
+		//״Ϊ0ʱֵģʽ
+		Shape*			m_Shape;
+		//״ģʽµֵλ
+		Value*			m_Slots;
+		//ֵģʽµļֵԣ˳
 		ObjNode*		m_Nodes;
+		//ֵģʽ¹ϣĿֽ(m_TableSize)ÿλöӦm_Nodes±
+		unsigned char*	m_Ctrl;
 		JetObject*		m_Prototype;
 
 		unsigned int	m_Size;
+		//ֵģʽΪm_Nodes(ϣλ7/8)״ģʽΪm_Slots
 		unsigned int	m_NodeCount;
+		//ֵģʽ¹ϣλJET_OBJECT_GROUPıΪ2
+		unsigned int	m_TableSize;
+
+		//鲿֣±꼴
+		Value*			m_Array;
+		unsigned int	m_ArraySize;
+
+		//ԪõʱŴ
+		MetaTable*		m_Meta;
 	public:
 		typedef ObjIterator<Value> Iterator;
 
 		JetObject(JetContext* context);
 		~JetObject();
 
+		//hash of a key, mixed with the seed of the context
 		std::size_t key(const Value* v) const;
 
-		Iterator find(const Value& key)
-		{
-			ObjNode* node = this->findNode(&key);
-			return Iterator(this, node);
-		}
-
-		Iterator find(const char* key)
-		{
-			ObjNode* node = this->findNode(key);
-			return Iterator(this, node);
-		}
+		Iterator find(const Value& key);
+		Iterator find(const char* key);
+		Iterator find(JetString* key);
 
 		//this are faster versions used in the VM
 		Value get(const Value& key)
 		{
-			auto node = this->findNode(&key);
-			return node ? node->second : Value();
+			if (auto slot = this->arraySlot(&key))
+				return *slot;
+			auto v = this->findValue(&key);
+			return v ? *v : Value();
 		}
 		Value get(const char* key)
 		{
-			auto node = this->findNode(key);
-			return node ? node->second : Value();
+			auto v = this->findValue(key);
+			return v ? *v : Value();
 		}
 
-		//just looks for a node
-		ObjNode* findNode(const Value* key);
-		ObjNode* findNode(const char* key);
+		//just looks for a value
+		Value* findValue(const Value* key);
+		Value* findValue(const char* key);
+		//key must be interned, string keys then compare by pointer
+		Value* findValue(JetString* key);
 
-		//finds node for key or creates one if doesnt exist
-		ObjNode* getNode(const Value* key);
-		ObjNode* getNode(const char* key);
+		//finds the value for key or creates one if doesnt exist, string keys get interned
+		Value* getValue(const Value* key);
+		Value* getValue(const char* key);
+		Value* getValue(JetString* key);
 
 		//try not to use these in the vm
 		Value& operator [](const Value& key);
@@ -619,30 +1082,56 @@ namespace Jet
 
 		Iterator begin()
 		{
-			for (unsigned int i = 0; i < this->m_NodeCount; i++)
-				if (this->m_Nodes[i].first.m_Type != ValueType::Null)
-					return Iterator(this, &m_Nodes[i]);
-			return end();
+			return Iterator(this, this->next(0));
 		}
 
-		inline size_t size()
-		{
-			return this->m_Size;
-		}
+		//keys in the shape or hash part plus the used slots of the array part
+		size_t size() const;
 
-		inline void SetPrototype(JetObject* obj)
-		{
-			this->m_Prototype = obj;
-		}
+		void SetPrototype(JetObject* obj);
+
+		//the metamethod found from this object up its prototype chain, 0 if there is none
+		const Value* GetMetamethod(Metamethod method);
 
 		void DebugPrint();
 
 	private:
-		//finds an open node in the table for inserting
-		ObjNode* getFreePosition();
+		//looks up all metamethods again after a key starting with _ was written on the chain
+		MetaTable* UpdateMetamethods();
+
+		//the array part slot of key if it is an int in range, may hold null
+		Value* arraySlot(const Value* key) const
+		{
+			return key->m_Type == ValueType::Int && (uint64_t)key->m_IntValue < this->m_ArraySize ? &this->m_Array[key->m_IntValue] : 0;
+		}
+
+		//grows the array part to the largest power of two that would be more than half used,
+		//counting the int keys in both parts and key, and moves keys from the hash part into it.
+		//Returns false if the array part stays as it is
+		bool Rebalance(const Value* key);
+
+		//finds a node in dictionary mode, string keys must be interned
+		ObjNode* findNode(const Value* key);
+		ObjNode* findNode(const Value* key, size_t hash);
+
+		//finds node for key or creates one if doesnt exist, dictionary mode only
+		ObjNode* getNode(const Value* key);
+
+		//puts the index of a node at the first empty position for its hash
+		void Insert(size_t hash, unsigned int node);
+
+		//rebuilds the table with size positions and room for 7/8 as many nodes
+		void Rehash(unsigned int size);
+
+		//switches to shape, which must be a transition of the current shape, and adds its new slot
+		void Append(Shape* shape);
+
+		//moves all keys into a hash table, used once the object no longer fits a shape
+		void ToDictionary();
 
-		//increases the size to fit new keys
-		void resize();
+		//iterator support: the first used position at or after i, and the entry there
+		unsigned int next(unsigned int i) const;
+		ObjEntry entry(unsigned int i);
 
 		//memory barrier
 		void Barrier();